@@ -0,0 +1,574 @@
+// For _setjmp/_longjmp when built with -D KR_EXCEPT_FAST_JMP.
+#define _XOPEN_SOURCE 700
+
+#include "krbase.h"
+#include "krclib.h"
+#include "krgrid.h"
+#include "krmaze.h"
+#include <time.h>
+#include <math.h>
+#include <setjmp.h>
+#include <stdint.h>
+
+// Micro-benchmarks. Build and run with `make bench`, optionally naming
+// the benchmarks to run:  ./bench iter_pipeline
+
+// Results are accumulated here so the compiler cannot drop the work.
+static volatile double bench_sink;
+
+static double bench_seconds(void)
+{
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#define BENCH_CASE(NAME_)  static void Bench_##NAME_(int n)
+
+static void bench_report(const char *name, const char *variant, int n, double secs)
+{
+	printf("%-20s %-18s %12d  %9.3f ms  %8.2f ns/op\n",
+	       name, variant, n, secs * 1e3, secs * 1e9 / n);
+}
+
+#define BENCH_TIME(NAME_, VARIANT_, N_, ...)  \
+	do{ \
+		double start_ = bench_seconds(); \
+		__VA_ARGS__; \
+		bench_report((NAME_), (VARIANT_), (N_), bench_seconds() - start_); \
+	}while(0)
+
+//----------------------------------------------------------------------
+// Iterators
+
+static bool   bench_is_positive(double x)       { return x > 0.0; }
+static double bench_square(double x)            { return x * x; }
+static double bench_add(double a, double b)     { return a + b; }
+
+ITER_FILTER_TEMPLATE(BenchPositives, NumIter, double, bench_is_positive)
+ITER_MAP_TEMPLATE(BenchSquares, BenchPositives, double, bench_square)
+ITER_REDUCE_TEMPLATE(bench_sum_squares, BenchSquares, double, bench_add)
+
+BENCH_CASE(iter_pipeline)
+{
+	double *data = malloc(sizeof(double) * n);
+	for (int i = 0; i < n; ++i)
+		data[i] = sin(i);
+
+	BENCH_TIME("iter_pipeline", "hand loop", n, {
+		double total = 0.0;
+		for (int i = 0; i < n; ++i)
+			if (data[i] > 0.0)
+				total += data[i] * data[i];
+		bench_sink += total;
+	});
+
+	BENCH_TIME("iter_pipeline", "pipeline", n, {
+		bench_sink += bench_sum_squares(
+			BenchSquares_begin(BenchPositives_begin(NumIter_begin(data, n))), 0.0);
+	});
+
+	free(data);
+}
+
+//----------------------------------------------------------------------
+// Exceptions
+//
+// The throw/catch round trip through krclib: EXCEPT_BEGIN, except_throw
+// filling the frame's error record, and except_dispose, against the old
+// path that mallocs an error per throw and frees it after the catch, and
+// a bare setjmp/longjmp, the floor for any throw. Build with
+// -D KR_EXCEPT_FAST_JMP for the _setjmp/_longjmp variant.
+
+__attribute__((noinline))
+static void bench_longjmp(jmp_buf env, int status)
+{
+	longjmp(env, status);
+}
+
+BENCH_CASE(except_throw)
+{
+	BENCH_TIME("except_throw", "except_throw", n, {
+		for (int i = 0; i < n; ++i) {
+			struct except_frame xf = {0};
+			if (EXCEPT_BEGIN(xf) == EXCEPT_TRY)
+				EXCEPT_THROW(&xf, STATUS_ERROR);
+			bench_sink += xf.error->status;
+			except_dispose(&xf);
+		}
+	});
+
+	BENCH_TIME("except_throw", "malloc per throw", n, {
+		for (int i = 0; i < n; ++i) {
+			struct except_frame xf = {0};
+			if (EXCEPT_BEGIN(xf) == EXCEPT_TRY) {
+				struct error *error = malloc(sizeof(*error));
+				if (!error)
+					FAILURE(STATUS_MALLOC_FAIL, "Failed to malloc error object.");
+				*error = (struct error){ .source = SRCLOC, .status = STATUS_ERROR };
+				except_throw_error(&xf, error);
+			}
+			bench_sink += xf.error->status;
+			free(xf.error);
+			except_dispose(&xf);
+		}
+	});
+
+	BENCH_TIME("except_throw", "bare longjmp", n, {
+		for (int i = 0; i < n; ++i) {
+			jmp_buf env;
+			int status = setjmp(env);
+			if (status == 0)
+				bench_longjmp(env, STATUS_ERROR);
+			bench_sink += status;
+		}
+	});
+}
+
+//----------------------------------------------------------------------
+// Checked Arithmetic
+//
+// A hot loop of overflow-checked size calculations: try_size_mult and
+// try_size_add under a per-iteration except_frame, versus chained status
+// results with size_mult_checked and size_add_checked.
+
+BENCH_CASE(checked_math)
+{
+	BENCH_TIME("checked_math", "except_frame", n, {
+		size_t total = 0;
+		for (int i = 0; i < n; ++i) {
+			struct except_frame xf = {0};
+			if (EXCEPT_BEGIN(xf) == EXCEPT_TRY)
+				total += try_size_add(try_size_mult(i, 24, &xf, SRCSITE("throw")), 16, &xf, SRCSITE("throw"));
+			except_dispose(&xf);
+		}
+		bench_sink += total;
+	});
+
+	BENCH_TIME("checked_math", "status result", n, {
+		size_t total = 0;
+		for (int i = 0; i < n; ++i) {
+			struct size_result r = size_add_checked(size_mult_checked(size_checked(i), 24), 16);
+			if (r.status == STATUS_OK)
+				total += r.value;
+		}
+		bench_sink += total;
+	});
+}
+
+//----------------------------------------------------------------------
+// Index Checks
+//
+// Summing a row-major grid through a grid_index like maze.c's, which
+// checks the row and column of every cell: with the old out-of-line
+// check_index (reproduced here), the inline one, boundary-only wrapping,
+// and one FOR_RANGE_CHECKED per row.
+
+enum { BENCH_GRID_ROWS = 512, BENCH_GRID_COLS = 512 };
+
+struct bench_grid { int nrows, ncols; int *cells; };
+
+__attribute__((noinline))
+static int bench_check_index_call(int len, int i, const struct SourceSite *site)
+{
+	i += len * (i < 0);
+	if (i < 0 || i >= len) {
+		struct AssertHandler *h = AssertHandler_current();
+		h->fail(h->bag, site->location, "Array index %d out of bounds [%d,%d).", i, 0, len);
+	}
+	return i;
+}
+
+#define BENCH_GRID_SUM(VARIANT_, INDEX_)  \
+	BENCH_TIME("grid_traverse", (VARIANT_), passes * cells, { \
+		long total = 0; \
+		for (int pass = 0; pass < passes; ++pass) \
+			for (int row = 0; row < g.nrows; ++row) \
+				for (int col = 0; col < g.ncols; ++col) \
+					total += g.cells[INDEX_]; \
+		bench_sink += total; \
+	})
+
+BENCH_CASE(grid_traverse)
+{
+	struct bench_grid g = { BENCH_GRID_ROWS, BENCH_GRID_COLS };
+	int cells = g.nrows * g.ncols;
+	int passes = int_max(1, n / cells);
+	g.cells = malloc(sizeof(int) * cells);
+	for (int i = 0; i < cells; ++i)
+		g.cells[i] = i & 0xFF;
+
+	BENCH_GRID_SUM("unchecked", row * g.ncols + col);
+	BENCH_GRID_SUM("out-of-line",
+		bench_check_index_call(g.nrows, row, SRCSITE("index check")) * g.ncols + bench_check_index_call(g.ncols, col, SRCSITE("index check")));
+	BENCH_GRID_SUM("inline check",
+		CHECK_BOUNDARY_LEN(g.nrows, row) * g.ncols + CHECK_BOUNDARY_LEN(g.ncols, col));
+	BENCH_GRID_SUM("boundary only",
+		wrap_index(g.nrows, row) * g.ncols + wrap_index(g.ncols, col));
+
+	BENCH_TIME("grid_traverse", "range per row", passes * cells, {
+		long total = 0;
+		for (int pass = 0; pass < passes; ++pass)
+			FOR_RANGE_CHECKED(row, g.nrows, 0, g.nrows) {
+				const int *cells_row = g.cells + row * g.ncols;
+				FOR_RANGE_CHECKED(col, g.ncols, 0, g.ncols)
+					total += cells_row[col];
+			}
+		bench_sink += total;
+	});
+
+	free(g.cells);
+}
+
+//----------------------------------------------------------------------
+// Grid Layouts
+//
+// A 1024x1024 grid of doubles (8 MB) in each layout: a row walk, a column
+// walk, and a 5-point stencil visited tile by tile.
+
+static double bench_stencil(struct Grid *g, int row, int col)
+{
+	return *(double*)Grid_at_unchecked(g, row-1, col) + *(double*)Grid_at_unchecked(g, row+1, col)
+	     + *(double*)Grid_at_unchecked(g, row, col-1) + *(double*)Grid_at_unchecked(g, row, col+1)
+	     - 4.0 * *(double*)Grid_at_unchecked(g, row, col);
+}
+
+BENCH_CASE(grid_layouts)
+{
+	enum { SIDE = 1024 };
+	int cells = SIDE * SIDE;
+	int passes = int_max(1, n / cells);
+	struct GridRect interior = { 1, 1, SIDE - 1, SIDE - 1 };
+
+	for (enum GridLayout layout = 0; layout < GRID_LAYOUT_COUNT; ++layout) {
+		struct Grid *g = Grid_create(SIDE, SIDE, sizeof(double), layout);
+		for (int row = 0; row < SIDE; ++row)
+			for (int col = 0; col < SIDE; ++col)
+				GRID_AT(double, g, row, col) = sin(row * 0.01) + col;
+
+		char variant[32];
+		snprintf(variant, sizeof(variant), "%s rows", GridLayout_name(layout));
+		BENCH_TIME("grid_layouts", variant, passes * cells, {
+			double total = 0.0;
+			for (int pass = 0; pass < passes; ++pass)
+				for (int row = 0; row < SIDE; ++row)
+					ITER_FOREACH(GridRowIter, it, GridRowIter_begin(g, row))
+						total += *(double*)GridRowIter_get(it);
+			bench_sink += total;
+		});
+
+		snprintf(variant, sizeof(variant), "%s cols", GridLayout_name(layout));
+		BENCH_TIME("grid_layouts", variant, passes * cells, {
+			double total = 0.0;
+			for (int pass = 0; pass < passes; ++pass)
+				for (int col = 0; col < SIDE; ++col)
+					ITER_FOREACH(GridColIter, it, GridColIter_begin(g, col))
+						total += *(double*)GridColIter_get(it);
+			bench_sink += total;
+		});
+
+		snprintf(variant, sizeof(variant), "%s stencil", GridLayout_name(layout));
+		BENCH_TIME("grid_layouts", variant, passes * cells, {
+			double total = 0.0;
+			for (int pass = 0; pass < passes; ++pass)
+				ITER_FOREACH(GridTileIter, t, GridTileIter_begin(g)) {
+					struct GridRect r = GridTileIter_get(t);
+					r.row0 = int_max(r.row0, interior.row0);  r.row1 = int_min(r.row1, interior.row1);
+					r.col0 = int_max(r.col0, interior.col0);  r.col1 = int_min(r.col1, interior.col1);
+					ITER_FOREACH(GridRectIter, c, GridRectIter_begin(g, r))
+						total += bench_stencil(g, c.row, c.col);
+				}
+			bench_sink += total;
+		});
+
+		Grid_destroy(g);
+	}
+}
+
+//----------------------------------------------------------------------
+// Stencils
+//
+// Game of Life and a diffusion step on a 1024x1024 torus: a per-cell loop
+// over two Grids that checks and wraps every neighbour index, then
+// Stencil_step with its ghost border on one and on four threads.
+
+static int bench_life_neighbours(struct Grid *g, int row, int col)
+{
+	int n = 0;
+	for (int dr = -1; dr <= 1; ++dr)
+		for (int dc = -1; dc <= 1; ++dc)
+			if (dr || dc)
+				n += GRID_AT(unsigned char, g, (row + dr + g->nrows) % g->nrows,
+				                               (col + dc + g->ncols) % g->ncols);
+	return n;
+}
+
+BENCH_CASE(stencil)
+{
+	enum { SIDE = 1024 };
+	int cells = SIDE * SIDE;
+	int steps = int_max(1, n / cells);
+	double alpha = 0.2;
+
+	struct Grid *life[2] = {
+		Grid_create(SIDE, SIDE, 1, GRID_ROW_MAJOR), Grid_create(SIDE, SIDE, 1, GRID_ROW_MAJOR) };
+	struct Grid *heat[2] = {
+		Grid_create(SIDE, SIDE, sizeof(double), GRID_ROW_MAJOR),
+		Grid_create(SIDE, SIDE, sizeof(double), GRID_ROW_MAJOR) };
+	struct Stencil *life_s = Stencil_create(SIDE, SIDE, 1, STENCIL_WRAP);
+	struct Stencil *heat_s = Stencil_create(SIDE, SIDE, sizeof(double), STENCIL_WRAP);
+
+	for (int row = 0; row < SIDE; ++row)
+		for (int col = 0; col < SIDE; ++col) {
+			unsigned char alive = (row * 7 + col * 13) % 5 < 2;
+			GRID_AT(unsigned char, life[0], row, col) = alive;
+			*(unsigned char*)Stencil_at(life_s, row, col) = alive;
+			GRID_AT(double, heat[0], row, col) = sin(row * 0.01) + col;
+			*(double*)Stencil_at(heat_s, row, col) = sin(row * 0.01) + col;
+		}
+
+	BENCH_TIME("stencil", "life per cell", steps * cells, {
+		for (int step = 0; step < steps; ++step) {
+			struct Grid *in = life[step & 1], *out = life[!(step & 1)];
+			for (int row = 0; row < SIDE; ++row)
+				for (int col = 0; col < SIDE; ++col) {
+					int n = bench_life_neighbours(in, row, col);
+					GRID_AT(unsigned char, out, row, col) =
+						n == 3 || (n == 2 && GRID_AT(unsigned char, in, row, col));
+				}
+		}
+	});
+	for (int threads = 1; threads <= 4; threads += 3) {
+		BENCH_TIME("stencil", threads == 1 ? "life 1 thread" : "life 4 threads", steps * cells, {
+			for (int step = 0; step < steps; ++step)
+				Stencil_step(life_s, Stencil_life_row, NULL, threads);
+		});
+	}
+
+	BENCH_TIME("stencil", "heat per cell", steps * cells, {
+		for (int step = 0; step < steps; ++step) {
+			struct Grid *in = heat[step & 1], *out = heat[!(step & 1)];
+			for (int row = 0; row < SIDE; ++row)
+				for (int col = 0; col < SIDE; ++col) {
+					double x = GRID_AT(double, in, row, col);
+					double sum = GRID_AT(double, in, (row + SIDE - 1) % SIDE, col)
+					           + GRID_AT(double, in, (row + 1) % SIDE, col)
+					           + GRID_AT(double, in, row, (col + SIDE - 1) % SIDE)
+					           + GRID_AT(double, in, row, (col + 1) % SIDE);
+					GRID_AT(double, out, row, col) = x + alpha * (sum - 4.0 * x);
+				}
+		}
+	});
+	for (int threads = 1; threads <= 4; threads += 3) {
+		BENCH_TIME("stencil", threads == 1 ? "heat 1 thread" : "heat 4 threads", steps * cells, {
+			for (int step = 0; step < steps; ++step)
+				Stencil_step(heat_s, Stencil_laplacian_row, &alpha, threads);
+		});
+	}
+
+	bench_sink += GRID_AT(double, heat[0], 1, 1) + *(double*)Stencil_at(heat_s, 1, 1)
+	            + GRID_AT(unsigned char, life[0], 1, 1) + *(unsigned char*)Stencil_at(life_s, 1, 1);
+
+	for (int i = 0; i < 2; ++i) {
+		Grid_destroy(life[i]);
+		Grid_destroy(heat[i]);
+	}
+	Stencil_destroy(life_s);
+	Stencil_destroy(heat_s);
+}
+
+//----------------------------------------------------------------------
+// Grid Sums
+//
+// Summed-area tables over a 2048x2048 int grid: a per-cell build through
+// GRID_AT, then GridSums_create on one and four threads; 64x64 rectangle
+// sums by rescanning, from the table and from a Fenwick tree; and Fenwick
+// point updates.
+
+BENCH_CASE(grid_sums)
+{
+	enum { SIDE = 2048, RECT = 64, RECT_CELLS = RECT * RECT };
+	int cells = SIDE * SIDE;
+	int builds = int_max(1, n / cells);
+	int queries = int_max(1, n / RECT_CELLS);
+
+	struct Grid *g = Grid_create(SIDE, SIDE, sizeof(int), GRID_ROW_MAJOR);
+	struct Grid *table = Grid_create(SIDE + 1, SIDE + 1, sizeof(long long), GRID_ROW_MAJOR);
+	for (int row = 0; row < SIDE; ++row)
+		for (int col = 0; col < SIDE; ++col)
+			GRID_AT(int, g, row, col) = (row * 7 + col * 13) % 101;
+
+	BENCH_TIME("grid_sums", "build per cell", builds * cells, {
+		for (int b = 0; b < builds; ++b)
+			for (int row = 1; row <= SIDE; ++row)
+				for (int col = 1; col <= SIDE; ++col)
+					GRID_AT(long long, table, row, col) = GRID_AT(int, g, row - 1, col - 1)
+						+ GRID_AT(long long, table, row - 1, col) + GRID_AT(long long, table, row, col - 1)
+						- GRID_AT(long long, table, row - 1, col - 1);
+		bench_sink += GRID_AT(long long, table, SIDE, SIDE);
+	});
+	struct GridSums *sums = NULL;
+	for (int threads = 1; threads <= 4; threads += 3) {
+		BENCH_TIME("grid_sums", threads == 1 ? "build 1 thread" : "build 4 threads", builds * cells, {
+			for (int b = 0; b < builds; ++b) {
+				GridSums_destroy(sums);
+				sums = GridSums_create(g, GRID_INT, threads);
+			}
+		});
+	}
+	struct GridFenwick *fenwick = GridFenwick_create(g, GRID_INT);
+
+	// Rectangles spread over the grid by a multiplicative step.
+	#define BENCH_RECT(Q_) \
+		((struct GridRect){ (Q_) * 769 % (SIDE - RECT), (Q_) * 1543 % (SIDE - RECT), \
+		                    (Q_) * 769 % (SIDE - RECT) + RECT, (Q_) * 1543 % (SIDE - RECT) + RECT })
+
+	BENCH_TIME("grid_sums", "rect rescan", queries * RECT_CELLS, {
+		long long total = 0;
+		for (int q = 0; q < queries; ++q)
+			ITER_FOREACH(GridRectIter, it, GridRectIter_begin(g, BENCH_RECT(q)))
+				total += *(int*)GridRectIter_get(it);
+		bench_sink += total;
+	});
+	BENCH_TIME("grid_sums", "rect table", queries, {
+		long long total = 0;
+		for (int q = 0; q < queries; ++q)
+			total += GridSums_rect_int(sums, BENCH_RECT(q));
+		bench_sink += total;
+	});
+	BENCH_TIME("grid_sums", "rect fenwick", queries, {
+		long long total = 0;
+		for (int q = 0; q < queries; ++q)
+			total += GridFenwick_rect_int(fenwick, BENCH_RECT(q));
+		bench_sink += total;
+	});
+	BENCH_TIME("grid_sums", "fenwick add", queries, {
+		for (int q = 0; q < queries; ++q)
+			GridFenwick_add_int(fenwick, (struct GridPos){ q * 769 % SIDE, q * 1543 % SIDE }, 1);
+	});
+	#undef BENCH_RECT
+
+	GridFenwick_destroy(fenwick);
+	GridSums_destroy(sums);
+	Grid_destroy(table);
+	Grid_destroy(g);
+}
+
+//----------------------------------------------------------------------
+// Maze Generators
+//
+// Every algorithm on square mazes of 1M cells and up by factors of ten
+// to n cells. Peak memory is the packed maze plus the algorithm's
+// scratch.
+
+BENCH_CASE(maze_generate)
+{
+	for (long long cells = 1000000; cells <= n; cells *= 10) {
+		int side = (int)ceil(sqrt((double)cells));
+		struct Maze *maze = Maze_create(side, side);
+
+		for (enum MazeAlgorithm a = 0; a < MAZE_ALGORITHM_COUNT; ++a) {
+			char variant[32];
+			snprintf(variant, sizeof(variant), "%s %lldM", MazeAlgorithm_name(a), cells / 1000000);
+			BENCH_TIME("maze_generate", variant, side * side, {
+				bench_sink += Maze_generate(maze, a, 1);
+			});
+			printf("%-20s %-18s %12s  %9.1f MB peak\n", "", "", "",
+			       (Maze_size(side, side) + MazeAlgorithm_scratch(a, side, side)) / 1e6);
+		}
+		Maze_destroy(maze);
+	}
+}
+
+//----------------------------------------------------------------------
+// Tiled Maze Generation
+//
+// n cells generated whole, then in MAZE_DEFAULT_TILE tiles on one and on
+// four threads.
+
+BENCH_CASE(maze_tiled)
+{
+	int side = (int)ceil(sqrt((double)n)), cells = side * side;
+	struct Maze *maze = Maze_create(side, side);
+	const enum MazeAlgorithm algorithms[] = { MAZE_BACKTRACKER, MAZE_WILSON, MAZE_KRUSKAL };
+
+	for (int i = 0; i < (int)ARRAY_LENGTH(algorithms); ++i) {
+		enum MazeAlgorithm a = algorithms[i];
+		char variant[32];
+		snprintf(variant, sizeof(variant), "%s whole", MazeAlgorithm_name(a));
+		BENCH_TIME("maze_tiled", variant, cells, {
+			bench_sink += Maze_generate(maze, a, 1);
+		});
+		for (int threads = 1; threads <= 4; threads += 3) {
+			snprintf(variant, sizeof(variant), "%s %d thr", MazeAlgorithm_name(a), threads);
+			BENCH_TIME("maze_tiled", variant, cells, {
+				bench_sink += Maze_generate_tiled(maze, a, 1, MAZE_DEFAULT_TILE, threads);
+			});
+		}
+	}
+	Maze_destroy(maze);
+}
+
+//----------------------------------------------------------------------
+// Maze Solver
+//
+// Breadth-first searches on an n-cell Eller maze: the full distance
+// field, corner to corner one way and from both ends, and the diameter.
+
+BENCH_CASE(maze_solve)
+{
+	int side = (int)ceil(sqrt((double)n)), cells = side * side;
+	struct Maze *maze = Maze_create(side, side);
+	Maze_generate(maze, MAZE_ELLER, 1);
+	struct GridPos corner = { 0, 0 }, far_corner = { -1, -1 }, path[1];
+
+	BENCH_TIME("maze_solve", "distances", cells, {
+		struct Grid *d = Maze_distances(maze, corner);
+		bench_sink += GRID_AT(int, d, -1, -1);
+		Grid_destroy(d);
+	});
+	BENCH_TIME("maze_solve", "solve one way", cells, {
+		bench_sink += Maze_solve(maze, corner, far_corner, false, path, 1);
+	});
+	BENCH_TIME("maze_solve", "solve both ends", cells, {
+		bench_sink += Maze_solve(maze, corner, far_corner, true, path, 1);
+	});
+	BENCH_TIME("maze_solve", "diameter", cells, {
+		bench_sink += Maze_diameter(maze).length;
+	});
+
+	Maze_destroy(maze);
+}
+
+//----------------------------------------------------------------------
+
+static const struct
+{
+	void (*run)(int n);
+	const char *name;
+	int n;
+}
+all_benches[] = {
+	{ Bench_iter_pipeline, "iter_pipeline", 10000000 },
+	{ Bench_except_throw,  "except_throw",   1000000 },
+	{ Bench_checked_math,  "checked_math",  10000000 },
+	{ Bench_grid_traverse, "grid_traverse", 50000000 },
+	{ Bench_grid_layouts,  "grid_layouts",  10000000 },
+	{ Bench_stencil,       "stencil",       20000000 },
+	{ Bench_grid_sums,     "grid_sums",     20000000 },
+	{ Bench_maze_generate, "maze_generate", 10000000 },
+	{ Bench_maze_tiled,    "maze_tiled",    10000000 },
+	{ Bench_maze_solve,    "maze_solve",    10000000 },
+};
+
+int main(int argc, char *argv[])
+{
+	for (int i = 0; i < (int)ARRAY_LENGTH(all_benches); ++i) {
+		bool selected = argc < 2;
+		for (int a = 1; a < argc; ++a)
+			selected |= !strcmp(argv[a], all_benches[i].name);
+		if (selected)
+			all_benches[i].run(all_benches[i].n);
+	}
+	return 0;
+}
@@ -1,11 +1,19 @@
 #include "krbase.h"
 #include <math.h>
 #include <float.h>
+#include <time.h>
 
 //----------------------------------------------------------------------
 // Debugging
 
-void debug_vprint(FILE *out, struct SourceLocation source, const char *format, va_list args)
+static DebugWriter debug_writer = NULL;
+
+void debug_set_writer(DebugWriter writer)
+{
+	debug_writer = writer;
+}
+
+void debug_vwrite(FILE *out, struct SourceLocation source, const char *format, va_list args)
 {
 	out = ptr_and(out, stderr);
 	fprintf(out, "%s:%d: ", source.file_name, source.line_num);
@@ -14,6 +22,14 @@ void debug_vprint(FILE *out, struct SourceLocation source, const char *format, v
 	fputc('\n', out);
 }
 
+void debug_vprint(FILE *out, struct SourceLocation source, const char *format, va_list args)
+{
+	if (debug_writer)
+		debug_writer(out, source, format, args);
+	else
+		debug_vwrite(out, source, format, args);
+}
+
 void debug_print(FILE *out, struct SourceLocation source, const char *format, ...)
 {
 	va_list args;
@@ -26,12 +42,63 @@ bool debug_abort(void* out, struct SourceLocation source, const char* format, ..
 {
 	va_list args;
 	va_start(args, format);
-	debug_vprint(out, source, format, args);
+	debug_vwrite(out, source, format, args);
 	va_end(args);
 
 	abort();
 	return false; // To satisfy compiler warnings. 
 }
+//----------------------------------------------------------------------
+// Source Sites
+
+static struct SourceSite *_Atomic site_registry = NULL;
+
+void SourceSite_hit(const struct SourceSite *site)
+{
+	struct SourceSite *hit = (struct SourceSite*)site;
+	atomic_fetch_add_explicit(&hit->hits, 1, memory_order_relaxed);
+	if (atomic_load_explicit(&hit->registered, memory_order_relaxed)
+	    || atomic_exchange(&hit->registered, true))
+		return;
+
+	struct SourceSite *head = atomic_load(&site_registry);
+	do hit->next = head;
+	while (!atomic_compare_exchange_weak(&site_registry, &head, hit));
+}
+
+unsigned long SourceSite_hits(const struct SourceSite *site)
+{
+	return atomic_load_explicit(&((struct SourceSite*)site)->hits, memory_order_relaxed);
+}
+
+unsigned long SourceSite_suppressed(const struct SourceSite *site)
+{
+	return atomic_load_explicit(&((struct SourceSite*)site)->suppressed, memory_order_relaxed);
+}
+
+// Most recently registered first.
+struct SourceSite *SourceSite_first(void)
+{
+	return atomic_load(&site_registry);
+}
+
+void SourceSite_reset_all(void)
+{
+	for (struct SourceSite *site = SourceSite_first(); site; site = site->next) {
+		atomic_store_explicit(&site->hits, 0, memory_order_relaxed);
+		atomic_store_explicit(&site->suppressed, 0, memory_order_relaxed);
+	}
+}
+
+void SourceSite_report(FILE *out)
+{
+	out = ptr_and(out, stderr);
+	for (struct SourceSite *site = SourceSite_first(); site; site = site->next)
+		fprintf(out, "%s:%u: %s hit %lu times, %lu suppressed\n",
+			site->location.file_name, site->location.line_num, site->kind,
+			SourceSite_hits(site), SourceSite_suppressed(site));
+}
+
 //----------------------------------------------------------------------
 // Math Stuff
 
@@ -64,49 +131,104 @@ const void *const_ptr_and(const void *p, const void *d)
 //----------------------------------------------------------------------
 // Assertions
 
-struct AssertHandler default_assert_handler = { .fail = debug_abort };
-struct AssertHandler *handler_top = &default_assert_handler;
+// Each thread has its own handler stack. A thread with an empty stack
+// uses the process-wide default, which should only be changed before
+// other threads start.
+static struct AssertHandler default_assert_handler = { .fail = debug_abort };
+static struct AssertHandler *process_handler = &default_assert_handler;
+KR_THREAD_POINTER(handler_top, struct AssertHandler)
+
+struct AssertHandler *AssertHandler_current(void)
+{
+	struct AssertHandler *top = handler_top_get();
+	return top ? top : process_handler;
+}
+void AssertHandler_set_default(struct AssertHandler *handler)
+{
+	process_handler = handler ? handler : &default_assert_handler;
+}
 void AssertHandler_push(struct AssertHandler *handler)
 {
-	handler->back = handler_top;
-	handler_top = handler;
+	handler->back = handler_top_get();
+	handler_top_set(handler);
 }
 void AssertHandler_pop(void)
 {
-	if (handler_top)
-		handler_top = handler_top->back;
-	if (!handler_top)
-		handler_top = &default_assert_handler;
+	struct AssertHandler *top = handler_top_get();
+	if (top)
+		handler_top_set(top->back);
 }
-bool fail(const char *m, struct SourceLocation loc)
+bool fail(const char *m, const struct SourceSite *site)
 {
-	return handler_top->fail(handler_top->bag, loc, m);
+	SourceSite_hit(site);
+	struct AssertHandler *h = AssertHandler_current();
+	return h->fail(h->bag, site->location, m);
 }
-bool assert_equal(const char* an, int av, const char* bn, int bv, struct SourceLocation loc)
+
+bool assert_equal(const char* an, int av, const char* bn, int bv, const struct SourceSite *site)
 {
 	if (av != bv)
 	{
-		return handler_top->fail(handler_top->bag, loc, 
-		                         "ASSERT Failed: %s(%d) == %s(%d)",
-								 an, av, bn, bv);
+		SourceSite_hit(site);
+		struct AssertHandler *h = AssertHandler_current();
+		return h->fail(h->bag, site->location, 
+		               "ASSERT Failed: %s(%d) == %s(%d)",
+		               an, av, bn, bv);
 	}
 	return true;
 }
-bool assert_streq(const char* a, const char* b, struct SourceLocation loc)
+bool assert_streq(const char* a, const char* b, const struct SourceSite *site)
 {
 	if (!strcmp(a,b)) {
-		return handler_top->fail(handler_top->bag, loc, "ASSERT Failed: \"%s\" == \"%s\"", a, b);
+		SourceSite_hit(site);
+		struct AssertHandler *h = AssertHandler_current();
+		return h->fail(h->bag, site->location, "ASSERT Failed: \"%s\" == \"%s\"", a, b);
 	}
 	return true;
 }
-int check_index(int len, int i, struct SourceLocation source)
+void check_index_fail(int len, int i, const struct SourceSite *site)
 {
-	i += len * (i < 0);
+	SourceSite_hit(site);
+	struct AssertHandler *h = AssertHandler_current();
+	h->fail(h->bag, site->location, "Array index %d out of bounds [%d,%d).", i, 0, len);
+}
 
-	if (i < 0  ||  i >= len)
-		handler_top->fail(handler_top->bag, source, "Array index %d out of bounds [%d,%d).", i, 0, len);
+int check_range_fail(int len, int start, int stop, const struct SourceSite *site)
+{
+	SourceSite_hit(site);
+	struct AssertHandler *h = AssertHandler_current();
+	h->fail(h->bag, site->location, "Index range [%d,%d) out of bounds [%d,%d).", start, stop, 0, len);
+	return stop;
+}
+
+//----------------------------------------------------------------------
+// Sampled Checks and Rate Limits
 
-	return i;
+static long long now_ms(void)
+{
+	struct timespec t;
+	timespec_get(&t, TIME_UTC);
+	return t.tv_sec * 1000LL + t.tv_nsec / 1000000;
+}
+
+// Racing threads may each open a new window; at worst a few extra
+// reports get through at the boundary. window_used stops at the limit,
+// so a site that fires for a long window can't wrap it.
+bool RateLimit_allow(struct RateLimit *limit, struct SourceSite *site)
+{
+	long long now = now_ms();
+	long long start = atomic_load_explicit(&limit->window_start, memory_order_relaxed);
+	if (now - start >= limit->interval_ms
+	    && atomic_compare_exchange_strong(&limit->window_start, &start, now))
+		atomic_store(&limit->window_used, 0);
+
+	int used = atomic_load_explicit(&limit->window_used, memory_order_relaxed);
+	while (used < limit->limit)
+		if (atomic_compare_exchange_weak(&limit->window_used, &used, used + 1))
+			return true;
+
+	atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+	return false;
 }
 
 
@@ -116,21 +238,225 @@ int check_index(int len, int i, struct SourceLocation source)
 nuspan num_slice(nuspan span, int first, int last)
 {
 	return (nuspan){
-		.p = span.p + check_index(span.length, first, SRCLOC),
-		.length = check_index(span.length, last, SRCLOC) - first + 1
+		.p = span.p + CHECK_BOUNDARY(span, first),
+		.length = CHECK_BOUNDARY(span, last) - first + 1
 	};
 }
 
 strand str_slice(strand span, int first, int last) 
 {
-	first = check_index(span.length, first, SRCLOC);
-	last  = check_index(span.length, last, SRCLOC);
+	first = CHECK_BOUNDARY(span, first);
+	last  = CHECK_BOUNDARY(span, last);
 	return (strand){
 		.p = span.p + first, 
 		.length = last - first + 1
 	};
 }
 
+//----------------------------------------------------------------------
+// Numeric Reductions
+//
+// Each kernel keeps NUM_LANES independent accumulators across the body
+// of the span, so the compiler can keep them in vector registers, then
+// combines the lanes and finishes the tail one element at a time.
+// No alignment is assumed; spans may start anywhere.
+
+enum { NUM_LANES = 4, NUM_PAIRWISE_BLOCK = 128 };
+
+static double num_sum_block(const double *p, int n)
+{
+	double acc[NUM_LANES] = {0};
+	int i = 0;
+	for (; i + NUM_LANES <= n; i += NUM_LANES)
+		for (int k = 0; k < NUM_LANES; ++k)
+			acc[k] += p[i+k];
+
+	double sum = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+	for (; i < n; ++i)
+		sum += p[i];
+	return sum;
+}
+
+static double num_sum_pairwise(const double *p, int n)
+{
+	if (n <= NUM_PAIRWISE_BLOCK)
+		return num_sum_block(p, n);
+
+	int half = (n / 2) & ~(NUM_LANES - 1);
+	return num_sum_pairwise(p, half) + num_sum_pairwise(p + half, n - half);
+}
+
+double num_sum(nuspan span)
+{
+	return num_sum_pairwise(span.p, span.length);
+}
+
+// Neumaier's variant of Kahan summation, one compensation term per lane.
+static void kahan_add(double *sum, double *err, double x)
+{
+	double t = *sum + x;
+	*err += (fabs(*sum) >= fabs(x)) ? (*sum - t) + x : (x - t) + *sum;
+	*sum = t;
+}
+
+double num_sum_kahan(nuspan span)
+{
+	double sum[NUM_LANES] = {0}, err[NUM_LANES] = {0};
+	const double *p = span.p;
+	int n = span.length, i = 0;
+
+	for (; i + NUM_LANES <= n; i += NUM_LANES)
+		for (int k = 0; k < NUM_LANES; ++k)
+			kahan_add(&sum[k], &err[k], p[i+k]);
+
+	double total = 0.0, comp = 0.0;
+	for (int k = 0; k < NUM_LANES; ++k) {
+		kahan_add(&total, &comp, sum[k]);
+		comp += err[k];
+	}
+	for (; i < n; ++i)
+		kahan_add(&total, &comp, p[i]);
+	return total + comp;
+}
+
+// Minimum of sign*x, scaled back by sign; sign -1 gives the maximum.
+// NaN elements never compare less, so they are ignored.
+static double num_extreme(nuspan span, double sign)
+{
+	double m[NUM_LANES] = { INFINITY, INFINITY, INFINITY, INFINITY };
+	const double *p = span.p;
+	int n = span.length, i = 0;
+
+	for (; i + NUM_LANES <= n; i += NUM_LANES)
+		for (int k = 0; k < NUM_LANES; ++k) {
+			double x = sign * p[i+k];
+			m[k] = (x < m[k]) ? x : m[k];
+		}
+
+	double r = fmin(fmin(m[0], m[1]), fmin(m[2], m[3]));
+	for (; i < n; ++i)
+		r = fmin(r, sign * p[i]);
+	return sign * r;
+}
+
+double num_min(nuspan span)  { return num_extreme(span,  1.0); }
+double num_max(nuspan span)  { return num_extreme(span, -1.0); }
+
+// Index of the first minimum of sign*x, or -1 if there is none.
+static int num_arg_extreme(nuspan span, double sign)
+{
+	double m[NUM_LANES] = { INFINITY, INFINITY, INFINITY, INFINITY };
+	int at[NUM_LANES] = { -1, -1, -1, -1 };
+	const double *p = span.p;
+	int n = span.length, i = 0;
+
+	for (; i + NUM_LANES <= n; i += NUM_LANES)
+		for (int k = 0; k < NUM_LANES; ++k) {
+			double x = sign * p[i+k];
+			bool take = x < m[k]  ||  (at[k] < 0 && x == x);
+			m[k]  = take ? x     : m[k];
+			at[k] = take ? i + k : at[k];
+		}
+
+	int best = -1;
+	for (int k = 0; k < NUM_LANES; ++k) {
+		if (at[k] < 0)
+			continue;
+		double b = (best < 0) ? NAN : sign * p[best];
+		if (best < 0  ||  m[k] < b  ||  (m[k] == b && at[k] < best))
+			best = at[k];
+	}
+
+	for (; i < n; ++i) {
+		double x = sign * p[i];
+		if ((best < 0 && x == x)  ||  x < sign * p[best])
+			best = i;
+	}
+	return best;
+}
+
+int num_argmin(nuspan span)  { return num_arg_extreme(span,  1.0); }
+int num_argmax(nuspan span)  { return num_arg_extreme(span, -1.0); }
+
+double num_mean(nuspan span)
+{
+	return span.length ? num_sum(span) / span.length : NAN;
+}
+
+double num_variance(nuspan span)
+{
+	return Moments_variance(num_moments(span));
+}
+
+double num_dot(nuspan a, nuspan b)
+{
+	ASSERTION(a.length == b.length);
+
+	double acc[NUM_LANES] = {0};
+	int n = int_min(a.length, b.length), i = 0;
+	for (; i + NUM_LANES <= n; i += NUM_LANES)
+		for (int k = 0; k < NUM_LANES; ++k)
+			acc[k] += a.p[i+k] * b.p[i+k];
+
+	double dot = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+	for (; i < n; ++i)
+		dot += a.p[i] * b.p[i];
+	return dot;
+}
+
+struct Moments Moments_add(struct Moments m, double x)
+{
+	m.count++;
+	double d = x - m.mean;
+	m.mean += d / m.count;
+	m.m2   += d * (x - m.mean);
+	return m;
+}
+
+// Chan et al. pairwise combination of two partial results.
+struct Moments Moments_merge(struct Moments a, struct Moments b)
+{
+	if (!a.count)  return b;
+	if (!b.count)  return a;
+
+	int n = a.count + b.count;
+	double d = b.mean - a.mean;
+	return (struct Moments){
+		.count = n,
+		.mean  = a.mean + d * b.count / n,
+		.m2    = a.m2 + b.m2 + d * d * ((double)a.count * b.count / n)
+	};
+}
+
+// Sample variance; NAN with fewer than two values.
+double Moments_variance(struct Moments m)
+{
+	return (m.count > 1) ? m.m2 / (m.count - 1) : NAN;
+}
+
+struct Moments num_moments(nuspan span)
+{
+	double mean[NUM_LANES] = {0}, m2[NUM_LANES] = {0};
+	const double *p = span.p;
+	int n = span.length, i = 0, count = 0;
+
+	for (; i + NUM_LANES <= n; i += NUM_LANES) {
+		++count;
+		for (int k = 0; k < NUM_LANES; ++k) {
+			double d = p[i+k] - mean[k];
+			mean[k] += d / count;
+			m2[k]   += d * (p[i+k] - mean[k]);
+		}
+	}
+
+	struct Moments m = {0};
+	for (int k = 0; k < NUM_LANES; ++k)
+		m = Moments_merge(m, (struct Moments){ count, mean[k], m2[k] });
+	for (; i < n; ++i)
+		m = Moments_add(m, p[i]);
+	return m;
+}
+
 const struct Interval R_positive = {  DBL_MIN,   INFINITY };
 const struct Interval R_negative = { -INFINITY, -DBL_MIN  };
 const struct Interval R_all      = { -INFINITY,  INFINITY };
@@ -167,4 +493,182 @@ void Interval_fprint(FILE *out, struct Interval invl)
 {
 	fprintf(out, "[%g,%g]", invl.left, invl.right);
 }
+bool Interval_is_empty(struct Interval invl)
+{
+	return !(invl.left <= invl.right);
+}
+
+static int num_out_length(nuspan in, nuspan out)
+{
+	ASSERTION(in.length == out.length);
+	return int_min(in.length, out.length);
+}
+
+static void num_fill(nuspan out, int n, double x)
+{
+	for (int i = 0; i < n; ++i)
+		out.p[i] = x;
+}
+
+// The loops below are branch-free selects so NAN inputs pass through
+// unchanged and the compiler is free to vectorize them.
+void num_clamp(struct Interval invl, nuspan in, nuspan out)
+{
+	int n = num_out_length(in, out);
+	if (Interval_is_empty(invl)) {
+		num_fill(out, n, NAN);
+		return;
+	}
+
+	double left = invl.left, right = invl.right;
+	for (int i = 0; i < n; ++i) {
+		double x = in.p[i];
+		x = (x < left)  ? left  : x;
+		x = (x > right) ? right : x;
+		out.p[i] = x;
+	}
+}
+
+void num_lerp(struct Interval invl, nuspan in, nuspan out)
+{
+	int n = num_out_length(in, out);
+	double left = invl.left, right = invl.right;
+	for (int i = 0; i < n; ++i)
+		out.p[i] = left * (1.0 - in.p[i]) + right * in.p[i];
+}
+
+int num_includes(struct Interval invl, nuspan in, bool out[])
+{
+	int count = 0;
+	for (int i = 0; i < in.length; ++i) {
+		bool inside = invl.left <= in.p[i]  &&  in.p[i] <= invl.right;
+		if (out)
+			out[i] = inside;
+		count += inside;
+	}
+	return count;
+}
+
+// Clamp into *from*, then map *from* linearly onto *to*, in one pass.
+// A zero-width *from* maps everything to to.left.
+void num_remap(struct Interval from, struct Interval to, nuspan in, nuspan out)
+{
+	int n = num_out_length(in, out);
+	if (Interval_is_empty(from) || Interval_is_empty(to)) {
+		num_fill(out, n, NAN);
+		return;
+	}
+
+	double width = from.right - from.left;
+	double scale = (width > 0.0) ? 1.0 / width : 0.0;
+	for (int i = 0; i < n; ++i) {
+		double x = in.p[i];
+		x = (x < from.left)  ? from.left  : x;
+		x = (x > from.right) ? from.right : x;
+		double t = (x - from.left) * scale;
+		out.p[i] = to.left * (1.0 - t) + to.right * t;
+	}
+}
+
+
+//----------------------------------------------------------------------
+// Vector Arrays
+//
+// Kernels walk one component array at a time so every inner loop is a
+// unit-stride pass over doubles.
 
+bool soa_create(int dims, int length, double *v[])
+{
+	double *block = (length > 0) ? malloc(sizeof(double) * dims * (size_t)length) : NULL;
+	for (int k = 0; k < dims; ++k)
+		v[k] = block ? block + (size_t)k * length : NULL;
+	return block || length <= 0;
+}
+
+void soa_destroy(int dims, double *v[])
+{
+	free(v[0]);
+	for (int k = 0; k < dims; ++k)
+		v[k] = NULL;
+}
+
+void soa_from_aos(int dims, int length, double *out[], const double aos[])
+{
+	for (int k = 0; k < dims; ++k)
+		for (int i = 0; i < length; ++i)
+			out[k][i] = aos[i * dims + k];
+}
+
+void soa_to_aos(int dims, int length, double aos[], double *const in[])
+{
+	for (int k = 0; k < dims; ++k)
+		for (int i = 0; i < length; ++i)
+			aos[i * dims + k] = in[k][i];
+}
+
+void soa_add(int dims, int length, double *out[], double *const a[], double *const b[])
+{
+	for (int k = 0; k < dims; ++k)
+		for (int i = 0; i < length; ++i)
+			out[k][i] = a[k][i] + b[k][i];
+}
+
+void soa_scale(int dims, int length, double *out[], double *const a[], double s)
+{
+	for (int k = 0; k < dims; ++k)
+		for (int i = 0; i < length; ++i)
+			out[k][i] = a[k][i] * s;
+}
+
+void soa_dot(int dims, int length, double out[], double *const a[], double *const b[])
+{
+	for (int i = 0; i < length; ++i)
+		out[i] = 0.0;
+	for (int k = 0; k < dims; ++k)
+		for (int i = 0; i < length; ++i)
+			out[i] += a[k][i] * b[k][i];
+}
+
+void soa_length(int dims, int length, double out[], double *const a[])
+{
+	soa_dot(dims, length, out, a, a);
+	for (int i = 0; i < length; ++i)
+		out[i] = sqrt(out[i]);
+}
+
+// Zero-length vectors stay zero rather than becoming NAN.
+// Works in blocks so the reciprocal lengths stay in a small local array.
+void soa_normalize(int dims, int length, double *out[], double *const a[])
+{
+	enum { BLOCK = 256 };
+	double inv[BLOCK];
+
+	for (int front = 0; front < length; front += BLOCK) {
+		int n = int_min(BLOCK, length - front);
+
+		for (int i = 0; i < n; ++i)
+			inv[i] = 0.0;
+		for (int k = 0; k < dims; ++k)
+			for (int i = 0; i < n; ++i)
+				inv[i] += a[k][front+i] * a[k][front+i];
+		for (int i = 0; i < n; ++i)
+			inv[i] = (inv[i] > 0.0) ? 1.0 / sqrt(inv[i]) : 0.0;
+
+		for (int k = 0; k < dims; ++k)
+			for (int i = 0; i < n; ++i)
+				out[k][front+i] = a[k][front+i] * inv[i];
+	}
+}
+
+void soa_distance(int dims, int length, double out[], double *const a[], double *const b[])
+{
+	for (int i = 0; i < length; ++i)
+		out[i] = 0.0;
+	for (int k = 0; k < dims; ++k)
+		for (int i = 0; i < length; ++i) {
+			double d = a[k][i] - b[k][i];
+			out[i] += d * d;
+		}
+	for (int i = 0; i < length; ++i)
+		out[i] = sqrt(out[i]);
+}
@@ -6,10 +6,12 @@
 #include <string.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 
 #define NOOP                        ((void)0)
 #define UNUSED(VAR_)                (void)(VAR_)
 #define CONCAT(A,B)                 A##B
+#define CONCAT_EXPAND(A,B)          CONCAT(A,B)
 #define STRINGIFY(TOKEN_)           #TOKEN_
 #define STRINGIFY_EXPAND(TOKEN_)    STRINGIFY(TOKEN_)
 #define ARRAY_LENGTH(A_)            (sizeof(A_) / sizeof(*(A_)))
@@ -18,12 +20,79 @@
 #define VA_NARGS_N(P0, P1, P2, P3, P4, P5, P6, P7, P8, P9, PA, PB, PC, PD, PE, PF, PN, ...) PN
 #define VA_NARGS(...) VA_NARGS_N(__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
 
+// Apply macro M_ to each argument, up to 8 arguments.
+#define VA_MAP_1(M_, A_)       M_(A_)
+#define VA_MAP_2(M_, A_, ...)  M_(A_) VA_MAP_1(M_, __VA_ARGS__)
+#define VA_MAP_3(M_, A_, ...)  M_(A_) VA_MAP_2(M_, __VA_ARGS__)
+#define VA_MAP_4(M_, A_, ...)  M_(A_) VA_MAP_3(M_, __VA_ARGS__)
+#define VA_MAP_5(M_, A_, ...)  M_(A_) VA_MAP_4(M_, __VA_ARGS__)
+#define VA_MAP_6(M_, A_, ...)  M_(A_) VA_MAP_5(M_, __VA_ARGS__)
+#define VA_MAP_7(M_, A_, ...)  M_(A_) VA_MAP_6(M_, __VA_ARGS__)
+#define VA_MAP_8(M_, A_, ...)  M_(A_) VA_MAP_7(M_, __VA_ARGS__)
+#define VA_MAP(M_, ...)  CONCAT_EXPAND(VA_MAP_, VA_NARGS(__VA_ARGS__))(M_, __VA_ARGS__)
+
 //----------------------------------------------------------------------
 // Custom Types
 
 typedef unsigned char byte;
 typedef void (*voidfn)(void);
 
+// Storage class for per-thread state. tcc has no _Thread_local, so there
+// it is empty, as it is wherever KR_THREAD_LOCAL is predefined; such
+// state is then shared by all threads and KR_HAVE_THREAD_LOCAL is 0. The
+// library's own per-thread state goes through KR_THREAD_POINTER and
+// KR_SAMPLE_COUNTER below, which hold up without it.
+#if !defined(KR_THREAD_LOCAL) && !defined(__TINYC__)
+#define KR_THREAD_LOCAL _Thread_local
+#define KR_HAVE_THREAD_LOCAL 1
+#endif
+#ifndef KR_THREAD_LOCAL
+#define KR_THREAD_LOCAL
+#endif
+#ifndef KR_HAVE_THREAD_LOCAL
+#define KR_HAVE_THREAD_LOCAL 0
+#endif
+
+// KR_THREAD_POINTER(Name_, T_) defines Name_get() and Name_set(p) for a
+// per-thread T_ pointer that starts NULL, for state that must stay per
+// thread even without _Thread_local: a C11 tss slot stands in there.
+#if KR_HAVE_THREAD_LOCAL
+#define KR_THREAD_POINTER(Name_, T_) \
+	static _Thread_local T_ *Name_##_value_ = NULL; \
+	static inline T_  *Name_##_get(void)   { return Name_##_value_; } \
+	static inline void Name_##_set(T_ *p)  { Name_##_value_ = p; }
+#else
+#include <threads.h>
+#define KR_THREAD_POINTER(Name_, T_) \
+	static tss_t Name_##_key_; \
+	static once_flag Name_##_once_ = ONCE_FLAG_INIT; \
+	static void Name_##_create_(void)  { tss_create(&Name_##_key_, NULL); } \
+	static inline T_ *Name_##_get(void) \
+	{ \
+		call_once(&Name_##_once_, Name_##_create_); \
+		return tss_get(Name_##_key_); \
+	} \
+	static inline void Name_##_set(T_ *p) \
+	{ \
+		call_once(&Name_##_once_, Name_##_create_); \
+		tss_set(Name_##_key_, p); \
+	}
+#endif
+
+// KR_SAMPLE_COUNTER(Name_) declares a static counter for one sampling
+// site, and KR_SAMPLE_TAKE(Name_, N_) is true on its first and then every
+// N_th pass. The counter is per thread; without _Thread_local it is one
+// atomic counter shared by the site's threads, which still samples one
+// pass in N_ overall.
+#if KR_HAVE_THREAD_LOCAL
+#define KR_SAMPLE_COUNTER(Name_)   static _Thread_local unsigned Name_ = 0
+#define KR_SAMPLE_TAKE(Name_, N_)  ((Name_)-- == 0 ? ((Name_) = (N_) - 1, true) : false)
+#else
+#define KR_SAMPLE_COUNTER(Name_)   static atomic_uint Name_ = 0
+#define KR_SAMPLE_TAKE(Name_, N_) \
+	(atomic_fetch_add_explicit(&(Name_), 1, memory_order_relaxed) % (unsigned)(N_) == 0)
+#endif
+
 //----------------------------------------------------------------------
 // Debugging
 
@@ -37,10 +106,61 @@ struct SourceLocation
 #define CURRENT_LOCATION   SRCLOC
 
 
+// debug_print and debug_vprint hand their output to the installed writer,
+// or write to *out* (default stderr) directly when there is none.
+// debug_abort always writes directly before aborting.
+typedef void (*DebugWriter)(FILE *out, struct SourceLocation source, const char *format, va_list args);
+void debug_set_writer(DebugWriter writer);
+void debug_vwrite(FILE *out, struct SourceLocation source, const char *format, va_list args);
+
 void debug_vprint(FILE* out, struct SourceLocation source, const char* format, va_list args);
 void debug_print (FILE* out, struct SourceLocation source, const char* format, ...);   
 bool debug_abort (void* out, struct SourceLocation source, const char* format, ...);
 
+//----------------------------------------------------------------------
+// Source Sites
+//
+// A static record for one check or throw site, so the site is passed as
+// a single pointer and counts how often it fires. Declare it where the
+// failure is handled:
+//
+//     if (!ok) { SOURCE_SITE(site, "check"); SourceSite_hit(&site); ... }
+//
+// or, where an expression is needed, take SRCSITE(kind), a pointer to a
+// fresh static site at that call. It is a GNU statement expression, which
+// gcc, clang and tcc all accept. The checks that return a value
+// (ASSERTION, check_index, check_range, the try_* functions,
+// except_throw) take their site this way, so a failure costs one pointer
+// argument and a counter increment.
+//
+// A site joins the registry the first time it is hit, without searching;
+// walk the registry with SourceSite_first and ->next for telemetry on
+// what actually fires. Sites that never fire are not listed.
+
+struct SourceSite
+{
+	struct SourceLocation location;
+	const char *kind;
+	atomic_ulong hits;
+	atomic_ulong suppressed;      // reports withheld by a RateLimit
+	atomic_bool registered;
+	struct SourceSite *next;
+};
+
+#define SOURCE_SITE(NAME_, KIND_)  \
+	static struct SourceSite NAME_ = { .location={ .file_name=__FILE__, .line_num=__LINE__ }, .kind=(KIND_) }
+
+#define SRCSITE(KIND_)  ({ SOURCE_SITE(srcsite_, KIND_); (const struct SourceSite *)&srcsite_; })
+
+// Sites are always declared writable; the const is only so they pass
+// through the check APIs as read-only handles.
+void SourceSite_hit(const struct SourceSite *site);
+unsigned long SourceSite_hits(const struct SourceSite *site);
+unsigned long SourceSite_suppressed(const struct SourceSite *site);
+struct SourceSite *SourceSite_first(void);
+void SourceSite_reset_all(void);
+void SourceSite_report(FILE *out);
+
 //----------------------------------------------------------------------
 // Math Stuff
 
@@ -67,13 +187,115 @@ struct AssertHandler
 };
 void AssertHandler_push(struct AssertHandler *handler);
 void AssertHandler_pop(void);
-bool fail(const char *m, struct SourceLocation loc);
-#define ASSERTION(T_)   ((T_)? true: fail("ASSERT Failed: " STRINGIFY_EXPAND(T_), SRCLOC))
-bool assert_equal(const char* an, int av, const char* bn, int bv, struct SourceLocation loc);
-#define ASSERT_INT_EQ(A_, B_) assert_equal(#A_, (A_), #B_, (B_), CURRENT_LOCATION)
-bool assert_streq(const char* a, const char* b, struct SourceLocation loc);
-int check_index(int len, int i, struct SourceLocation source);
-#define CHECK(S_, I_)  check_index((S_).length, (I_), SRCLOC)
+struct AssertHandler *AssertHandler_current(void);
+void AssertHandler_set_default(struct AssertHandler *handler);
+bool fail(const char *m, const struct SourceSite *site);
+#define ASSERTION(T_)   ((T_)? true: fail("ASSERT Failed: " STRINGIFY_EXPAND(T_), SRCSITE("assert")))
+bool assert_equal(const char* an, int av, const char* bn, int bv, const struct SourceSite *site);
+#define ASSERT_INT_EQ(A_, B_) assert_equal(#A_, (A_), #B_, (B_), SRCSITE("assert"))
+bool assert_streq(const char* a, const char* b, const struct SourceSite *site);
+
+//----------------------------------------------------------------------
+// Index Checks
+//
+// check_index wraps a negative index from the end and reports one
+// outside [0,len) to the assert handler. The test is inline and
+// predicted to pass; the report is made out of line.
+//
+// Build with KR_CHECK_BOUNDARY_ONLY to keep only the checks where an
+// index enters from a caller: CHECK and CHECK_LEN then just wrap
+// negative indices, while CHECK_BOUNDARY and CHECK_BOUNDARY_LEN, used by
+// slicing and other API entry points, always check.
+//
+// FOR_RANGE_CHECKED checks [START_,STOP_) against LEN_ once, so the loop
+// body can index without a check per element. A bad range runs the loop
+// zero times.
+
+#if defined(__GNUC__) || defined(__clang__)
+#define KR_LIKELY(X_)    __builtin_expect(!!(X_), 1)
+#define KR_UNLIKELY(X_)  __builtin_expect(!!(X_), 0)
+#define KR_COLD          __attribute__((cold, noinline))
+#define KR_PREFETCH(P_)  __builtin_prefetch(P_)
+#else
+#define KR_LIKELY(X_)    (X_)
+#define KR_UNLIKELY(X_)  (X_)
+#define KR_COLD
+#define KR_PREFETCH(P_)  ((void)(P_))
+#endif
+
+KR_COLD void check_index_fail(int len, int i, const struct SourceSite *site);
+KR_COLD int  check_range_fail(int len, int start, int stop, const struct SourceSite *site);
+
+static inline int wrap_index(int len, int i)
+{
+	return i + len * (i < 0);
+}
+
+static inline int check_index(int len, int i, const struct SourceSite *site)
+{
+	i = wrap_index(len, i);
+	if (KR_UNLIKELY((unsigned)i >= (unsigned)len))
+		check_index_fail(len, i, site);
+	return i;
+}
+
+// Returns start, or stop when the range is bad.
+static inline int check_range(int len, int start, int stop, const struct SourceSite *site)
+{
+	if (KR_UNLIKELY(start < 0 || start > stop || stop > len))
+		return check_range_fail(len, start, stop, site);
+	return start;
+}
+
+#ifdef KR_CHECK_BOUNDARY_ONLY
+#define CHECK(S_, I_)          wrap_index((S_).length, (I_))
+#define CHECK_LEN(LEN_, I_)    wrap_index((LEN_), (I_))
+#else
+#define CHECK(S_, I_)          check_index((S_).length, (I_), SRCSITE("index check"))
+#define CHECK_LEN(LEN_, I_)    check_index((LEN_), (I_), SRCSITE("index check"))
+#endif
+#define CHECK_BOUNDARY(S_, I_)        check_index((S_).length, (I_), SRCSITE("index check"))
+#define CHECK_BOUNDARY_LEN(LEN_, I_)  check_index((LEN_), (I_), SRCSITE("index check"))
+
+#define FOR_RANGE_CHECKED(I_, LEN_, START_, STOP_) \
+	for (int I_##_stop_ = (STOP_), I_ = check_range((LEN_), (START_), I_##_stop_, SRCSITE("range check")); \
+	     I_ < I_##_stop_; ++I_)
+
+//----------------------------------------------------------------------
+// Sampled Checks and Rate Limits
+//
+// ASSERT_SAMPLED evaluates its condition on the first and then every
+// N_th pass through that site on each thread, so expensive invariants
+// can stay on in production at 1/N of their cost. The countdown is per
+// site and per thread, so neighbouring sites never alias.
+//
+// DEBUG_PRINT_LIMITED lets at most LIMIT_ reports per INTERVAL_MS_
+// through from its site; the rest only count as suppressed on the
+// site, where SourceSite_report and SourceSite_suppressed find them.
+// LIMIT_ and INTERVAL_MS_ must be constants.
+
+#define ASSERT_SAMPLED(N_, T_) \
+	do{ KR_SAMPLE_COUNTER(countdown_); \
+		if (KR_SAMPLE_TAKE(countdown_, N_)) { \
+			if (!(T_)) { \
+				SOURCE_SITE(site_, "sampled assert"); \
+				fail("ASSERT Failed: " STRINGIFY_EXPAND(T_), &site_); } } } while(0)
+
+struct RateLimit
+{
+	int limit, interval_ms;
+	atomic_llong window_start;    // ms
+	atomic_int   window_used;
+};
+
+bool RateLimit_allow(struct RateLimit *limit, struct SourceSite *site);
+
+#define DEBUG_PRINT_LIMITED(LIMIT_, INTERVAL_MS_, OUT_, ...) \
+	do{ SOURCE_SITE(site_, "log"); \
+		static struct RateLimit limit_ = { .limit=(LIMIT_), .interval_ms=(INTERVAL_MS_) }; \
+		SourceSite_hit(&site_); \
+		if (RateLimit_allow(&limit_, &site_)) \
+			debug_print((OUT_), site_.location, __VA_ARGS__); } while(0)
 
 //=============================================================================
 // Compound Types
@@ -92,6 +314,133 @@ typedef SPAN(double)  nuspan;
 #define $N(...)   (nuspan){ .p=( (double[]){__VA_ARGS__}), .length=VA_NARGS(__VA_ARGS__) };
 nuspan num_slice(nuspan span, int first, int last); 
 
+//----------------------------------------------------------------------
+// Numeric Reductions
+
+double num_sum       (nuspan span);
+double num_sum_kahan (nuspan span);
+double num_min       (nuspan span);
+double num_max       (nuspan span);
+int    num_argmin    (nuspan span);
+int    num_argmax    (nuspan span);
+double num_mean      (nuspan span);
+double num_variance  (nuspan span);
+double num_dot       (nuspan a, nuspan b);
+
+// Running count, mean and sum of squared deviations (Welford).
+struct Moments { int count; double mean, m2; };
+
+struct Moments num_moments      (nuspan span);
+struct Moments Moments_add      (struct Moments m, double x);
+struct Moments Moments_merge    (struct Moments a, struct Moments b);
+double         Moments_variance (struct Moments m);
+
+//----------------------------------------------------------------------
+// Iterators
+//
+// An iterator is a small struct passed by value, like Fibonacci:
+//
+//     Name_done(it)  - true when no elements remain
+//     Name_get(it)   - current element
+//     Name_next(it)  - iterator advanced one element
+//
+// The templates define sources and stages as static inline functions
+// over another iterator type. A pipeline built from them is one loop
+// after inlining, with no intermediate storage between stages.
+//
+//     ITER_SPAN_TEMPLATE(NumIter, double)
+//     ITER_FILTER_TEMPLATE(Positives, NumIter, double, is_positive)
+//     ITER_MAP_TEMPLATE(Squares, Positives, double, square)
+//     ITER_REDUCE_TEMPLATE(sum_squares, Squares, double, add)
+//
+//     double total = sum_squares(Squares_begin(Positives_begin(NumIter_begin(s.p, s.length))), 0.0);
+
+#define ITER_FOREACH(Name_, It_, Begin_)  \
+	for (Name_ It_ = (Begin_); !Name_##_done(It_); It_ = Name_##_next(It_))
+
+#define ITER_SPAN_TEMPLATE(Name_, T_)  \
+	typedef struct { const T_ *p, *end; } Name_; \
+	static inline Name_ Name_##_begin(const T_ *p, int length) { \
+		return (Name_){ .p = p, .end = p + (p ? length : 0) }; } \
+	static inline bool  Name_##_done(Name_ it)  { return it.p == it.end; } \
+	static inline T_    Name_##_get(Name_ it)   { return *it.p; } \
+	static inline Name_ Name_##_next(Name_ it)  { ++it.p; return it; }
+
+// Endless sequence from a value-semantics state such as Fibonacci.
+#define ITER_GENERATOR_TEMPLATE(Name_, T_, State_, Get_, Next_)  \
+	typedef struct { State_ state; } Name_; \
+	static inline Name_ Name_##_begin(State_ s) { return (Name_){ .state = s }; } \
+	static inline bool  Name_##_done(Name_ it)  { UNUSED(it); return false; } \
+	static inline T_    Name_##_get(Name_ it)   { return Get_(it.state); } \
+	static inline Name_ Name_##_next(Name_ it)  { it.state = Next_(it.state); return it; }
+
+#define ITER_MAP_TEMPLATE(Name_, Src_, T_, Fn_)  \
+	typedef struct { Src_ src; } Name_; \
+	static inline Name_ Name_##_begin(Src_ src) { return (Name_){ .src = src }; } \
+	static inline bool  Name_##_done(Name_ it)  { return Src_##_done(it.src); } \
+	static inline T_    Name_##_get(Name_ it)   { return Fn_(Src_##_get(it.src)); } \
+	static inline Name_ Name_##_next(Name_ it)  { it.src = Src_##_next(it.src); return it; }
+
+#define ITER_FILTER_TEMPLATE(Name_, Src_, T_, Pred_)  \
+	typedef struct { Src_ src; } Name_; \
+	static inline Name_ Name_##_begin(Src_ src) { \
+		while (!Src_##_done(src) && !Pred_(Src_##_get(src))) \
+			src = Src_##_next(src); \
+		return (Name_){ .src = src }; } \
+	static inline bool  Name_##_done(Name_ it)  { return Src_##_done(it.src); } \
+	static inline T_    Name_##_get(Name_ it)   { return Src_##_get(it.src); } \
+	static inline Name_ Name_##_next(Name_ it)  { return Name_##_begin(Src_##_next(it.src)); }
+
+// Stops after n elements without advancing the source past the last one.
+#define ITER_TAKE_TEMPLATE(Name_, Src_, T_)  \
+	typedef struct { Src_ src; int left; } Name_; \
+	static inline Name_ Name_##_begin(Src_ src, int n) { return (Name_){ .src = src, .left = n }; } \
+	static inline bool  Name_##_done(Name_ it)  { return it.left <= 0 || Src_##_done(it.src); } \
+	static inline T_    Name_##_get(Name_ it)   { return Src_##_get(it.src); } \
+	static inline Name_ Name_##_next(Name_ it)  { \
+		if (--it.left > 0) it.src = Src_##_next(it.src); \
+		return it; }
+
+// Pairs elements of two sources, combined by Fn_(a, b); ends with the shorter.
+#define ITER_ZIP_TEMPLATE(Name_, SrcA_, SrcB_, T_, Fn_)  \
+	typedef struct { SrcA_ a; SrcB_ b; } Name_; \
+	static inline Name_ Name_##_begin(SrcA_ a, SrcB_ b) { return (Name_){ .a = a, .b = b }; } \
+	static inline bool  Name_##_done(Name_ it)  { return SrcA_##_done(it.a) || SrcB_##_done(it.b); } \
+	static inline T_    Name_##_get(Name_ it)   { return Fn_(SrcA_##_get(it.a), SrcB_##_get(it.b)); } \
+	static inline Name_ Name_##_next(Name_ it)  { \
+		it.a = SrcA_##_next(it.a); it.b = SrcB_##_next(it.b); return it; }
+
+// Defines T_ Name_(Src_ it, T_ init), folding Fn_(acc, x) over the source.
+#define ITER_REDUCE_TEMPLATE(Name_, Src_, T_, Fn_)  \
+	static inline T_ Name_(Src_ it, T_ acc) { \
+		for (; !Src_##_done(it); it = Src_##_next(it)) \
+			acc = Fn_(acc, Src_##_get(it)); \
+		return acc; }
+
+// Integer counter from start up to (not including) stop by step.
+typedef struct { int i, stop, step; } RangeIter;
+
+static inline RangeIter RangeIter_begin(int start, int stop, int step)
+{
+	return (RangeIter){ .i = start, .stop = stop, .step = step };
+}
+static inline bool RangeIter_done(RangeIter it)
+{
+	return (it.step > 0) ? it.i >= it.stop : it.i <= it.stop;
+}
+static inline int RangeIter_get(RangeIter it)
+{
+	return it.i;
+}
+static inline RangeIter RangeIter_next(RangeIter it)
+{
+	it.i += it.step;
+	return it;
+}
+
+ITER_SPAN_TEMPLATE(NumIter, double)
+ITER_SPAN_TEMPLATE(StrIter, char)
+
 //----------------------------------------------------------------------
 // Interval
 
@@ -102,6 +451,15 @@ bool   includes (struct Interval invl, double n);
 double clamp    (struct Interval invl, double n);
 double lerp     (struct Interval invl, double t);
 void Interval_fprint (FILE *out, struct Interval invl); 
+bool Interval_is_empty (struct Interval invl);
+
+// Span-wide versions write one result per input element to *out*, which
+// may be the same span as *in*. An empty interval yields NAN (or false)
+// for every element.
+void num_clamp    (struct Interval invl, nuspan in, nuspan out);
+void num_lerp     (struct Interval invl, nuspan in, nuspan out);
+int  num_includes (struct Interval invl, nuspan in, bool out[]);
+void num_remap    (struct Interval from, struct Interval to, nuspan in, nuspan out);
 
 // Common intervals on the real number line. 
 extern const struct Interval R_positive;
@@ -123,4 +481,68 @@ typedef VECTOR(x,y,z)     VectorXYZ;
 typedef VECTOR(r,g,b)     VectorRGB;
 typedef VECTOR(row,col)   VectorRowCol;
 
+//----------------------------------------------------------------------
+// Vector Arrays
+//
+// Structure-of-arrays counterpart to VECTOR: one array per component,
+// named by the same member list, plus v[] for random access by component.
+// All components share one allocation from SOA_CREATE.
+
+#define VECTOR_SOA_FIELD_(NAME_)   double *NAME_;
+#define VECTOR_SOA(...)  \
+	struct { \
+		int length; \
+		union { \
+			struct { VA_MAP(VECTOR_SOA_FIELD_, __VA_ARGS__) }; \
+			double *v[VA_NARGS(__VA_ARGS__)]; \
+		}; \
+	}
+
+typedef VECTOR_SOA(x,y)      VectorArrayXY;
+typedef VECTOR_SOA(x,y,z)    VectorArrayXYZ;
+typedef VECTOR_SOA(r,g,b)    VectorArrayRGB;
+
+bool soa_create  (int dims, int length, double *v[]);
+void soa_destroy (int dims, double *v[]);
+void soa_from_aos(int dims, int length, double *out[], const double aos[]);
+void soa_to_aos  (int dims, int length, double aos[], double *const in[]);
+
+void soa_add      (int dims, int length, double *out[], double *const a[], double *const b[]);
+void soa_scale    (int dims, int length, double *out[], double *const a[], double s);
+void soa_dot      (int dims, int length, double out[], double *const a[], double *const b[]);
+void soa_length   (int dims, int length, double out[], double *const a[]);
+void soa_normalize(int dims, int length, double *out[], double *const a[]);
+void soa_distance (int dims, int length, double out[], double *const a[], double *const b[]);
+
+#define SOA_LENGTHS_MATCH(A_, B_)  ASSERTION((A_).length == (B_).length)
+
+#define SOA_CREATE(S_, N_)   soa_create(VEC_LENGTH(S_), (S_).length = (N_), (S_).v)
+#define SOA_DESTROY(S_)      (soa_destroy(VEC_LENGTH(S_), (S_).v), (S_).length = 0)
+
+// A_ points to an array of (S_).length VECTOR structs of the same dimension.
+#define SOA_FROM_AOS(S_, A_)  \
+	(ASSERTION(sizeof(*(A_)) == sizeof(double) * VEC_LENGTH(S_)), \
+	 soa_from_aos(VEC_LENGTH(S_), (S_).length, (S_).v, (const double*)(A_)))
+#define SOA_TO_AOS(A_, S_)  \
+	(ASSERTION(sizeof(*(A_)) == sizeof(double) * VEC_LENGTH(S_)), \
+	 soa_to_aos(VEC_LENGTH(S_), (S_).length, (double*)(A_), (S_).v))
+
+#define SOA_ADD(Out_, A_, B_)  \
+	(SOA_LENGTHS_MATCH(Out_, A_), SOA_LENGTHS_MATCH(Out_, B_), \
+	 soa_add(VEC_LENGTH(Out_), (Out_).length, (Out_).v, (A_).v, (B_).v))
+#define SOA_SCALE(Out_, A_, S_)  \
+	(SOA_LENGTHS_MATCH(Out_, A_), \
+	 soa_scale(VEC_LENGTH(Out_), (Out_).length, (Out_).v, (A_).v, (S_)))
+#define SOA_NORMALIZE(Out_, A_)  \
+	(SOA_LENGTHS_MATCH(Out_, A_), \
+	 soa_normalize(VEC_LENGTH(Out_), (Out_).length, (Out_).v, (A_).v))
+
+// Per-vector scalar results go to a double array of (A_).length elements.
+#define SOA_DOT(Out_, A_, B_)  \
+	(SOA_LENGTHS_MATCH(A_, B_), soa_dot(VEC_LENGTH(A_), (A_).length, (Out_), (A_).v, (B_).v))
+#define SOA_LENGTH(Out_, A_)  \
+	soa_length(VEC_LENGTH(A_), (A_).length, (Out_), (A_).v)
+#define SOA_DISTANCE(Out_, A_, B_)  \
+	(SOA_LENGTHS_MATCH(A_, B_), soa_distance(VEC_LENGTH(A_), (A_).length, (Out_), (A_).v, (B_).v))
+
 #endif
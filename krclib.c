@@ -1,3 +1,9 @@
+// POSIX and X/Open names a strict -std=c11 build hides: localtime_r,
+// clock_gettime and CLOCK_REALTIME_COARSE for timestamps, and
+// _setjmp/_longjmp when built with -D KR_EXCEPT_FAST_JMP. Defined ahead
+// of every include, since the first system header fixes what's visible.
+#define _XOPEN_SOURCE 700
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -8,32 +14,35 @@
 
 #include "krclib.h"
 
-//----------------------------------------------------------------------
-// Primitive Utilities
-
-static char *kr_int_to_str_back(int n, char *ps)
-{
-	int sign = n < 0 ? -1 : 1;
-
-	*ps-- = '\0';
-	do *ps-- = sign * (n % 10) + '0';
-	while ((n /= 10) != 0);
-
-	if (sign < 0)  *ps-- = '-';
-
-	return ++ps;
-}
-
 //----------------------------------------------------------------------
 // Error Module
 
 //static const enum debug_level DEBUG_LEVEL_DEFAULT = DEBUG_LEVEL_LOW;
 
-static enum debug_level ASSERT_VOLUME = DEBUG_LEVEL_MEDIUM;
+// Each thread may set its own volume; until it does, it follows the
+// process-wide default. A thread's volume is kept as a pointer to its
+// level's entry in volume_marks, so it stays per thread through
+// KR_THREAD_POINTER even where there is no _Thread_local.
+static enum debug_level DEFAULT_VOLUME = DEBUG_LEVEL_MEDIUM;
+static char volume_marks[DEBUG_LEVEL_MAX + 1];
+KR_THREAD_POINTER(thread_volume, char)
 
 void debug_set_volume(enum debug_level level)
 {
-	ASSERT_VOLUME = level;
+	level = (level < DEBUG_LEVEL_ALWAYS) ? DEBUG_LEVEL_ALWAYS
+	      : (level > DEBUG_LEVEL_MAX)    ? DEBUG_LEVEL_MAX : level;
+	thread_volume_set(&volume_marks[level]);
+}
+
+void debug_set_default_volume(enum debug_level level)
+{
+	DEFAULT_VOLUME = level;
+}
+
+enum debug_level debug_volume(void)
+{
+	char *mark = thread_volume_get();
+	return mark ? (enum debug_level)(mark - volume_marks) : DEFAULT_VOLUME;
 }
 
 const char *status_string(enum status stat)
@@ -54,18 +63,20 @@ const char *status_string(enum status stat)
 void debug_print_abort(FILE *out, enum status status, struct SourceLocation source, const char *format, ...)
 {
 	va_list args;
+	va_start(args, format);
 	debug_vprint(out, source, format, args);
 	va_end(args);
 	abort();
 }
 
 void assert_failure(
-		struct  SourceLocation  source,
-		enum    debug_level      level,
-		const   char             *msg)
+		const   struct SourceSite *site,
+		enum    debug_level        level,
+		const   char              *msg)
 {
-	if (level <= ASSERT_VOLUME)
-		debug_print_abort(stderr, STATUS_ASSERT_FAILURE, source, msg);
+	SourceSite_hit(site);
+	if (level <= debug_volume())
+		debug_print_abort(stderr, STATUS_ASSERT_FAILURE, site->location, "%s", msg);
 }
 
 
@@ -84,18 +95,6 @@ void error_fatal(const struct error *error)
 	abort();
 }
 
-int check_index(int i, int length, struct SourceLocation dbg)
-{
-	if (i < -length || i >= length) {
-		char buf[100] = "";
-		snprintf(buf, 100, "%d is out of bounds [%d..%d)", i, -length, length);
-		assert_failure(dbg, DEBUG_LEVEL_MIN, buf);
-	}
-
-	return (i < 0) ? (i += length) : i;
-}
-
-
 void except_throw_error(struct except_frame *frame, struct error *error)
 {
 	if (!frame)
@@ -103,36 +102,33 @@ void except_throw_error(struct except_frame *frame, struct error *error)
 //		error_fatal(error, "Unhandled exception");
 
 	frame->error = error;
-	longjmp(frame->env, (int)error->status);
+	KR_LONGJMP(frame->env, (int)error->status);
 }
 
-void except_throw(struct except_frame *frame, enum status status, struct SourceLocation source)
+void except_throw(struct except_frame *frame, enum status status, const struct SourceSite *site)
 {
-	struct error *error = malloc(sizeof(struct error));
-	if (!error)
-		FAILURE(STATUS_MALLOC_FAIL, "Failed to malloc error object.");
+	SourceSite_hit(site);
+	struct error unhandled;
+	struct error *error = frame ? &frame->record : &unhandled;
 
 	*error = (struct error){
-		.source = source,
+		.source = site->location,
 		.status = status,
 	};
 
 	except_throw_error(frame, error);
 }
 
-void except_try(struct except_frame *frame, enum status status, struct SourceLocation source)
+void except_try(struct except_frame *frame, enum status status, const struct SourceSite *site)
 {
 	if (status != STATUS_OK)
-		except_throw(frame, status, source);
+		except_throw(frame, status, site);
 }
 
 void except_dispose(struct except_frame *frame)
 {
-	if (frame && frame->error)
-	{
-		free(frame->error);
+	if (frame)
 		frame->error = NULL;
-	}
 }
 
 bool size_t_mult_overflows(size_t a, size_t b)
@@ -145,18 +141,18 @@ bool size_t_add_overflows(size_t a, size_t b)
     return a > SIZE_MAX - b;
 }
 
-size_t try_size_mult(size_t a, size_t b, struct except_frame *xf, struct SourceLocation loc)
+size_t try_size_mult(size_t a, size_t b, struct except_frame *xf, const struct SourceSite *site)
 {
     if (size_t_mult_overflows(a, b))
-		except_throw(xf, STATUS_MATH_OVERFLOW, loc);
+		except_throw(xf, STATUS_MATH_OVERFLOW, site);
 
 	return a * b;
 }
 
-size_t try_size_add(size_t a, size_t b, struct except_frame *xf, struct SourceLocation loc)
+size_t try_size_add(size_t a, size_t b, struct except_frame *xf, const struct SourceSite *site)
 {
     if (size_t_add_overflows(a, b))
-		except_throw(xf, STATUS_MATH_OVERFLOW, loc);
+		except_throw(xf, STATUS_MATH_OVERFLOW, site);
 
 	return a + b;
 }
@@ -176,10 +172,10 @@ bool int_mult_overflows(int a, int b)
 		return b < INT_MAX / a;
 }
 
-int try_int_mult(int a, int b, struct except_frame *xf, struct SourceLocation loc)
+int try_int_mult(int a, int b, struct except_frame *xf, const struct SourceSite *site)
 {
 	if (int_mult_overflows(a, b))
-		except_throw(xf, STATUS_MATH_OVERFLOW, loc);
+		except_throw(xf, STATUS_MATH_OVERFLOW, site);
 
 	return a * b;
 }
@@ -189,27 +185,47 @@ bool ptrdiff_to_int_overflows(ptrdiff_t d)
 	return (d > (ptrdiff_t)INT_MAX) || (d < (ptrdiff_t)-INT_MAX);
 }
 
-int try_ptrdiff_to_int(ptrdiff_t d, struct except_frame *xf, struct SourceLocation loc)
+int try_ptrdiff_to_int(ptrdiff_t d, struct except_frame *xf, const struct SourceSite *site)
 {
 	if (ptrdiff_to_int_overflows(d))
-		except_throw(xf, STATUS_MATH_OVERFLOW, loc);
+		except_throw(xf, STATUS_MATH_OVERFLOW, site);
 
 	return (int)d;
 }
-void *try_malloc(size_t size, struct except_frame *xf, struct SourceLocation source)
+void *try_malloc(size_t size, struct except_frame *xf, const struct SourceSite *site)
 {
 	void *mem = malloc(size);
 	if (!mem)
-		except_throw(xf, STATUS_MALLOC_FAIL, source);
+		except_throw(xf, STATUS_MALLOC_FAIL, site);
 	return mem;
 }
 
 void *fam_alloc(size_t head_size, size_t elem_size, size_t array_length, struct except_frame *xf)
 {
 	size_t size = 0;
-	size = try_size_mult(elem_size, array_length, xf, CURRENT_LOCATION);
-	size = try_size_add(size, head_size, xf, CURRENT_LOCATION);
-	return try_malloc(size, xf, CURRENT_LOCATION);
+	size = try_size_mult(elem_size, array_length, xf, SRCSITE("throw"));
+	size = try_size_add(size, head_size, xf, SRCSITE("throw"));
+	return try_malloc(size, xf, SRCSITE("throw"));
+}
+
+struct mem_result malloc_checked(struct size_result size)
+{
+	if (size.status != STATUS_OK)
+		return (struct mem_result){ .status = size.status };
+
+	void *mem = malloc(size.value);
+	return (struct mem_result){
+		.value  = mem,
+		.status = mem ? STATUS_OK : STATUS_MALLOC_FAIL
+	};
+}
+
+struct mem_result fam_alloc_checked(size_t head_size, size_t elem_size, size_t array_length)
+{
+	return malloc_checked(
+	           size_add_checked(
+	               size_mult_checked(size_checked(elem_size), array_length),
+	               head_size));
 }
 
 //----------------------------------------------------------------------
@@ -408,6 +424,360 @@ char *timestamp(char *s, size_t num, struct tm *(*totime)(const time_t*))
 	return s;
 }
 
+struct timespec timestamp_now(bool coarse)
+{
+	struct timespec t;
+#ifdef CLOCK_REALTIME_COARSE
+	if (coarse && clock_gettime(CLOCK_REALTIME_COARSE, &t) == 0)
+		return t;
+#else
+	UNUSED(coarse);
+#endif
+	timespec_get(&t, TIME_UTC);
+	return t;
+}
+
+static const char digit_pairs[201] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static char *put_2digits(char *p, int n)
+{
+	memcpy(p, &digit_pairs[2 * n], 2);
+	return p + 2;
+}
+
+// Days since 1970-01-01 to a proleptic Gregorian date.
+static void civil_from_days(long days, int *year, int *month, int *day)
+{
+	days += 719468;
+	long era = (days >= 0 ? days : days - 146096) / 146097;
+	long doe = days - era * 146097;
+	long yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+	long doy = doe - (365*yoe + yoe/4 - yoe/100);
+	long mp  = (5*doy + 2) / 153;
+
+	*day   = doy - (153*mp + 2)/5 + 1;
+	*month = mp < 10 ? mp + 3 : mp - 9;
+	*year  = yoe + era * 400 + (*month <= 2);
+}
+
+// Broken-down time for a UTC offset, without touching gmtime's static.
+static void utc_fields(time_t secs, long offset, int f[6])
+{
+	long long t = (long long)secs + offset;
+	long days = t / 86400, rem = t % 86400;
+	if (rem < 0)
+		rem += 86400, --days;
+
+	civil_from_days(days, &f[0], &f[1], &f[2]);
+	f[3] = rem / 3600;
+	f[4] = rem / 60 % 60;
+	f[5] = rem % 60;
+}
+
+// Proleptic Gregorian date to days since 1970-01-01.
+static long days_from_civil(int year, int month, int day)
+{
+	year -= month <= 2;
+	long era = (year >= 0 ? year : year - 399) / 400;
+	long yoe = year - era * 400;
+	long doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	long doe = yoe * 365 + yoe/4 - yoe/100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+// Seconds east of UTC in effect at secs.
+static long local_offset(time_t secs)
+{
+	struct tm local;
+#ifdef _POSIX_C_SOURCE
+	if (!localtime_r(&secs, &local))
+		return 0;
+#else
+	struct tm *lt = localtime(&secs);
+	if (!lt)
+		return 0;
+	local = *lt;
+#endif
+	long long wall = days_from_civil(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday) * 86400LL
+	               + local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+	return (long)(wall - secs);
+}
+
+//----------------------------------------------------------------------
+// Timestamp Parsing
+
+// Eight bytes as one word, first byte lowest, regardless of byte order.
+static inline uint64_t load_word(const char *p)
+{
+	const unsigned char *b = (const unsigned char *)p;
+	return (uint64_t)b[0]       | (uint64_t)b[1] << 8  | (uint64_t)b[2] << 16 | (uint64_t)b[3] << 24
+	     | (uint64_t)b[4] << 32 | (uint64_t)b[5] << 40 | (uint64_t)b[6] << 48 | (uint64_t)b[7] << 56;
+}
+
+// digits has 0xFF at the bytes that must be '0'-'9'; every other byte
+// must equal the same byte of literal. Adding 6 to a 0x3_ byte keeps its
+// high nibble 3 only for 0-9, and ASCII bytes can't carry into the next.
+static inline bool word_matches(uint64_t w, uint64_t digits, uint64_t literal)
+{
+	const uint64_t ones = 0x0101010101010101u;
+	return !(w & (0x80 * ones))
+	    && (w & ~digits) == (literal & ~digits)
+	    && (w & digits & (0xF0 * ones)) == (digits & (0x30 * ones))
+	    && ((w + 0x06 * ones) & digits & (0xF0 * ones)) == (digits & (0x30 * ones));
+}
+
+static inline bool is_digit(char c)  { return (unsigned)(c - '0') < 10; }
+static inline int digit_at(const char *p, int i)  { return p[i] - '0'; }
+static inline int two_digits(const char *p, int i)  { return 10 * digit_at(p, i) + digit_at(p, i+1); }
+
+// days_from_civil for years 0-9999: shifted 400 years forward and
+// March-based, so it needs only unsigned arithmetic and no branches.
+static inline long long days_from_parsed_civil(unsigned year, unsigned month, unsigned day)
+{
+	static const unsigned short days_before_month[12] = {
+		306, 337, 0, 31, 61, 92, 122, 153, 184, 214, 245, 275 };
+	unsigned y = year + 400 - (month <= 2);
+	unsigned days = y*365 + y/4 - y/100 + y/400 + days_before_month[month-1] + day - 1;
+	return (long long)days - (719468 + 146097);
+}
+
+static bool is_leap_year(int y)  { return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0; }
+
+// "YYYY-MM-DD?HH:MM:SS" where ? is 'T' or ' ', and the time separator is
+// time_sep. Returns seconds since the epoch, ignoring any zone.
+static inline bool parse_civil(const char *p, char time_sep, long long *secs)
+{
+	// Bytes 0-7 "YYYY-MM-"; bytes 8-15 "DD?HH:MM" with the separator
+	// masked out and checked on its own.
+	const uint64_t date_digits  = 0x00FFFF00FFFFFFFFu;
+	const uint64_t date_literal = (uint64_t)'-' << 32 | (uint64_t)'-' << 56;
+	const uint64_t time_digits  = 0xFFFF00FFFF00FFFFu;
+	const uint64_t time_literal = (uint64_t)time_sep << 40;
+	const uint64_t time_word    = load_word(p + 8) & ~((uint64_t)0xFF << 16);
+
+	if (!word_matches(load_word(p), date_digits, date_literal)
+	    || !word_matches(time_word, time_digits, time_literal)
+	    || !(p[10] == 'T' || p[10] == 't' || p[10] == ' ')
+	    || p[16] != time_sep || !is_digit(p[17]) || !is_digit(p[18]))
+		return false;
+
+	int year   = 100 * two_digits(p, 0) + two_digits(p, 2);
+	int month  = two_digits(p, 5);
+	int day    = two_digits(p, 8);
+	int hour   = two_digits(p, 11);
+	int minute = two_digits(p, 14);
+	int second = two_digits(p, 17);
+
+	static const char month_days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	if (month < 1 || month > 12 || day < 1
+	    || day > month_days[month-1] + (month == 2 && is_leap_year(year))
+	    || hour > 23 || minute > 59 || second > 60)
+		return false;
+
+	*secs = days_from_parsed_civil(year, month, day) * 86400LL + hour * 3600 + minute * 60 + second;
+	return true;
+}
+
+static struct time_result time_result_of(long long secs, long nsec)
+{
+	if ((time_t)secs != secs)
+		return (struct time_result){ .status = STATUS_MATH_OVERFLOW };
+	return (struct time_result){ .value = { .tv_sec = secs, .tv_nsec = nsec }, .status = STATUS_OK };
+}
+
+struct time_result timestamp_parse_iso(strand s)
+{
+	const struct time_result fail = { .status = STATUS_PARSE_FAIL };
+	const char *p = s.p, *end = s.p + s.length;
+	long long secs;
+	if (s.length < 20 || !parse_civil(p, ':', &secs))
+		return fail;
+	p += 19;
+
+	long nsec = 0;
+	if (*p == '.' || *p == ',') {
+		int n = 0;
+		while (++p < end && is_digit(*p))
+			if (n++ < 9)
+				nsec = nsec * 10 + (*p - '0');
+		if (n == 0)
+			return fail;
+		for (; n < 9; ++n)
+			nsec *= 10;
+	}
+
+	if (p < end && (*p == 'Z' || *p == 'z'))
+		++p;
+	else if (p < end && (*p == '+' || *p == '-')) {
+		int sign = (*p++ == '-') ? -1 : 1;
+		long left = end - p;
+		if (left < 2 || !is_digit(p[0]) || !is_digit(p[1]))
+			return fail;
+		int hours = two_digits(p, 0), minutes = 0;
+		p += 2;
+		left -= 2;
+		bool colon = left > 0 && *p == ':';
+		if (colon)
+			++p, --left;
+		if (left >= 2 && is_digit(p[0]) && is_digit(p[1])) {
+			minutes = two_digits(p, 0);
+			p += 2;
+		}
+		else if (colon)
+			return fail;
+		if (hours > 23 || minutes > 59)
+			return fail;
+		secs -= sign * (hours * 3600L + minutes * 60L);
+	}
+	else
+		return fail;
+
+	if (p != end)
+		return fail;
+	return time_result_of(secs, nsec);
+}
+
+struct time_result timestamp_parse(strand s, long utc_offset)
+{
+	const struct time_result fail = { .status = STATUS_PARSE_FAIL };
+	long long secs;
+	if (s.length < 21 || s.p[19] != ' ' || !parse_civil(s.p, '.', &secs))
+		return fail;
+
+	strand zone = { .p = s.p + 20, .length = s.length - 20 };
+	if (zone.length > 6)
+		return fail;
+	for (int i = 0; i < zone.length; ++i)
+		if (!isalpha((unsigned char)zone.p[i]))
+			return fail;
+
+	bool utc = (zone.length == 3 && (!memcmp(zone.p, "UTC", 3) || !memcmp(zone.p, "GMT", 3)))
+	        || (zone.length == 1 && zone.p[0] == 'Z');
+	if (!utc)
+		secs -= utc_offset;
+	return time_result_of(secs, 0);
+}
+
+//----------------------------------------------------------------------
+// Timestamp Formatting
+
+struct timestamp_cache
+{
+	time_t second;
+	bool valid;
+	char prefix[19];            // YYYY-MM-DDTHH:MM:SS
+	char zone[7];               // "Z" or "+hh:mm"
+	int zone_length;
+};
+
+#if KR_HAVE_THREAD_LOCAL
+static KR_THREAD_LOCAL struct timestamp_cache timestamp_caches[2];
+
+static struct timestamp_cache *timestamp_caches_get(void)
+{
+	return timestamp_caches;
+}
+#else
+// Without _Thread_local each thread allocates its pair of caches on first
+// use, in a tss slot that frees them when the thread exits.
+static tss_t timestamp_caches_key;
+static once_flag timestamp_caches_once = ONCE_FLAG_INIT;
+
+static void timestamp_caches_create(void)
+{
+	tss_create(&timestamp_caches_key, free);
+}
+
+static struct timestamp_cache *timestamp_caches_get(void)
+{
+	call_once(&timestamp_caches_once, timestamp_caches_create);
+	struct timestamp_cache *caches = tss_get(timestamp_caches_key);
+	if (caches)
+		return caches;
+
+	caches = calloc(2, sizeof(*caches));
+	if (caches && tss_set(timestamp_caches_key, caches) != thrd_success) {
+		free(caches);
+		caches = NULL;
+	}
+	return caches;
+}
+#endif
+
+static void timestamp_cache_fill(struct timestamp_cache *cache, time_t second, bool local)
+{
+	long offset = local ? local_offset(second) : 0;
+	int f[6];
+	utc_fields(second, offset, f);
+
+	char *p = cache->prefix;
+	p = put_2digits(p, f[0] / 100 % 100);
+	p = put_2digits(p, f[0] % 100);
+	*p++ = '-';  p = put_2digits(p, f[1]);
+	*p++ = '-';  p = put_2digits(p, f[2]);
+	*p++ = 'T';  p = put_2digits(p, f[3]);
+	*p++ = ':';  p = put_2digits(p, f[4]);
+	*p++ = ':';  p = put_2digits(p, f[5]);
+
+	if (!local) {
+		cache->zone[0] = 'Z';
+		cache->zone_length = 1;
+	}
+	else {
+		long m = offset / 60;
+		cache->zone[0] = (m < 0) ? '-' : '+';
+		m = (m < 0) ? -m : m;
+		put_2digits(cache->zone + 1, m / 60 % 100);
+		cache->zone[3] = ':';
+		put_2digits(cache->zone + 4, m % 60);
+		cache->zone_length = 6;
+	}
+
+	cache->second = second;
+	cache->valid  = true;
+}
+
+// Appends the timestamp and a terminating '\0'; false, with buf left
+// unchanged, when it does not fit.
+bool timestamp_iso(strbuf *buf, struct timespec t, enum timestamp_precision precision, bool local)
+{
+	struct timestamp_cache *caches = timestamp_caches_get();
+	// Out of memory: format through a cache of our own.
+	struct timestamp_cache *cache = caches ? &caches[local] : &(struct timestamp_cache){0};
+	if (!cache->valid || cache->second != t.tv_sec)
+		timestamp_cache_fill(cache, t.tv_sec, local);
+
+	int length = sizeof(cache->prefix) + (precision ? 1 + precision : 0) + cache->zone_length;
+	if (strbuf_cap(buf) < length + 1)
+		return false;
+
+	char *p = buf->back;
+	memcpy(p, cache->prefix, sizeof(cache->prefix));
+	p += sizeof(cache->prefix);
+
+	if (precision) {
+		long us = t.tv_nsec / 1000;
+		*p++ = '.';
+		p = put_2digits(p, us / 10000);
+		if (precision == TIMESTAMP_MILLIS)
+			*p++ = '0' + us / 1000 % 10;
+		else {
+			p = put_2digits(p, us / 100 % 100);
+			p = put_2digits(p, us % 100);
+		}
+	}
+
+	memcpy(p, cache->zone, cache->zone_length);
+	p += cache->zone_length;
+	*p = '\0';
+
+	buf->back = p;
+	return true;
+}
+
 
 
 
@@ -421,7 +791,7 @@ static const int XORSHIFT_PARAM_LIST[][3] = {
 
 void Xorshift_init(Xorshifter *state, uint32_t seed, int params_num)
 {
-	params_num = params_num % ARRAY_SIZE(XORSHIFT_PARAM_LIST);
+	params_num = params_num % ARRAY_LENGTH(XORSHIFT_PARAM_LIST);
     const int *params = XORSHIFT_PARAM_LIST[params_num];
 
     *state = (Xorshifter)
@@ -6,6 +6,8 @@
 #include <stdint.h>
 #include <time.h>
 #include <setjmp.h>
+#include <stddef.h>
+#include <limits.h>
 
 #include "krbase.h"
 
@@ -110,7 +112,25 @@ enum debug_level
 	DEBUG_LEVEL_MAX,
 };
 
+// Checks above DEBUG_LEVEL_CEILING are compiled out: their level test is
+// a constant expression, so the condition and arguments are never
+// evaluated and no code is emitted. Checks at or below the ceiling still
+// compare against the runtime volume. Release builds keep everything
+// below DEBUG_LEVEL_HIGH unless the ceiling is set on the command line,
+// e.g. -D DEBUG_LEVEL_CEILING=DEBUG_LEVEL_MIN.
+#ifndef DEBUG_LEVEL_CEILING
+#  ifdef NDEBUG
+#    define DEBUG_LEVEL_CEILING  DEBUG_LEVEL_MEDIUM_9
+#  else
+#    define DEBUG_LEVEL_CEILING  DEBUG_LEVEL_MAX
+#  endif
+#endif
+
+#define DEBUG_LEVEL_COMPILED(Level_)  ((Level_) <= DEBUG_LEVEL_CEILING || (Level_) == DEBUG_LEVEL_MIN)
+
 void debug_set_volume(enum debug_level level);
+void debug_set_default_volume(enum debug_level level);
+enum debug_level debug_volume(void);
 
 
 #define KR_STATUS_X_TABLE \
@@ -125,6 +145,7 @@ void debug_set_volume(enum debug_level level);
             X(MATH_OVERFLOW,    "Arithmetic overflow") \
 			X(MALLOC_FAIL,      "Memory allocation failed") \
 			X(OUT_OF_SPACE,     "Not enough space to copy data") \
+			X(PARSE_FAIL,       "Could not parse input") \
 			X(EXCEPTION,        "Exception thrown") 
 
 #define X(EnumName_, _)  STATUS_##EnumName_,
@@ -138,7 +159,13 @@ const char *status_string(enum status stat);
 
 
 
-#define WATCH_INT(Val_)  debug_print(stderr, STATUS_WATCH, CURRENT_LOCATION, STRINGIFY(Val_) " = %d\n", Val_)
+#define WATCH_LEVEL  DEBUG_LEVEL_HIGH
+
+#define WATCH_INT(Val_) \
+	do{ if (DEBUG_LEVEL_COMPILED(WATCH_LEVEL)) { \
+		SOURCE_SITE(site_, "watch"); \
+		SourceSite_hit(&site_); \
+		debug_print(stderr, site_.location, STRINGIFY(Val_) " = %d", (Val_)); } } while(0)
 
 struct error 
 { 
@@ -149,52 +176,188 @@ struct error
 
 void error_fprint(FILE *out, const struct error *error);
 void error_fatal(const struct error *error);
-void assert_failure(struct SourceLocation source, enum debug_level level, const char *msg);
+void assert_failure(const struct SourceSite *site, enum debug_level level, const char *msg);
 
 #define PRECON(Condition_, Level_) \
-	do{ if (Condition_); else assert_failure(CURRENT_LOCATION, (Level_), #Condition_); } while(0)
+	do{ if (!DEBUG_LEVEL_COMPILED(Level_) || (Condition_)); \
+		else { SOURCE_SITE(site_, "precondition"); \
+		       assert_failure(&site_, (Level_), #Condition_); } } while(0)
 
 #define REQUIRE(Condition_)  PRECON(Condition_, DEBUG_LEVEL_LOW) 
 
+// PRECON checked on the first and every N_th pass per thread; see
+// ASSERT_SAMPLED.
+#define PRECON_SAMPLED(N_, Condition_, Level_) \
+	do{ KR_SAMPLE_COUNTER(countdown_); \
+		if (DEBUG_LEVEL_COMPILED(Level_) && KR_SAMPLE_TAKE(countdown_, N_)) \
+			PRECON(Condition_, Level_); } while(0)
+
 #define FAILURE(Status_, Message_)   \
 	error_fatal(&(struct error){ .source=CURRENT_LOCATION, .status=(Status_), .message=(Message_) })
 
-#define CHECK(I_, LEN_)  check_index((I_), (LEN_), CURRENT_LOCATION)
-int check_index(int i, int length, struct SourceLocation dbg);
 
 
+// The frame carries its own error record, so throwing never allocates.
+// error points at the record, or at a caller's error passed to
+// except_throw_error.
 struct except_frame 
 {
-	volatile struct { jmp_buf env; };
+	jmp_buf env;
 	struct error *error;
+	struct error  record;
 };
 
-#define  EXCEPT_BEGIN(Xf_)  setjmp((Xf_).env)
+// Define KR_EXCEPT_FAST_JMP on POSIX systems to use _setjmp/_longjmp,
+// which skip saving and restoring the signal mask. Needs _XOPEN_SOURCE
+// defined before any system header.
+#ifdef KR_EXCEPT_FAST_JMP
+#define  KR_SETJMP(Env_)        _setjmp(Env_)
+#define  KR_LONGJMP(Env_, Val_) _longjmp((Env_), (Val_))
+#else
+#define  KR_SETJMP(Env_)        setjmp(Env_)
+#define  KR_LONGJMP(Env_, Val_) longjmp((Env_), (Val_))
+#endif
+
+#define  EXCEPT_BEGIN(Xf_)  KR_SETJMP((Xf_).env)
 void except_throw_error(struct except_frame *frame, struct error *error);
-void except_throw(struct except_frame *frame, enum status status, struct SourceLocation dbi);
-void except_try(struct except_frame *frame, enum status status, struct SourceLocation dbi);
+void except_throw(struct except_frame *frame, enum status status, const struct SourceSite *site);
+void except_try(struct except_frame *frame, enum status status, const struct SourceSite *site);
 void except_dispose(struct except_frame *frame);
 
 #define  EXCEPT_TRY  0
 
+// except_throw and except_try that take their site from the call, where
+// each throw is counted.
+#define  EXCEPT_THROW(Xf_, Status_)  except_throw((Xf_), (Status_), SRCSITE("throw"))
+
+#define  EXCEPT_CHECK(Xf_, Status_) \
+	do{ enum status status_ = (Status_); \
+		if (status_ != STATUS_OK) EXCEPT_THROW((Xf_), status_); } while(0)
+
 //----------------------------------------------------------------------
 // Arithmetic Overflow Safety
 
 bool size_t_mult_overflows(size_t a, size_t b);
 bool size_t_add_overflows(size_t a, size_t b);
-size_t try_size_mult(size_t a, size_t b, struct except_frame *xf, struct SourceLocation loc);
-size_t try_size_add(size_t a, size_t b, struct except_frame *xf, struct SourceLocation loc);
+size_t try_size_mult(size_t a, size_t b, struct except_frame *xf, const struct SourceSite *site);
+size_t try_size_add(size_t a, size_t b, struct except_frame *xf, const struct SourceSite *site);
 
 bool   int_mult_overflows(int a, int b);
-int    try_int_mult(int a, int b, struct except_frame *xf, struct SourceLocation loc);
+int    try_int_mult(int a, int b, struct except_frame *xf, const struct SourceSite *site);
 
 bool ptrdiff_to_int_overflows(ptrdiff_t d);
-int try_ptrdiff_to_int(ptrdiff_t d, struct except_frame *xf, struct SourceLocation loc);
+int try_ptrdiff_to_int(ptrdiff_t d, struct except_frame *xf, const struct SourceSite *site);
+
+//----------------------------------------------------------------------
+// Checked Results
+//
+// Status-code alternatives to the try_* functions that need no
+// except_frame or setjmp. Each takes the previous result and passes a
+// failure straight through, so a whole calculation can be chained and
+// checked once:
+//
+//     struct size_result n = size_add_checked(size_mult_checked(size_checked(len), elem), head);
+//     if (n.status != STATUS_OK) ...
+//
+// except_try(xf, r.status, site) turns a failed result into an exception.
+
+struct size_result { size_t value; enum status status; };
+struct int_result  { int    value; enum status status; };
+struct mem_result  { void  *value; enum status status; };
+
+#if defined(__GNUC__) || defined(__clang__)
+#define KR_MULT_OVERFLOWS(A_, B_, R_)  __builtin_mul_overflow((A_), (B_), (R_))
+#define KR_ADD_OVERFLOWS(A_, B_, R_)   __builtin_add_overflow((A_), (B_), (R_))
+#endif
+
+static inline struct size_result size_checked(size_t v)
+{
+	return (struct size_result){ .value = v, .status = STATUS_OK };
+}
+
+static inline struct size_result size_mult_checked(struct size_result a, size_t b)
+{
+#ifdef KR_MULT_OVERFLOWS
+	if (a.status == STATUS_OK && KR_MULT_OVERFLOWS(a.value, b, &a.value))
+		a.status = STATUS_MATH_OVERFLOW;
+#else
+	if (a.status != STATUS_OK)
+		;
+	else if (size_t_mult_overflows(a.value, b))
+		a.status = STATUS_MATH_OVERFLOW;
+	else
+		a.value *= b;
+#endif
+	return a;
+}
+
+static inline struct size_result size_add_checked(struct size_result a, size_t b)
+{
+#ifdef KR_ADD_OVERFLOWS
+	if (a.status == STATUS_OK && KR_ADD_OVERFLOWS(a.value, b, &a.value))
+		a.status = STATUS_MATH_OVERFLOW;
+#else
+	if (a.status != STATUS_OK)
+		;
+	else if (size_t_add_overflows(a.value, b))
+		a.status = STATUS_MATH_OVERFLOW;
+	else
+		a.value += b;
+#endif
+	return a;
+}
+
+static inline struct int_result int_checked(int v)
+{
+	return (struct int_result){ .value = v, .status = STATUS_OK };
+}
+
+static inline struct int_result int_mult_checked(struct int_result a, int b)
+{
+#ifdef KR_MULT_OVERFLOWS
+	if (a.status == STATUS_OK && KR_MULT_OVERFLOWS(a.value, b, &a.value))
+		a.status = STATUS_MATH_OVERFLOW;
+#else
+	if (a.status != STATUS_OK)
+		;
+	else if (a.value && b && int_mult_overflows(a.value, b))
+		a.status = STATUS_MATH_OVERFLOW;
+	else
+		a.value *= b;
+#endif
+	return a;
+}
+
+static inline struct int_result int_add_checked(struct int_result a, int b)
+{
+#ifdef KR_ADD_OVERFLOWS
+	if (a.status == STATUS_OK && KR_ADD_OVERFLOWS(a.value, b, &a.value))
+		a.status = STATUS_MATH_OVERFLOW;
+#else
+	if (a.status != STATUS_OK)
+		;
+	else if ((b > 0 && a.value > INT_MAX - b) || (b < 0 && a.value < INT_MIN - b))
+		a.status = STATUS_MATH_OVERFLOW;
+	else
+		a.value += b;
+#endif
+	return a;
+}
+
+static inline struct int_result ptrdiff_to_int_checked(ptrdiff_t d)
+{
+	if (ptrdiff_to_int_overflows(d))
+		return (struct int_result){ .status = STATUS_MATH_OVERFLOW };
+	return int_checked((int)d);
+}
+
+struct mem_result malloc_checked(struct size_result size);
+struct mem_result fam_alloc_checked(size_t head_size, size_t elem_size, size_t array_length);
 
 //----------------------------------------------------------------------
 // Memory tools
 
-void *try_malloc(size_t size, struct except_frame *xf, struct SourceLocation source);
+void *try_malloc(size_t size, struct except_frame *xf, const struct SourceSite *site);
 void *fam_alloc(size_t head_size, size_t elem_size, size_t array_length, struct except_frame *xf);
 
 
@@ -207,7 +370,7 @@ void *fam_alloc(size_t head_size, size_t elem_size, size_t array_length, struct
 		TYPE_ at[VA_NARGS(__VA_ARGS__)]; \
 	}
 
-#define VECT_LENGTH(V_)    (int)(ARRAY_SIZE((V_).at))
+#define VECT_LENGTH(V_)    (int)(ARRAY_LENGTH((V_).at))
 
 //----------------------------------------------------------------------
 //@module range
@@ -238,14 +401,14 @@ static inline bool range_has(struct range r, int i)
 	static inline struct Name_ CONCAT(Name_,_slice)(struct Name_ span, int start, int stop) { \
 		int length = CONCAT(Name_,_length)(span);  \
 		return (struct Name_){ \
-			.front = span.front + CHECK(start, length), \
-			.back  = span.front + CHECK(stop,  length) };  }
+			.front = span.front + CHECK_BOUNDARY_LEN(length, start), \
+			.back  = span.front + CHECK_BOUNDARY_LEN(length, stop) };  }
 
 SPAN_TEMPLATE(char, char_span)
 SPAN_TEMPLATE(char, strand)
 SPAN_TEMPLATE(int, int_span)
 SPAN_TEMPLATE(double, dub_span)
-SPAN_TEMPLATE(Byte, byte_span)
+SPAN_TEMPLATE(byte, byte_span)
 
 
 //----------------------------------------------------------------------
@@ -325,6 +488,15 @@ void   Chain_append(Chain *c, struct link *l);
 void   Chain_appends(Chain *chain, ...);
 void  *Chain_foreach(Chain *chain, void (*fn)(void*,void*), void *baggage, int offset);
 
+// Iterator over the T_ structs linked into a Chain through their Link_ member.
+#define ITER_CHAIN_TEMPLATE(Name_, T_, Link_)  \
+	typedef struct { struct link *n, *head; } Name_; \
+	static inline Name_ Name_##_begin(Chain *c) { \
+		return (Name_){ .n = c->head.next, .head = &c->head }; } \
+	static inline bool  Name_##_done(Name_ it)  { return !it.n || it.n == it.head; } \
+	static inline T_   *Name_##_get(Name_ it)   { return MEMBER_TO_STRUCT_PTR(it.n, T_, Link_); } \
+	static inline Name_ Name_##_next(Name_ it)  { it.n = it.n->next; return it; }
+
 
 //----------------------------------------------------------------------
 //@module Logging
@@ -338,6 +510,39 @@ char *timestamp(char *s, size_t num, struct tm *(*totime)(const time_t*));
 #define TIMESTAMP_GMT()  timestamp((char[TIMESTAMP_SIZE]){}, TIMESTAMP_SIZE, gmtime)
 #define TIMESTAMP_LOC()  timestamp((char[TIMESTAMP_SIZE]){}, TIMESTAMP_SIZE, localtime)
 
+// ISO-8601 timestamps for log lines, e.g. "2026-10-19T08:15:42.137Z".
+// The date and time of day are formatted once per second per thread and
+// cached; each call copies the cached prefix and writes the fraction
+// from a digit table. Local times carry their UTC offset ("+02:00").
+//
+// timestamp_now(true) reads the coarse clock where the system has one
+// (a few milliseconds resolution, much cheaper), otherwise the regular
+// clock.
+
+enum timestamp_precision
+{
+	TIMESTAMP_SECONDS = 0,
+	TIMESTAMP_MILLIS  = 3,
+	TIMESTAMP_MICROS  = 6,
+};
+
+#define TIMESTAMP_ISO_SIZE  sizeof("YYYY-MM-DDTHH:MM:SS.uuuuuu+hh:mm")
+
+struct timespec timestamp_now(bool coarse);
+bool timestamp_iso(strbuf *buf, struct timespec t, enum timestamp_precision precision, bool local);
+
+// Parse timestamps straight from a strand, without libc time functions or
+// the timezone database. timestamp_parse_iso reads
+// "YYYY-MM-DDTHH:MM:SS[.fraction](Z|+hh:mm|+hhmm|+hh)"; a space may stand
+// in for the T. timestamp_parse reads TIMESTAMP_FORMAT; zone names other
+// than UTC, GMT and Z can't be resolved and are taken to be utc_offset
+// seconds east of UTC. Trailing text is an error.
+
+struct time_result { struct timespec value; enum status status; };
+
+struct time_result timestamp_parse_iso(strand s);
+struct time_result timestamp_parse(strand s, long utc_offset);
+
 
 
 
@@ -407,15 +612,15 @@ static inline bool List_in_bounds(void *l, int i)
 
 static inline int List_check(void *l, int i)
 {
-	if (i < 0)
-		i = LIST_BASE(l)->length + i;
-//	CHECK(l && List_in_bounds(l, i));
-	return i;
+	return CHECK_LEN(List_length(l), i);
 }
 
 #define LIST_AT(L_, I_)   ((L_)->front[List_check((L_), (I_))])
 #define LIST_LAST(L_)     LIST_AT(L_, -1)
 
+// Start an ITER_SPAN_TEMPLATE iterator over the elements of a LIST.
+#define LIST_BEGIN(Iter_, L_)   Iter_##_begin((L_) ? (L_)->front : NULL, List_length(L_))
+
 void List_dispose(void *l);
 
 
@@ -567,5 +772,7 @@ static inline Fibonacci Fib_next(Fibonacci fib)
 	return (Fibonacci){ .f0 = fib.f1, .f1 = fib.f0 + fib.f1 };
 }
 
+ITER_GENERATOR_TEMPLATE(FibIter, int, Fibonacci, Fib_get, Fib_next)
+
 #endif
 // vim: ft=c
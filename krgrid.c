@@ -0,0 +1,806 @@
+// For mmap.
+#define _POSIX_C_SOURCE 200809L
+
+#include "krgrid.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <threads.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+#if defined(_POSIX_MAPPED_FILES) && _POSIX_MAPPED_FILES > 0
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define GRID_FILE_MMAP 1
+#endif
+
+enum { GRID_MAX_THREADS = 64 };
+
+// Runs fn on each of n argument blocks of arg_size bytes, one thread per
+// block. The calling thread runs the first block, and any block whose
+// thread can't be started.
+static void grid_run_threads(thrd_start_t fn, void *args, size_t arg_size, int n)
+{
+	thrd_t threads[GRID_MAX_THREADS];
+	bool started[GRID_MAX_THREADS] = {0};
+
+	for (int t = 1; t < n; ++t)
+		started[t] = thrd_create(&threads[t], fn, (byte*)args + t * arg_size) == thrd_success;
+
+	fn(args);
+	for (int t = 1; t < n; ++t) {
+		if (started[t])
+			thrd_join(threads[t], NULL);
+		else
+			fn((byte*)args + t * arg_size);
+	}
+}
+
+//----------------------------------------------------------------------
+// Grid
+
+static int grid_round_pow2(int n)
+{
+	int p = 1;
+	while (p < n)
+		p <<= 1;
+	return p;
+}
+
+static int grid_log2(int pow2)
+{
+	int k = 0;
+	while ((1 << k) < pow2)
+		++k;
+	return k;
+}
+
+// The fields of a grid of the given shape, or false for negative sizes
+// or sizes too large to index with an int.
+static bool grid_shape(struct Grid *shape, int nrows, int ncols, int elem_size, enum GridLayout layout)
+{
+	if (nrows < 0 || ncols < 0 || elem_size <= 0 || layout < 0 || layout >= GRID_LAYOUT_COUNT)
+		return false;
+
+	*shape = (struct Grid){ .nrows = nrows, .ncols = ncols, .elem_size = elem_size, .layout = layout };
+	long long capacity = (long long)nrows * ncols;
+
+	switch (layout) {
+		case GRID_TILED: {
+			long long tile_rows = (nrows + GRID_TILE - 1LL) / GRID_TILE;
+			long long tile_cols = (ncols + GRID_TILE - 1LL) / GRID_TILE;
+			capacity = tile_rows * tile_cols * GRID_TILE * GRID_TILE;
+			shape->tile_cols = tile_cols;
+			break;
+		}
+		case GRID_MORTON: {
+			if (nrows > (1 << 30) || ncols > (1 << 30))
+				return false;
+			int r = grid_round_pow2(nrows), c = grid_round_pow2(ncols);
+			capacity = (long long)r * c;
+			shape->morton_bits = grid_log2(int_min(r, c));
+			break;
+		}
+		default:
+			break;
+	}
+
+	if (capacity > INT_MAX || (size_t)capacity > (SIZE_MAX - GRID_FILE_ALIGN) / elem_size)
+		return false;
+	shape->capacity = capacity;
+	return true;
+}
+
+// Returns NULL for negative sizes, sizes too large to index with an int,
+// or when out of memory. Cells start zeroed.
+struct Grid *Grid_create(int nrows, int ncols, int elem_size, enum GridLayout layout)
+{
+	struct Grid shape;
+	if (!grid_shape(&shape, nrows, ncols, elem_size, layout))
+		return NULL;
+
+	struct Grid *grid = calloc(1, sizeof(*grid) + (size_t)shape.capacity * elem_size);
+	if (grid)
+		*grid = shape;
+	return grid;
+}
+
+void Grid_destroy(struct Grid *grid)
+{
+	free(grid);
+}
+
+void Grid_fill(struct Grid *grid, const void *value)
+{
+	for (int row = 0; row < grid->nrows; ++row)
+		for (int col = 0; col < grid->ncols; ++col)
+			memcpy(Grid_at_unchecked(grid, row, col), value, grid->elem_size);
+}
+
+// A copy of grid stored in a different layout; NULL when out of memory.
+struct Grid *Grid_relayout(const struct Grid *grid, enum GridLayout layout)
+{
+	struct Grid *copy = Grid_create(grid->nrows, grid->ncols, grid->elem_size, layout);
+	if (!copy)
+		return NULL;
+
+	for (int row = 0; row < grid->nrows; ++row)
+		for (int col = 0; col < grid->ncols; ++col)
+			memcpy(Grid_at_unchecked(copy, row, col),
+			       Grid_at_unchecked((struct Grid*)grid, row, col), grid->elem_size);
+	return copy;
+}
+
+const char *GridLayout_name(enum GridLayout layout)
+{
+	static const char *names[] = {
+		[GRID_ROW_MAJOR] = "row-major",
+		[GRID_TILED]     = "tiled",
+		[GRID_MORTON]    = "morton",
+	};
+	return (layout >= 0 && layout < GRID_LAYOUT_COUNT) ? names[layout] : "unknown";
+}
+
+//----------------------------------------------------------------------
+// Grid Files
+
+static const char grid_file_magic[8] = "KRGRID";
+
+enum { GRID_FILE_BYTE_ORDER = 0x01020304 };
+
+// Returns false, with errno set, when the file can't be written.
+bool grid_file_save(const char *path, struct GridFileHeader header, const void *data)
+{
+	memcpy(header.magic, grid_file_magic, sizeof(header.magic));
+	header.byte_order = GRID_FILE_BYTE_ORDER;
+
+	FILE *file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	static const byte zeros[GRID_FILE_ALIGN];
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+	       && fwrite(zeros, GRID_FILE_ALIGN - sizeof(header), 1, file) == 1
+	       && fwrite(data, 1, header.data_size, file) == header.data_size;
+	return fclose(file) == 0 && ok;
+}
+
+// Maps a file of the given kind, filling in *header. Returns the data at
+// GRID_FILE_ALIGN, or NULL with errno set; EINVAL means the file isn't
+// of this kind, is damaged, or was written with the other byte order.
+// The GRID_FILE_ALIGN bytes before the data are writable and private.
+void *grid_file_map(const char *path, enum GridFileKind kind, struct GridFileHeader *header)
+{
+	byte *base = NULL;
+	size_t size = 0;
+
+#ifdef GRID_FILE_MMAP
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(*header) && (uintmax_t)st.st_size <= SIZE_MAX) {
+		size = st.st_size;
+		base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (base == MAP_FAILED)
+			base = NULL;
+	}
+	else
+		errno = EINVAL;
+	close(fd);
+#else
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return NULL;
+	if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= sizeof(*header)
+	    && (base = malloc(size)) && (rewind(file), fread(base, 1, size, file) != size))
+		free(base), base = NULL;
+	fclose(file);
+#endif
+	if (!base)
+		return NULL;
+
+	memcpy(header, base, sizeof(*header));
+	if (memcmp(header->magic, grid_file_magic, sizeof(header->magic))
+	    || header->byte_order != GRID_FILE_BYTE_ORDER || header->kind != kind
+	    || size < GRID_FILE_ALIGN || header->data_size != size - GRID_FILE_ALIGN) {
+		grid_file_unmap(base + GRID_FILE_ALIGN, size - GRID_FILE_ALIGN);
+		errno = EINVAL;
+		return NULL;
+	}
+	return base + GRID_FILE_ALIGN;
+}
+
+void grid_file_unmap(void *data, size_t data_size)
+{
+	if (data) {
+#ifdef GRID_FILE_MMAP
+		munmap((byte*)data - GRID_FILE_ALIGN, GRID_FILE_ALIGN + data_size);
+#else
+		free((byte*)data - GRID_FILE_ALIGN);
+#endif
+	}
+}
+
+// Returns false, with errno set, when the file can't be written.
+bool Grid_save(const struct Grid *grid, const char *path)
+{
+	struct GridFileHeader header = {
+		.kind = GRID_FILE_GRID,
+		.nrows = grid->nrows, .ncols = grid->ncols,
+		.elem_size = grid->elem_size, .layout = grid->layout,
+		.data_size = (uint64_t)grid->capacity * grid->elem_size };
+	return grid_file_save(path, header, grid->cells);
+}
+
+// NULL, with errno set, when the file can't be mapped or isn't a grid.
+// The struct Grid sits just before the cells, in the private header page.
+struct Grid *Grid_open_mapped(const char *path)
+{
+	struct GridFileHeader header;
+	byte *cells = grid_file_map(path, GRID_FILE_GRID, &header);
+	if (!cells)
+		return NULL;
+
+	struct Grid shape;
+	if (!grid_shape(&shape, header.nrows, header.ncols, header.elem_size, header.layout)
+	    || header.data_size != (uint64_t)shape.capacity * shape.elem_size) {
+		grid_file_unmap(cells, header.data_size);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	struct Grid *grid = (struct Grid*)(cells - offsetof(struct Grid, cells));
+	*grid = shape;
+	return grid;
+}
+
+void Grid_close_mapped(struct Grid *grid)
+{
+	if (grid)
+		grid_file_unmap(grid->cells, (size_t)grid->capacity * grid->elem_size);
+}
+
+//----------------------------------------------------------------------
+// Stencil Engine
+
+// Returns NULL for empty or oversized grids, elements wider than
+// STENCIL_ALIGN, or when out of memory. Both buffers start zeroed.
+struct Stencil *Stencil_create(int nrows, int ncols, int elem_size, enum StencilBorder border)
+{
+	if (nrows < 1 || ncols < 1 || elem_size <= 0 || elem_size > STENCIL_ALIGN)
+		return NULL;
+
+	long long row_bytes = STENCIL_ALIGN + (ncols + 1LL) * elem_size;
+	long long stride = (row_bytes + STENCIL_ALIGN - 1) / STENCIL_ALIGN * STENCIL_ALIGN;
+	if (stride > INT_MAX || (unsigned long long)stride * (nrows + 2ULL) > SIZE_MAX)
+		return NULL;
+	size_t size = (size_t)stride * (nrows + 2);
+
+	struct Stencil *stencil = malloc(sizeof(*stencil));
+	if (!stencil)
+		return NULL;
+	*stencil = (struct Stencil){
+		.nrows = nrows, .ncols = ncols, .elem_size = elem_size,
+		.stride = stride, .border = border,
+		.buffers = { aligned_alloc(STENCIL_ALIGN, size), aligned_alloc(STENCIL_ALIGN, size) },
+	};
+	if (!stencil->buffers[0] || !stencil->buffers[1]) {
+		Stencil_destroy(stencil);
+		return NULL;
+	}
+	memset(stencil->buffers[0], 0, size);
+	memset(stencil->buffers[1], 0, size);
+	return stencil;
+}
+
+static void stencil_pool_destroy(struct StencilPool *pool);
+
+void Stencil_destroy(struct Stencil *stencil)
+{
+	if (stencil) {
+		stencil_pool_destroy(stencil->pool);
+		free(stencil->buffers[0]);
+		free(stencil->buffers[1]);
+		free(stencil);
+	}
+}
+
+static byte *stencil_cell(const struct Stencil *stencil, int buffer, int row, int col)
+{
+	return stencil->buffers[buffer] + (row + 1) * stencil->stride + STENCIL_ALIGN
+	     + col * stencil->elem_size;
+}
+
+// Sets every ghost cell of both buffers.
+void Stencil_set_halo(struct Stencil *stencil, const void *value)
+{
+	int size = stencil->elem_size;
+	for (int buffer = 0; buffer < 2; ++buffer) {
+		for (int col = -1; col <= stencil->ncols; ++col) {
+			memcpy(stencil_cell(stencil, buffer, -1, col), value, size);
+			memcpy(stencil_cell(stencil, buffer, stencil->nrows, col), value, size);
+		}
+		for (int row = 0; row < stencil->nrows; ++row) {
+			memcpy(stencil_cell(stencil, buffer, row, -1), value, size);
+			memcpy(stencil_cell(stencil, buffer, row, stencil->ncols), value, size);
+		}
+	}
+}
+
+// Ghost cells of the current buffer from the opposite edges; the ghost
+// rows are copied last so they pick up the corners.
+static void stencil_wrap_halo(struct Stencil *stencil)
+{
+	int b = stencil->current, size = stencil->elem_size;
+	int last_row = stencil->nrows - 1, last_col = stencil->ncols - 1;
+
+	for (int row = 0; row < stencil->nrows; ++row) {
+		memcpy(stencil_cell(stencil, b, row, -1), stencil_cell(stencil, b, row, last_col), size);
+		memcpy(stencil_cell(stencil, b, row, stencil->ncols), stencil_cell(stencil, b, row, 0), size);
+	}
+
+	size_t row_bytes = (size_t)(stencil->ncols + 2) * size;
+	memcpy(stencil_cell(stencil, b, -1, -1), stencil_cell(stencil, b, last_row, -1), row_bytes);
+	memcpy(stencil_cell(stencil, b, stencil->nrows, -1), stencil_cell(stencil, b, 0, -1), row_bytes);
+}
+
+struct StencilBand
+{
+	struct Stencil *stencil;
+	StencilRowFn fn;
+	void *ctx;
+	int row0, row1;
+};
+
+static int stencil_band(void *arg)
+{
+	struct StencilBand *band = arg;
+	struct Stencil *s = band->stencil;
+	int in = s->current, out = !s->current;
+
+	for (int row = band->row0; row < band->row1; ++row) {
+		const byte *center = stencil_cell(s, in, row, 0);
+		band->fn(stencil_cell(s, out, row, 0),
+		         center - s->stride, center, center + s->stride, s->ncols, band->ctx);
+	}
+	return 0;
+}
+
+// Worker threads kept for the life of a stencil. Worker t runs bands[t];
+// the stepping thread runs bands[0]. Each step bumps generation under the
+// lock, which hands the workers their bands, then waits for pending to
+// reach zero.
+struct StencilWorker
+{
+	struct StencilPool *pool;
+	int index;
+	unsigned long seen;          // last generation this worker ran
+};
+
+struct StencilPool
+{
+	mtx_t lock;
+	cnd_t start, done;
+	unsigned long generation;
+	int nworkers;                // threads started, as workers 1..nworkers
+	int active;                  // workers below this index run this step
+	int pending;                 // active workers still running this step
+	bool quit;
+	struct StencilBand bands[GRID_MAX_THREADS];
+	struct StencilWorker workers[GRID_MAX_THREADS];
+	thrd_t threads[GRID_MAX_THREADS];
+};
+
+static int stencil_worker(void *arg)
+{
+	struct StencilWorker *worker = arg;
+	struct StencilPool *pool = worker->pool;
+
+	mtx_lock(&pool->lock);
+	for (;;) {
+		while (worker->seen == pool->generation && !pool->quit)
+			cnd_wait(&pool->start, &pool->lock);
+		if (pool->quit)
+			break;
+		worker->seen = pool->generation;
+		if (worker->index >= pool->active)
+			continue;
+
+		mtx_unlock(&pool->lock);
+		stencil_band(&pool->bands[worker->index]);
+		mtx_lock(&pool->lock);
+		if (--pool->pending == 0)
+			cnd_signal(&pool->done);
+	}
+	mtx_unlock(&pool->lock);
+	return 0;
+}
+
+static struct StencilPool *stencil_pool_create(void)
+{
+	struct StencilPool *pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	bool locked = mtx_init(&pool->lock, mtx_plain) == thrd_success;
+	bool started = cnd_init(&pool->start) == thrd_success;
+	bool done = cnd_init(&pool->done) == thrd_success;
+	if (locked && started && done)
+		return pool;
+
+	if (locked)   mtx_destroy(&pool->lock);
+	if (started)  cnd_destroy(&pool->start);
+	if (done)     cnd_destroy(&pool->done);
+	free(pool);
+	return NULL;
+}
+
+static void stencil_pool_destroy(struct StencilPool *pool)
+{
+	if (!pool)
+		return;
+
+	mtx_lock(&pool->lock);
+	pool->quit = true;
+	cnd_broadcast(&pool->start);
+	mtx_unlock(&pool->lock);
+
+	for (int t = 1; t <= pool->nworkers; ++t)
+		thrd_join(pool->threads[t], NULL);
+	mtx_destroy(&pool->lock);
+	cnd_destroy(&pool->start);
+	cnd_destroy(&pool->done);
+	free(pool);
+}
+
+// Runs pool->bands[0..n), starting workers up to n-1 as needed. Bands
+// without a worker, when one can't be started, run on this thread.
+static void stencil_pool_run(struct StencilPool *pool, int n)
+{
+	while (pool->nworkers < n - 1) {
+		int t = pool->nworkers + 1;
+		pool->workers[t] = (struct StencilWorker){ pool, t, pool->generation };
+		if (thrd_create(&pool->threads[t], stencil_worker, &pool->workers[t]) != thrd_success)
+			break;
+		pool->nworkers = t;
+	}
+	int helpers = int_min(n - 1, pool->nworkers);
+
+	mtx_lock(&pool->lock);
+	pool->active = helpers + 1;
+	pool->pending = helpers;
+	++pool->generation;
+	cnd_broadcast(&pool->start);
+	mtx_unlock(&pool->lock);
+
+	stencil_band(&pool->bands[0]);
+	for (int t = helpers + 1; t < n; ++t)
+		stencil_band(&pool->bands[t]);
+
+	mtx_lock(&pool->lock);
+	while (pool->pending > 0)
+		cnd_wait(&pool->done, &pool->lock);
+	mtx_unlock(&pool->lock);
+}
+
+// One update of every cell, then the buffers swap.
+void Stencil_step(struct Stencil *stencil, StencilRowFn fn, void *ctx, int nthreads)
+{
+	if (stencil->border == STENCIL_WRAP)
+		stencil_wrap_halo(stencil);
+
+	nthreads = int_max(1, int_min(int_min(nthreads, GRID_MAX_THREADS), stencil->nrows));
+	if (nthreads > 1 && !stencil->pool)
+		stencil->pool = stencil_pool_create();
+
+	struct StencilBand local[1];
+	struct StencilBand *bands = stencil->pool ? stencil->pool->bands : local;
+	if (!stencil->pool)
+		nthreads = 1;
+	for (int t = 0; t < nthreads; ++t)
+		bands[t] = (struct StencilBand){
+			.stencil = stencil, .fn = fn, .ctx = ctx,
+			.row0 = (long long)stencil->nrows * t / nthreads,
+			.row1 = (long long)stencil->nrows * (t + 1) / nthreads };
+
+	if (nthreads > 1)
+		stencil_pool_run(stencil->pool, nthreads);
+	else
+		stencil_band(&bands[0]);
+
+	stencil->current = !stencil->current;
+}
+
+void Stencil_life_row(void *restrict out, const void *above, const void *row,
+                      const void *below, int ncols, void *ctx)
+{
+	unsigned char *restrict o = out;
+	const unsigned char *a = above, *r = row, *b = below;
+	UNUSED(ctx);
+
+	for (int c = 0; c < ncols; ++c) {
+		int n = a[c-1] + a[c] + a[c+1] + r[c-1] + r[c+1] + b[c-1] + b[c] + b[c+1];
+		o[c] = (n == 3) | (r[c] & (n == 2));
+	}
+}
+
+void Stencil_laplacian_row(void *restrict out, const void *above, const void *row,
+                           const void *below, int ncols, void *ctx)
+{
+	double *restrict o = out;
+	const double *a = above, *r = row, *b = below;
+	double alpha = *(const double*)ctx;
+
+	for (int c = 0; c < ncols; ++c)
+		o[c] = r[c] + alpha * (a[c] + b[c] + r[c-1] + r[c+1] - 4.0 * r[c]);
+}
+
+//----------------------------------------------------------------------
+// Grid Sums
+
+enum { GRID_SUMS_ALIGN = 64 };
+
+static bool grid_number_fits(const struct Grid *grid, enum GridNumber type)
+{
+	return grid->elem_size == (type == GRID_INT ? (int)sizeof(int) : (int)sizeof(double));
+}
+
+// Cells of one grid row as a contiguous array: the row itself for
+// GRID_ROW_MAJOR, otherwise gathered into scratch.
+static const void *grid_sums_row(const struct Grid *grid, int row, void *scratch)
+{
+	if (grid->layout == GRID_ROW_MAJOR)
+		return grid->cells + (size_t)row * grid->ncols * grid->elem_size;
+
+	for (int col = 0; col < grid->ncols; ++col)
+		memcpy((byte*)scratch + (size_t)col * grid->elem_size,
+		       grid->cells + (size_t)Grid_offset(grid, row, col) * grid->elem_size, grid->elem_size);
+	return scratch;
+}
+
+// A row of the table from a row of cells and the table row above. The
+// running sum along the row is one dependent chain, so the row above is
+// added in the same pass: a separate, vectorized pass measured slower.
+#define GRID_SUMS_SCAN_ROW(NAME_, T_, SUM_) \
+	static void NAME_(SUM_ *restrict out, const T_ *restrict in, const SUM_ *restrict above, int ncols) \
+	{ \
+		SUM_ sum = 0; \
+		for (int col = 0; col < ncols; ++col) { \
+			sum += in[col]; \
+			out[col + 1] = sum + above[col + 1]; \
+		} \
+	}
+
+GRID_SUMS_SCAN_ROW(grid_sums_scan_int, int, int64_t)
+GRID_SUMS_SCAN_ROW(grid_sums_scan_double, double, double)
+
+#define GRID_SUMS_ADD_ROW(NAME_, SUM_) \
+	static void NAME_(SUM_ *restrict out, const SUM_ *restrict carry, int ncols) \
+	{ \
+		for (int col = 1; col <= ncols; ++col) \
+			out[col] += carry[col]; \
+	}
+
+GRID_SUMS_ADD_ROW(grid_sums_add_int, int64_t)
+GRID_SUMS_ADD_ROW(grid_sums_add_double, double)
+
+struct GridSumsBand
+{
+	struct GridSums *sums;
+	const struct Grid *grid;
+	void *scratch;           // a row of cells, unless the grid is row-major
+	int row0, row1;          // grid rows; table rows row0 + 1 to row1
+	bool carry;              // second pass: add table row row0
+};
+
+// First pass: the band's rows summed as if the band started the grid.
+// Second pass: the total of the bands above added to all but the band's
+// last row, which the calling thread has already completed.
+static int grid_sums_band(void *arg)
+{
+	struct GridSumsBand *band = arg;
+	struct GridSums *s = band->sums;
+	size_t stride = s->stride;
+
+	if (s->type == GRID_INT) {
+		int64_t *table = s->table;
+		for (int row = band->row0; row < band->row1; ++row) {
+			if (band->carry)
+				grid_sums_add_int(table + (row + 1) * stride, table + band->row0 * stride, s->ncols);
+			else
+				grid_sums_scan_int(table + (row + 1) * stride, grid_sums_row(band->grid, row, band->scratch),
+				                   row > band->row0 ? table + row * stride : table, s->ncols);
+		}
+	}
+	else {
+		double *table = s->table;
+		for (int row = band->row0; row < band->row1; ++row) {
+			if (band->carry)
+				grid_sums_add_double(table + (row + 1) * stride, table + band->row0 * stride, s->ncols);
+			else
+				grid_sums_scan_double(table + (row + 1) * stride, grid_sums_row(band->grid, row, band->scratch),
+				                      row > band->row0 ? table + row * stride : table, s->ncols);
+		}
+	}
+	return 0;
+}
+
+// Returns NULL when the grid's cells aren't the size of type, or when
+// out of memory.
+struct GridSums *GridSums_create(const struct Grid *grid, enum GridNumber type, int nthreads)
+{
+	if (!grid_number_fits(grid, type))
+		return NULL;
+
+	nthreads = int_max(1, int_min(int_min(nthreads, GRID_MAX_THREADS), grid->nrows));
+	int per_line = GRID_SUMS_ALIGN / sizeof(int64_t);
+	long long stride = (grid->ncols + 1LL + per_line - 1) / per_line * per_line;
+	if ((unsigned long long)stride * (grid->nrows + 1ULL) > SIZE_MAX / sizeof(int64_t))
+		return NULL;
+	size_t size = (size_t)stride * (grid->nrows + 1) * sizeof(int64_t);
+	size_t scratch_size = (size_t)grid->ncols * grid->elem_size;
+
+	struct GridSums *sums = malloc(sizeof(*sums));
+	if (!sums)
+		return NULL;
+	*sums = (struct GridSums){
+		.nrows = grid->nrows, .ncols = grid->ncols, .type = type,
+		.stride = stride, .table = aligned_alloc(GRID_SUMS_ALIGN, size) };
+	byte *scratch = grid->layout == GRID_ROW_MAJOR ? NULL : malloc(scratch_size * nthreads + 1);
+	if (!sums->table || (grid->layout != GRID_ROW_MAJOR && !scratch)) {
+		free(scratch);
+		GridSums_destroy(sums);
+		return NULL;
+	}
+	memset(sums->table, 0, (size_t)stride * sizeof(int64_t));
+	for (int row = 1; row <= grid->nrows; ++row)
+		memset((int64_t*)sums->table + row * stride, 0, sizeof(int64_t));
+
+	struct GridSumsBand bands[GRID_MAX_THREADS];
+	for (int t = 0; t < nthreads; ++t)
+		bands[t] = (struct GridSumsBand){
+			.sums = sums, .grid = grid,
+			.scratch = scratch ? scratch + t * scratch_size : NULL,
+			.row0 = (long long)grid->nrows * t / nthreads,
+			.row1 = (long long)grid->nrows * (t + 1) / nthreads };
+	grid_run_threads(grid_sums_band, bands, sizeof(bands[0]), nthreads);
+	free(scratch);
+
+	// Complete the last row of each band in turn, from the band above.
+	// Then, in parallel, every other row of a band gets the same row
+	// added, the last of the band above; the first band is done.
+	for (int t = 1; t < nthreads; ++t) {
+		size_t last = (size_t)bands[t].row1 * stride, above = (size_t)bands[t].row0 * stride;
+		if (type == GRID_INT)
+			grid_sums_add_int((int64_t*)sums->table + last, (int64_t*)sums->table + above, grid->ncols);
+		else
+			grid_sums_add_double((double*)sums->table + last, (double*)sums->table + above, grid->ncols);
+	}
+	for (int t = 0; t < nthreads; ++t) {
+		bands[t].carry = true;
+		bands[t].row1 = t == 0 ? bands[t].row0 : bands[t].row1 - 1;
+	}
+	grid_run_threads(grid_sums_band, bands, sizeof(bands[0]), nthreads);
+
+	return sums;
+}
+
+void GridSums_destroy(struct GridSums *sums)
+{
+	if (sums) {
+		free(sums->table);
+		free(sums);
+	}
+}
+
+double GridSums_mean(const struct GridSums *sums, struct GridRect r)
+{
+	r = GridRect_clip(r, sums->nrows, sums->ncols);
+	long long area = (long long)(r.row1 - r.row0) * (r.col1 - r.col0);
+	if (area == 0)
+		return 0.0;
+	double total = sums->type == GRID_INT ? (double)GridSums_rect_int(sums, r) : GridSums_rect_double(sums, r);
+	return total / area;
+}
+
+//----------------------------------------------------------------------
+// Grid Fenwick Tree
+
+// Tree node i covers the i & -i indexes ending at i, on both axes.
+#define GRID_FENWICK_FUNCTIONS(SUFFIX_, TYPE_, T_, SUM_) \
+	static SUM_ grid_fenwick_prefix_##SUFFIX_(const struct GridFenwick *f, int nrows, int ncols) \
+	{ \
+		const SUM_ *tree = f->tree; \
+		SUM_ sum = 0; \
+		for (int i = nrows; i > 0; i -= i & -i) \
+			for (int j = ncols; j > 0; j -= j & -j) \
+				sum += tree[(size_t)i * f->stride + j]; \
+		return sum; \
+	} \
+	\
+	SUM_ GridFenwick_rect_##SUFFIX_(const struct GridFenwick *fenwick, struct GridRect r) \
+	{ \
+		ASSERTION(fenwick->type == TYPE_); \
+		r = GridRect_clip(r, fenwick->nrows, fenwick->ncols); \
+		return grid_fenwick_prefix_##SUFFIX_(fenwick, r.row1, r.col1) \
+		     - grid_fenwick_prefix_##SUFFIX_(fenwick, r.row0, r.col1) \
+		     - grid_fenwick_prefix_##SUFFIX_(fenwick, r.row1, r.col0) \
+		     + grid_fenwick_prefix_##SUFFIX_(fenwick, r.row0, r.col0); \
+	} \
+	\
+	void GridFenwick_add_##SUFFIX_(struct GridFenwick *fenwick, struct GridPos p, SUM_ delta) \
+	{ \
+		if (!ASSERTION(fenwick->type == TYPE_)) \
+			return; \
+		SUM_ *tree = fenwick->tree; \
+		p.row = CHECK_LEN(fenwick->nrows, p.row); \
+		p.col = CHECK_LEN(fenwick->ncols, p.col); \
+		if ((unsigned)p.row >= (unsigned)fenwick->nrows || (unsigned)p.col >= (unsigned)fenwick->ncols) \
+			return;             /* already reported; row 0 would never end the loop */ \
+		for (int i = p.row + 1; i <= fenwick->nrows; i += i & -i) \
+			for (int j = p.col + 1; j <= fenwick->ncols; j += j & -j) \
+				tree[(size_t)i * fenwick->stride + j] += delta; \
+	} \
+	\
+	static void grid_fenwick_build_##SUFFIX_(struct GridFenwick *f, const struct Grid *grid, void *scratch) \
+	{ \
+		SUM_ *tree = f->tree; \
+		for (int i = 1; i <= f->nrows; ++i) { \
+			SUM_ *row = tree + (size_t)i * f->stride; \
+			const void *cells = grid_sums_row(grid, i - 1, scratch); \
+			for (int j = 1; j <= f->ncols; ++j) \
+				row[j] = ((const T_*)cells)[j - 1]; \
+			for (int j = 1; j <= f->ncols; ++j) \
+				if (j + (j & -j) <= f->ncols) \
+					row[j + (j & -j)] += row[j]; \
+		} \
+		for (int i = 1; i <= f->nrows; ++i) { \
+			int parent = i + (i & -i); \
+			if (parent <= f->nrows) \
+				for (int j = 1; j <= f->ncols; ++j) \
+					tree[(size_t)parent * f->stride + j] += tree[(size_t)i * f->stride + j]; \
+		} \
+	}
+
+GRID_FENWICK_FUNCTIONS(int, GRID_INT, int, int64_t)
+GRID_FENWICK_FUNCTIONS(double, GRID_DOUBLE, double, double)
+
+// Built from the grid in time linear in its cells. Returns NULL when the
+// grid's cells aren't the size of type, or when out of memory.
+struct GridFenwick *GridFenwick_create(const struct Grid *grid, enum GridNumber type)
+{
+	if (!grid_number_fits(grid, type))
+		return NULL;
+
+	struct GridFenwick *fenwick = malloc(sizeof(*fenwick));
+	if (!fenwick)
+		return NULL;
+	*fenwick = (struct GridFenwick){
+		.nrows = grid->nrows, .ncols = grid->ncols, .type = type, .stride = grid->ncols + 1,
+		.tree = calloc((size_t)(grid->nrows + 1) * (grid->ncols + 1), sizeof(int64_t)) };
+	void *scratch = grid->layout == GRID_ROW_MAJOR ? NULL : malloc((size_t)grid->ncols * grid->elem_size + 1);
+	if (!fenwick->tree || (grid->layout != GRID_ROW_MAJOR && !scratch)) {
+		free(scratch);
+		GridFenwick_destroy(fenwick);
+		return NULL;
+	}
+
+	if (type == GRID_INT)
+		grid_fenwick_build_int(fenwick, grid, scratch);
+	else
+		grid_fenwick_build_double(fenwick, grid, scratch);
+	free(scratch);
+	return fenwick;
+}
+
+void GridFenwick_destroy(struct GridFenwick *fenwick)
+{
+	if (fenwick) {
+		free(fenwick->tree);
+		free(fenwick);
+	}
+}
@@ -0,0 +1,392 @@
+#ifndef KR_KRGRID_H_INCLUDED
+#define KR_KRGRID_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include "krbase.h"
+
+//----------------------------------------------------------------------
+// Grid
+//
+// Generic dynamic 2D array of elem_size-byte elements. The layout decides
+// where each cell lives in memory:
+//
+//   GRID_ROW_MAJOR  rows one after another; row walks are sequential.
+//   GRID_TILED      GRID_TILE x GRID_TILE blocks, stored row-major; cells
+//                   near each other on either axis usually share a block.
+//   GRID_MORTON     Z-order: row and column bits interleaved, so locality
+//                   holds at every scale. Dimensions are padded up to
+//                   powers of two.
+//
+// Positions outside the grid are reported by Grid_at (through the assert
+// handler) or return NULL from Grid_cell. Negative rows and columns count
+// from the end, as with check_index.
+
+enum GridLayout
+{
+	GRID_ROW_MAJOR,
+	GRID_TILED,
+	GRID_MORTON,
+	GRID_LAYOUT_COUNT
+};
+
+enum { GRID_TILE_SHIFT = 3, GRID_TILE = 1 << GRID_TILE_SHIFT };
+
+struct GridPos  { int row, col; };
+struct GridRect { int row0, col0, row1, col1; };     // [row0,row1) x [col0,col1)
+
+struct Grid
+{
+	int nrows, ncols;
+	int elem_size;
+	enum GridLayout layout;
+	int tile_cols;           // GRID_TILED: blocks per row of blocks
+	int morton_bits;         // GRID_MORTON: interleaved bits per axis
+	int capacity;            // elements allocated, including padding
+	_Alignas(max_align_t) byte cells[];
+};
+
+struct Grid *Grid_create(int nrows, int ncols, int elem_size, enum GridLayout layout);
+void         Grid_destroy(struct Grid *grid);
+void         Grid_fill(struct Grid *grid, const void *value);
+struct Grid *Grid_relayout(const struct Grid *grid, enum GridLayout layout);
+const char  *GridLayout_name(enum GridLayout layout);
+
+// Spread the low 16 bits of x to the even bit positions.
+static inline unsigned grid_spread_bits(unsigned x)
+{
+	x &= 0xFFFF;
+	x = (x | x << 8) & 0x00FF00FF;
+	x = (x | x << 4) & 0x0F0F0F0F;
+	x = (x | x << 2) & 0x33333333;
+	x = (x | x << 1) & 0x55555555;
+	return x;
+}
+
+// Element offset of an in-bounds cell; no checks.
+static inline int Grid_offset(const struct Grid *grid, int row, int col)
+{
+	switch (grid->layout) {
+		case GRID_TILED: {
+			int tile = (row >> GRID_TILE_SHIFT) * grid->tile_cols + (col >> GRID_TILE_SHIFT);
+			return tile << (2 * GRID_TILE_SHIFT)
+			     | (row & (GRID_TILE - 1)) << GRID_TILE_SHIFT
+			     | (col & (GRID_TILE - 1));
+		}
+		case GRID_MORTON: {
+			int k = grid->morton_bits;
+			unsigned low_mask = (1u << k) - 1;
+			unsigned low  = grid_spread_bits(row & low_mask) << 1 | grid_spread_bits(col & low_mask);
+			unsigned high = (unsigned)(row >> k) | (unsigned)(col >> k);
+			return (int)(high << 2 * k | low);
+		}
+		default:
+			return row * grid->ncols + col;
+	}
+}
+
+static inline void *Grid_at_unchecked(struct Grid *grid, int row, int col)
+{
+	return grid->cells + (size_t)Grid_offset(grid, row, col) * grid->elem_size;
+}
+
+static inline void *Grid_at(struct Grid *grid, int row, int col)
+{
+	row = CHECK_LEN(grid->nrows, row);
+	col = CHECK_LEN(grid->ncols, col);
+	return Grid_at_unchecked(grid, row, col);
+}
+
+static inline bool Grid_includes(const struct Grid *grid, struct GridPos p)
+{
+	return 0 <= p.row && p.row < grid->nrows && 0 <= p.col && p.col < grid->ncols;
+}
+
+// NULL when p is outside the grid.
+static inline void *Grid_cell(struct Grid *grid, struct GridPos p)
+{
+	return Grid_includes(grid, p) ? Grid_at_unchecked(grid, p.row, p.col) : NULL;
+}
+
+#define GRID_AT(T_, GRID_, ROW_, COL_)  (*(T_*)Grid_at((GRID_), (ROW_), (COL_)))
+
+static inline int Grid_nrows(const struct Grid *grid)  { return grid->nrows; }
+static inline int Grid_ncols(const struct Grid *grid)  { return grid->ncols; }
+
+// Row r of a GRID_ROW_MAJOR grid as one contiguous span of ncols cells,
+// for loops and memcpy that want a plain array. Tiled and Morton grids
+// scatter a row across blocks, so for them the span is null (p NULL,
+// length 0); walk their rows with GridRowIter instead.
+typedef SPAN(void) GridSpan;
+
+static inline GridSpan Grid_row(struct Grid *grid, int row)
+{
+	row = CHECK_BOUNDARY_LEN(grid->nrows, row);
+	if (grid->layout != GRID_ROW_MAJOR)
+		return (GridSpan){0};
+	return (GridSpan){ .p = Grid_at_unchecked(grid, row, 0), .length = grid->ncols };
+}
+
+// The part of r inside an nrows x ncols grid; all zero when none is.
+static inline struct GridRect GridRect_clip(struct GridRect r, int nrows, int ncols)
+{
+	r.row0 = int_max(r.row0, 0);  r.row1 = int_min(r.row1, nrows);
+	r.col0 = int_max(r.col0, 0);  r.col1 = int_min(r.col1, ncols);
+	if (r.row0 >= r.row1 || r.col0 >= r.col1)
+		r = (struct GridRect){0};
+	return r;
+}
+
+static inline struct GridPos GridPos_above (struct GridPos p)  { --p.row;  return p; }
+static inline struct GridPos GridPos_below (struct GridPos p)  { ++p.row;  return p; }
+static inline struct GridPos GridPos_before(struct GridPos p)  { --p.col;  return p; }
+static inline struct GridPos GridPos_after (struct GridPos p)  { ++p.col;  return p; }
+
+//----------------------------------------------------------------------
+// Grid Files
+//
+// A grid saved by Grid_save is a fixed header followed, at byte
+// GRID_FILE_ALIGN, by the cells exactly as they lie in memory, in the
+// grid's layout. Grid_open_mapped maps such a file and returns a grid
+// that reads its cells straight from the page cache: nothing is parsed
+// or copied, so opening takes the same time for any size. Writes to a
+// mapped grid stay private to the process. Cells are stored in native
+// byte order; a file from a machine of the other byte order is rejected.
+//
+// A mapped grid is released with Grid_close_mapped, not Grid_destroy.
+// Where mmap isn't available the file is read into memory instead.
+//
+// The grid_file functions are the container itself, shared with other
+// kinds of 2D data such as mazes.
+
+enum { GRID_FILE_ALIGN = 4096 };
+
+enum GridFileKind { GRID_FILE_GRID = 1, GRID_FILE_MAZE = 2 };
+
+struct GridFileHeader
+{
+	char     magic[8];       // "KRGRID" and two zeros
+	uint32_t byte_order;     // 0x01020304 as stored by the writer
+	uint32_t kind;           // GridFileKind
+	int32_t  nrows, ncols;
+	int32_t  elem_size;
+	int32_t  layout;
+	uint64_t data_size;      // bytes of data at GRID_FILE_ALIGN
+};
+
+struct Grid *Grid_open_mapped(const char *path);
+void         Grid_close_mapped(struct Grid *grid);
+bool         Grid_save(const struct Grid *grid, const char *path);
+
+bool  grid_file_save(const char *path, struct GridFileHeader header, const void *data);
+void *grid_file_map(const char *path, enum GridFileKind kind, struct GridFileHeader *header);
+void  grid_file_unmap(void *data, size_t data_size);
+
+//----------------------------------------------------------------------
+// Grid Iterators
+//
+// GridRowIter and GridColIter walk one row or column, GridRectIter the
+// cells of a rectangle row by row, and GridTileIter the GRID_TILE-sized
+// blocks covering the grid (clipped at the edges) in storage order for
+// GRID_TILED. Walking tiles, then the cells of each tile, keeps a tiled
+// or Morton grid's accesses within a few cache lines.
+//
+//     ITER_FOREACH(GridTileIter, t, GridTileIter_begin(grid))
+//         ITER_FOREACH(GridRectIter, c, GridRectIter_begin(grid, GridTileIter_get(t)))
+//             visit(GridRectIter_get(c));
+
+typedef struct { struct Grid *grid; int row, col, end; } GridRowIter;
+typedef struct { struct Grid *grid; int row, col, end; } GridColIter;
+typedef struct { struct Grid *grid; struct GridRect rect; int row, col; } GridRectIter;
+typedef struct { const struct Grid *grid; int row, col; } GridTileIter;
+
+static inline GridRowIter GridRowIter_begin(struct Grid *grid, int row)
+{
+	return (GridRowIter){ grid, CHECK_BOUNDARY_LEN(grid->nrows, row), 0, grid->ncols };
+}
+static inline bool  GridRowIter_done(GridRowIter it)  { return it.col >= it.end; }
+static inline void *GridRowIter_get(GridRowIter it)   { return Grid_at_unchecked(it.grid, it.row, it.col); }
+static inline GridRowIter GridRowIter_next(GridRowIter it)  { ++it.col;  return it; }
+
+static inline GridColIter GridColIter_begin(struct Grid *grid, int col)
+{
+	return (GridColIter){ grid, 0, CHECK_BOUNDARY_LEN(grid->ncols, col), grid->nrows };
+}
+static inline bool  GridColIter_done(GridColIter it)  { return it.row >= it.end; }
+static inline void *GridColIter_get(GridColIter it)   { return Grid_at_unchecked(it.grid, it.row, it.col); }
+static inline GridColIter GridColIter_next(GridColIter it)  { ++it.row;  return it; }
+
+// The rectangle is clipped to the grid.
+static inline GridRectIter GridRectIter_begin(struct Grid *grid, struct GridRect r)
+{
+	r = GridRect_clip(r, grid->nrows, grid->ncols);
+	return (GridRectIter){ grid, r, r.row0, r.col0 };
+}
+static inline bool  GridRectIter_done(GridRectIter it)  { return it.row >= it.rect.row1; }
+static inline void *GridRectIter_get(GridRectIter it)   { return Grid_at_unchecked(it.grid, it.row, it.col); }
+static inline struct GridPos GridRectIter_pos(GridRectIter it)  { return (struct GridPos){ it.row, it.col }; }
+static inline GridRectIter GridRectIter_next(GridRectIter it)
+{
+	if (++it.col >= it.rect.col1)
+		it.col = it.rect.col0, ++it.row;
+	return it;
+}
+
+static inline GridTileIter GridTileIter_begin(const struct Grid *grid)
+{
+	return (GridTileIter){ grid, grid->ncols > 0 ? 0 : grid->nrows, 0 };
+}
+static inline bool GridTileIter_done(GridTileIter it)  { return it.row >= it.grid->nrows; }
+static inline struct GridRect GridTileIter_get(GridTileIter it)
+{
+	return (struct GridRect){
+		it.row, it.col,
+		int_min(it.row + GRID_TILE, it.grid->nrows),
+		int_min(it.col + GRID_TILE, it.grid->ncols) };
+}
+static inline GridTileIter GridTileIter_next(GridTileIter it)
+{
+	if ((it.col += GRID_TILE) >= it.grid->ncols)
+		it.col = 0, it.row += GRID_TILE;
+	return it;
+}
+
+//----------------------------------------------------------------------
+// Stencil Engine
+//
+// Repeated whole-grid updates, like cellular automata or diffusion, over
+// two buffers that swap after each step. Every row carries a one-cell
+// ghost border, so a row function can read row[-1] and row[ncols], and
+// the rows above and below, without checks in its inner loop:
+//
+//     void blur(void *restrict out, const void *above, const void *row,
+//               const void *below, int ncols, void *ctx);
+//
+// STENCIL_FIXED keeps the ghost cells at what Stencil_set_halo stored
+// (zero to start). STENCIL_WRAP refreshes them from the opposite edges
+// before each step, making the grid a torus.
+//
+// Stencil_step splits the rows into bands across nthreads threads. The
+// first threaded step starts worker threads that stay with the stencil,
+// waiting between steps, until Stencil_destroy.
+// Buffers are 64-byte aligned and column 0 of every row starts on a
+// 64-byte boundary, so row functions vectorize cleanly.
+
+enum StencilBorder { STENCIL_FIXED, STENCIL_WRAP };
+
+enum { STENCIL_ALIGN = 64 };
+
+typedef void (*StencilRowFn)(void *restrict out, const void *above, const void *row,
+                             const void *below, int ncols, void *ctx);
+
+struct StencilPool;
+
+struct Stencil
+{
+	int nrows, ncols;
+	int elem_size;
+	int stride;                  // bytes from one row to the next
+	enum StencilBorder border;
+	int current;                 // buffers[current] holds the latest state
+	byte *buffers[2];
+	struct StencilPool *pool;    // NULL until the first threaded step
+};
+
+struct Stencil *Stencil_create(int nrows, int ncols, int elem_size, enum StencilBorder border);
+void  Stencil_destroy(struct Stencil *stencil);
+void  Stencil_set_halo(struct Stencil *stencil, const void *value);
+void  Stencil_step(struct Stencil *stencil, StencilRowFn fn, void *ctx, int nthreads);
+
+// Column 0 of row in the current buffer; row may be -1 or nrows for the
+// ghost rows.
+static inline void *Stencil_row(struct Stencil *stencil, int row)
+{
+	return stencil->buffers[stencil->current] + (row + 1) * stencil->stride + STENCIL_ALIGN;
+}
+
+static inline void *Stencil_at(struct Stencil *stencil, int row, int col)
+{
+	row = CHECK_LEN(stencil->nrows, row);
+	col = CHECK_LEN(stencil->ncols, col);
+	return (byte*)Stencil_row(stencil, row) + col * stencil->elem_size;
+}
+
+// Row functions for common stencils. Life cells are unsigned char 0 or 1;
+// the Laplacian step is x += *(double*)ctx * (4-neighbour sum - 4x).
+void Stencil_life_row(void *restrict out, const void *above, const void *row,
+                      const void *below, int ncols, void *ctx);
+void Stencil_laplacian_row(void *restrict out, const void *above, const void *row,
+                           const void *below, int ncols, void *ctx);
+
+//----------------------------------------------------------------------
+// Grid Sums
+//
+// Rectangle sums and means over a grid of int or double in constant
+// time. GridSums is a summed-area table: each entry holds the sum of all
+// cells above and to the left, so a rectangle takes four lookups.
+// GridSums_create reads the grid once, a row at a time, splitting the
+// rows into bands across nthreads threads. Int cells are summed as
+// int64_t, double cells as double.
+//
+// A GridSums is a snapshot of the grid. For cells that keep changing,
+// GridFenwick, a 2D Fenwick tree, takes point updates and answers
+// rectangle sums, each in O(log nrows * log ncols). It doesn't see the
+// grid again after GridFenwick_create; pass it the change of every cell.
+//
+// Rectangles are clipped to the grid. An empty one sums to zero and has
+// a mean of zero.
+
+enum GridNumber { GRID_INT, GRID_DOUBLE };
+
+struct GridSums
+{
+	int nrows, ncols;
+	enum GridNumber type;
+	int stride;              // entries from one row to the next
+	void *table;             // (nrows + 1) rows of int64_t or double; row 0 and column 0 are zero
+};
+
+struct GridSums *GridSums_create(const struct Grid *grid, enum GridNumber type, int nthreads);
+void   GridSums_destroy(struct GridSums *sums);
+double GridSums_mean(const struct GridSums *sums, struct GridRect r);
+
+// Index of the table entries at the corners of a clipped rectangle.
+static inline size_t grid_sums_index(const struct GridSums *sums, int row, int col)
+{
+	return (size_t)row * sums->stride + col;
+}
+
+static inline int64_t GridSums_rect_int(const struct GridSums *sums, struct GridRect r)
+{
+	ASSERTION(sums->type == GRID_INT);
+	r = GridRect_clip(r, sums->nrows, sums->ncols);
+	const int64_t *t = sums->table;
+	return t[grid_sums_index(sums, r.row1, r.col1)] - t[grid_sums_index(sums, r.row0, r.col1)]
+	     - t[grid_sums_index(sums, r.row1, r.col0)] + t[grid_sums_index(sums, r.row0, r.col0)];
+}
+
+static inline double GridSums_rect_double(const struct GridSums *sums, struct GridRect r)
+{
+	ASSERTION(sums->type == GRID_DOUBLE);
+	r = GridRect_clip(r, sums->nrows, sums->ncols);
+	const double *t = sums->table;
+	return t[grid_sums_index(sums, r.row1, r.col1)] - t[grid_sums_index(sums, r.row0, r.col1)]
+	     - t[grid_sums_index(sums, r.row1, r.col0)] + t[grid_sums_index(sums, r.row0, r.col0)];
+}
+
+struct GridFenwick
+{
+	int nrows, ncols;
+	enum GridNumber type;
+	int stride;              // ncols + 1
+	void *tree;              // (nrows + 1) rows of int64_t or double, indexed from 1
+};
+
+struct GridFenwick *GridFenwick_create(const struct Grid *grid, enum GridNumber type);
+void    GridFenwick_destroy(struct GridFenwick *fenwick);
+void    GridFenwick_add_int(struct GridFenwick *fenwick, struct GridPos p, int64_t delta);
+void    GridFenwick_add_double(struct GridFenwick *fenwick, struct GridPos p, double delta);
+int64_t GridFenwick_rect_int(const struct GridFenwick *fenwick, struct GridRect r);
+double  GridFenwick_rect_double(const struct GridFenwick *fenwick, struct GridRect r);
+
+#endif
@@ -0,0 +1,565 @@
+#include "krlog.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <time.h>
+#include <threads.h>
+#include <stdatomic.h>
+
+//----------------------------------------------------------------------
+// Records
+
+enum
+{
+	LOG_MAX_ARGS  = 8,
+	LOG_TEXT_SIZE = 256,     // copied format and %s arguments, or a preformatted message
+	LOG_LINE_MAX  = 1024,
+	LOG_BATCH_SIZE = 64 * 1024,
+};
+
+union LogArg
+{
+	long long          i;
+	unsigned long long u;
+	double             d;
+	const void        *p;
+};
+
+struct LogRecord
+{
+	struct timespec time;
+	struct SourceLocation source;
+	FILE *out;
+	bool formatted;          // text holds the whole message, not a format
+	int nargs;
+	union LogArg args[LOG_MAX_ARGS];
+	char text[LOG_TEXT_SIZE];
+};
+
+// Single-producer, single-consumer ring owned by one logging thread.
+struct LogRing
+{
+	atomic_uint head;        // next slot the owner writes
+	atomic_uint tail;        // next slot the background thread reads
+	atomic_ulong dropped;
+	atomic_bool closed;      // owner thread has exited
+	struct LogRing *next;
+	struct LogRecord slots[LOG_RING_SLOTS];
+};
+
+static struct
+{
+	mtx_t lock;              // guards rings and draining
+	cnd_t wake;              // signalled when records are waiting
+	cnd_t room;              // broadcast when rings have been drained
+	thrd_t thread;
+	bool initialized;
+	atomic_bool running;
+	tss_t ring_key;
+	struct LogOptions options;
+	struct LogRing *rings;
+	unsigned long dropped_closed;
+	char batch[LOG_BATCH_SIZE];
+}
+Log;
+
+KR_THREAD_POINTER(thread_ring, struct LogRing)
+
+//----------------------------------------------------------------------
+// Format Specifications
+
+enum LogLength { LEN_NONE, LEN_HH, LEN_H, LEN_L, LEN_LL, LEN_J, LEN_Z, LEN_T, LEN_BIG_L };
+
+struct LogSpec
+{
+	const char *front, *back;    // '%' through the conversion character
+	bool width_star, prec_star, has_prec;
+	int precision;
+	enum LogLength length;
+	char conv;
+};
+
+// f points at a '%' that does not start "%%".
+static const char *log_parse_spec(const char *f, struct LogSpec *spec)
+{
+	*spec = (struct LogSpec){ .front = f++ };
+
+	while (*f && strchr("-+ #0", *f))
+		++f;
+
+	if (*f == '*')
+		spec->width_star = true, ++f;
+	else while (isdigit((unsigned char)*f))
+		++f;
+
+	if (*f == '.') {
+		spec->has_prec = true;
+		if (*++f == '*')
+			spec->prec_star = true, ++f;
+		else while (isdigit((unsigned char)*f))
+			spec->precision = spec->precision * 10 + (*f++ - '0');
+	}
+
+	switch (*f) {
+		case 'h':  spec->length = (*++f == 'h') ? (++f, LEN_HH) : LEN_H;  break;
+		case 'l':  spec->length = (*++f == 'l') ? (++f, LEN_LL) : LEN_L;  break;
+		case 'j':  spec->length = LEN_J;      ++f;  break;
+		case 'z':  spec->length = LEN_Z;      ++f;  break;
+		case 't':  spec->length = LEN_T;      ++f;  break;
+		case 'L':  spec->length = LEN_BIG_L;  ++f;  break;
+	}
+
+	spec->conv = *f;
+	if (*f)
+		++f;
+	spec->back = f;
+	return f;
+}
+
+// Copy the format, then the arguments it consumes, into the record: the
+// caller's format may be a buffer it reuses as soon as we return. Returns
+// false for anything that can't be replayed later (a format too long to
+// copy, too many arguments, %n, wide strings).
+static bool log_capture(struct LogRecord *rec, const char *format, va_list args)
+{
+	int text_used = 0;
+	while (format[text_used])
+		if (++text_used >= LOG_TEXT_SIZE - 1)
+			return false;
+	memcpy(rec->text, format, ++text_used);
+	rec->nargs = 0;
+
+	for (const char *f = format; *f; ) {
+		if (*f != '%') {
+			++f;
+			continue;
+		}
+		if (f[1] == '%') {
+			f += 2;
+			continue;
+		}
+
+		struct LogSpec spec;
+		f = log_parse_spec(f, &spec);
+		if (rec->nargs + spec.width_star + spec.prec_star + 1 > LOG_MAX_ARGS)
+			return false;
+		if (spec.length == LEN_L && (spec.conv == 's' || spec.conv == 'c'))
+			return false;
+
+		if (spec.width_star)
+			rec->args[rec->nargs++].i = va_arg(args, int);
+		if (spec.prec_star) {
+			spec.precision = va_arg(args, int);
+			spec.has_prec = spec.precision >= 0;
+			rec->args[rec->nargs++].i = spec.precision;
+		}
+
+		union LogArg *arg = &rec->args[rec->nargs++];
+		switch (spec.conv) {
+			case 'd': case 'i':
+				switch (spec.length) {
+					case LEN_L:   arg->i = va_arg(args, long);       break;
+					case LEN_LL:  arg->i = va_arg(args, long long);  break;
+					case LEN_J:   arg->i = va_arg(args, intmax_t);   break;
+					case LEN_Z:
+					case LEN_T:   arg->i = va_arg(args, ptrdiff_t);  break;
+					default:      arg->i = va_arg(args, int);        break;
+				}
+				break;
+
+			case 'u': case 'o': case 'x': case 'X':
+				switch (spec.length) {
+					case LEN_L:   arg->u = va_arg(args, unsigned long);       break;
+					case LEN_LL:  arg->u = va_arg(args, unsigned long long);  break;
+					case LEN_J:   arg->u = va_arg(args, uintmax_t);           break;
+					case LEN_Z:   arg->u = va_arg(args, size_t);              break;
+					case LEN_T:   arg->u = va_arg(args, ptrdiff_t);           break;
+					default:      arg->u = va_arg(args, unsigned);            break;
+				}
+				break;
+
+			case 'c':
+				arg->i = va_arg(args, int);
+				break;
+
+			case 'f': case 'F': case 'e': case 'E':
+			case 'g': case 'G': case 'a': case 'A':
+				arg->d = (spec.length == LEN_BIG_L) ? (double)va_arg(args, long double)
+				                                    : va_arg(args, double);
+				break;
+
+			case 'p':
+				arg->p = va_arg(args, void*);
+				break;
+
+			case 's': {
+				const char *s = const_ptr_and(va_arg(args, const char*), "(null)");
+				int room = LOG_TEXT_SIZE - text_used - 1;
+				if (spec.has_prec)
+					room = int_min(room, spec.precision);
+				int n = 0;
+				while (n < room && s[n])
+					++n;
+				memcpy(rec->text + text_used, s, n);
+				rec->text[text_used + n] = '\0';
+				arg->i = text_used;
+				text_used = int_min(text_used + n + 1, LOG_TEXT_SIZE - 1);
+				break;
+			}
+
+			default:
+				return false;
+		}
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------
+// Rendering
+
+struct LogLine { char *p; int length, size; };
+
+static void line_append(struct LogLine *line, const char *s, int n)
+{
+	n = int_min(n, line->size - 1 - line->length);
+	if (n > 0) {
+		memcpy(line->p + line->length, s, n);
+		line->length += n;
+	}
+}
+
+// Rebuild one conversion without '*': widths and precisions read from the
+// record are written into the spec text.
+static void spec_resolve(const struct LogSpec *spec, const union LogArg **arg, char *out, int size)
+{
+	int n = 0;
+	for (const char *c = spec->front; c < spec->back && n < size - 12; ++c) {
+		if (*c != '*')
+			out[n++] = *c;
+		else if (c[-1] == '.' && (*arg)->i < 0)
+			--n, ++*arg;                // negative precision: as if omitted
+		else
+			n += sprintf(out + n, "%d", (int)(*arg)++->i);
+	}
+	out[n] = '\0';
+}
+
+#define LOG_SNPRINTF(Line_, Fmt_, Val_)  \
+	do{ \
+		char tmp_[LOG_LINE_MAX]; \
+		int n_ = snprintf(tmp_, sizeof(tmp_), (Fmt_), (Val_)); \
+		line_append((Line_), tmp_, int_min(n_, (int)sizeof(tmp_) - 1)); \
+	}while(0)
+
+static void log_render(const struct LogRecord *rec, struct LogLine *line)
+{
+	char prefix[LOG_LINE_MAX];
+	int n = snprintf(prefix, sizeof(prefix), "%s:%d: ", rec->source.file_name, rec->source.line_num);
+	line_append(line, prefix, int_min(n, (int)sizeof(prefix) - 1));
+
+	if (rec->formatted) {
+		line_append(line, rec->text, strlen(rec->text));
+		line_append(line, "\n", 1);
+		return;
+	}
+
+	const union LogArg *arg = rec->args;
+	for (const char *f = rec->text; *f; ) {
+		const char *lit = f;
+		while (*f && *f != '%')
+			++f;
+		line_append(line, lit, f - lit);
+		if (!*f)
+			break;
+		if (f[1] == '%') {
+			line_append(line, "%", 1);
+			f += 2;
+			continue;
+		}
+
+		struct LogSpec spec;
+		f = log_parse_spec(f, &spec);
+		char fmt[48];
+		spec_resolve(&spec, &arg, fmt, sizeof(fmt));
+
+		switch (spec.conv) {
+			case 'd': case 'i':
+				switch (spec.length) {
+					case LEN_L:   LOG_SNPRINTF(line, fmt, (long)arg->i);       break;
+					case LEN_LL:  LOG_SNPRINTF(line, fmt, (long long)arg->i);  break;
+					case LEN_J:   LOG_SNPRINTF(line, fmt, (intmax_t)arg->i);   break;
+					case LEN_Z:
+					case LEN_T:   LOG_SNPRINTF(line, fmt, (ptrdiff_t)arg->i);  break;
+					default:      LOG_SNPRINTF(line, fmt, (int)arg->i);        break;
+				}
+				break;
+
+			case 'u': case 'o': case 'x': case 'X':
+				switch (spec.length) {
+					case LEN_L:   LOG_SNPRINTF(line, fmt, (unsigned long)arg->u);       break;
+					case LEN_LL:  LOG_SNPRINTF(line, fmt, (unsigned long long)arg->u);  break;
+					case LEN_J:   LOG_SNPRINTF(line, fmt, (uintmax_t)arg->u);           break;
+					case LEN_Z:   LOG_SNPRINTF(line, fmt, (size_t)arg->u);              break;
+					case LEN_T:   LOG_SNPRINTF(line, fmt, (ptrdiff_t)arg->u);           break;
+					default:      LOG_SNPRINTF(line, fmt, (unsigned)arg->u);            break;
+				}
+				break;
+
+			case 'c':
+				LOG_SNPRINTF(line, fmt, (int)arg->i);
+				break;
+
+			case 'p':
+				LOG_SNPRINTF(line, fmt, arg->p);
+				break;
+
+			case 's':
+				LOG_SNPRINTF(line, fmt, rec->text + arg->i);
+				break;
+
+			default:
+				if (spec.length == LEN_BIG_L)
+					LOG_SNPRINTF(line, fmt, (long double)arg->d);
+				else
+					LOG_SNPRINTF(line, fmt, arg->d);
+				break;
+		}
+		++arg;
+	}
+	line_append(line, "\n", 1);
+}
+
+//----------------------------------------------------------------------
+// Background Thread
+
+static bool time_before(struct timespec a, struct timespec b)
+{
+	return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+static void batch_write(FILE *out, int length)
+{
+	if (out && length)
+		fwrite(Log.batch, 1, length, out);
+}
+
+// Merge every ring's pending records by timestamp and write them out,
+// batching consecutive lines bound for the same stream. Log.lock held.
+static void log_drain(void)
+{
+	FILE *out = NULL;
+	int length = 0;
+
+	for (;;) {
+		struct LogRing *next = NULL;
+		struct LogRecord *rec = NULL;
+		for (struct LogRing *r = Log.rings; r; r = r->next) {
+			unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+			if (tail == atomic_load_explicit(&r->head, memory_order_acquire))
+				continue;
+			struct LogRecord *candidate = &r->slots[tail % LOG_RING_SLOTS];
+			if (!rec || time_before(candidate->time, rec->time))
+				next = r, rec = candidate;
+		}
+		if (!rec)
+			break;
+
+		FILE *rec_out = ptr_and(rec->out, stderr);
+		if (rec_out != out || length > LOG_BATCH_SIZE - LOG_LINE_MAX) {
+			batch_write(out, length);
+			out = rec_out;
+			length = 0;
+		}
+
+		struct LogLine line = { Log.batch + length, 0, LOG_LINE_MAX };
+		log_render(rec, &line);
+		length += line.length;
+
+		atomic_store_explicit(&next->tail,
+			atomic_load_explicit(&next->tail, memory_order_relaxed) + 1,
+			memory_order_release);
+	}
+
+	batch_write(out, length);
+	if (out)
+		fflush(out);
+	cnd_broadcast(&Log.room);
+
+	// Free rings whose threads have exited and which are now empty.
+	for (struct LogRing **r = &Log.rings; *r; ) {
+		struct LogRing *ring = *r;
+		if (atomic_load(&ring->closed) && atomic_load(&ring->tail) == atomic_load(&ring->head)) {
+			Log.dropped_closed += atomic_load(&ring->dropped);
+			*r = ring->next;
+			free(ring);
+		}
+		else
+			r = &ring->next;
+	}
+}
+
+static int log_thread(void *unused)
+{
+	UNUSED(unused);
+	mtx_lock(&Log.lock);
+	while (atomic_load(&Log.running)) {
+		log_drain();
+
+		struct timespec until;
+		timespec_get(&until, TIME_UTC);
+		long ns = until.tv_nsec + Log.options.flush_ms * 1000000L;
+		until.tv_sec  += ns / 1000000000L;
+		until.tv_nsec  = ns % 1000000000L;
+		cnd_timedwait(&Log.wake, &Log.lock, &until);
+	}
+	log_drain();
+	mtx_unlock(&Log.lock);
+	return 0;
+}
+
+//----------------------------------------------------------------------
+// Logging Threads
+
+static void ring_release(void *ring)
+{
+	atomic_store(&((struct LogRing*)ring)->closed, true);
+}
+
+static struct LogRing *ring_acquire(void)
+{
+	struct LogRing *ring = thread_ring_get();
+	if (ring)
+		return ring;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return NULL;
+
+	mtx_lock(&Log.lock);
+	ring->next = Log.rings;
+	Log.rings = ring;
+	mtx_unlock(&Log.lock);
+
+	tss_set(Log.ring_key, ring);
+	thread_ring_set(ring);
+	return ring;
+}
+
+static void log_vprint(FILE *out, struct SourceLocation source, const char *format, va_list args)
+{
+	struct LogRing *ring = ring_acquire();
+	if (!ring) {
+		debug_vwrite(out, source, format, args);
+		return;
+	}
+
+	// Tails only advance under Log.lock, so a full ring checked under the
+	// lock can't miss the broadcast that follows a drain.
+	unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= LOG_RING_SLOTS) {
+		bool full = true;
+		if (Log.options.policy == LOG_BLOCK) {
+			mtx_lock(&Log.lock);
+			while ((full = head - atomic_load(&ring->tail) >= LOG_RING_SLOTS) && atomic_load(&Log.running)) {
+				cnd_signal(&Log.wake);
+				cnd_wait(&Log.room, &Log.lock);
+			}
+			mtx_unlock(&Log.lock);
+		}
+		if (full) {
+			atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+			return;
+		}
+	}
+
+	struct LogRecord *rec = &ring->slots[head % LOG_RING_SLOTS];
+	timespec_get(&rec->time, TIME_UTC);
+	rec->source = source;
+	rec->out    = out;
+	rec->formatted = true;
+
+	va_list copy;
+	va_copy(copy, args);
+	if (!format)
+		rec->text[0] = '\0';
+	else if (log_capture(rec, format, copy))
+		rec->formatted = false;
+	else
+		vsnprintf(rec->text, sizeof(rec->text), format, args);
+	va_end(copy);
+
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+//----------------------------------------------------------------------
+// Control
+
+bool Log_start(struct LogOptions options)
+{
+	if (!Log.initialized) {
+		if (mtx_init(&Log.lock, mtx_plain) != thrd_success
+		    || cnd_init(&Log.wake) != thrd_success
+		    || cnd_init(&Log.room) != thrd_success
+		    || tss_create(&Log.ring_key, ring_release) != thrd_success)
+			return false;
+		Log.initialized = true;
+	}
+
+	if (atomic_load(&Log.running))
+		return true;
+
+	Log.options = options;
+	if (Log.options.flush_ms <= 0)
+		Log.options.flush_ms = 10;
+
+	atomic_store(&Log.running, true);
+	if (thrd_create(&Log.thread, log_thread, NULL) != thrd_success) {
+		atomic_store(&Log.running, false);
+		return false;
+	}
+
+	debug_set_writer(log_vprint);
+	return true;
+}
+
+// Restores direct writing, then drains every ring before returning.
+void Log_stop(void)
+{
+	if (!atomic_load(&Log.running))
+		return;
+
+	debug_set_writer(NULL);
+
+	mtx_lock(&Log.lock);
+	atomic_store(&Log.running, false);
+	cnd_signal(&Log.wake);
+	mtx_unlock(&Log.lock);
+
+	thrd_join(Log.thread, NULL);
+}
+
+// Write out everything logged so far, on the calling thread.
+void Log_flush(void)
+{
+	if (!atomic_load(&Log.running))
+		return;
+
+	mtx_lock(&Log.lock);
+	log_drain();
+	mtx_unlock(&Log.lock);
+}
+
+// Counts every ring, including those of threads that have exited and
+// rings left behind by Log_stop.
+unsigned long Log_dropped(void)
+{
+	if (!Log.initialized)
+		return 0;
+
+	mtx_lock(&Log.lock);
+	unsigned long dropped = Log.dropped_closed;
+	for (struct LogRing *r = Log.rings; r; r = r->next)
+		dropped += atomic_load(&r->dropped);
+	mtx_unlock(&Log.lock);
+	return dropped;
+}
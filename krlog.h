@@ -0,0 +1,37 @@
+#ifndef KR_KRLOG_H_INCLUDED
+#define KR_KRLOG_H_INCLUDED
+
+#include "krbase.h"
+
+//----------------------------------------------------------------------
+// Asynchronous Log
+//
+// While started, debug_print and debug_vprint no longer format on the
+// calling thread. Each thread copies the format and its arguments into a
+// compact record in its own lock-free ring; a background thread formats
+// records from all rings in timestamp order and writes them in batches.
+// Formats and %s arguments may live in buffers the caller reuses at once.
+//
+// Start and stop the log from one thread, before worker threads begin
+// logging and after they finish.
+
+enum { LOG_RING_SLOTS = 1024 };
+
+enum LogPolicy
+{
+	LOG_DROP,       // discard the record and count it when the ring is full
+	LOG_BLOCK,      // wait for the background thread to make room
+};
+
+struct LogOptions
+{
+	enum LogPolicy policy;
+	int flush_ms;   // background thread wakes this often; 0 uses 10 ms
+};
+
+bool Log_start(struct LogOptions options);
+void Log_stop(void);
+void Log_flush(void);
+unsigned long Log_dropped(void);
+
+#endif
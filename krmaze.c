@@ -0,0 +1,1140 @@
+#include "krmaze.h"
+#include "krclib.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <threads.h>
+
+//----------------------------------------------------------------------
+// Maze
+
+// Bytes Maze_create allocates for the maze, or 0 when it is too large.
+size_t Maze_size(int nrows, int ncols)
+{
+	if (nrows < 1 || ncols < 1)
+		return 0;
+	size_t row_words = ((size_t)ncols + MAZE_CELLS_PER_WORD - 1) / MAZE_CELLS_PER_WORD;
+	if ((size_t)nrows > (SIZE_MAX - sizeof(struct Maze)) / sizeof(uint64_t) / row_words)
+		return 0;
+	return sizeof(struct Maze) + (size_t)nrows * row_words * sizeof(uint64_t);
+}
+
+// Every wall starts closed. Returns NULL for empty or oversized mazes, or
+// when out of memory.
+struct Maze *Maze_create(int nrows, int ncols)
+{
+	size_t size = Maze_size(nrows, ncols);
+	if (!size)
+		return NULL;
+
+	struct Maze *maze = calloc(1, size);
+	if (maze)
+		*maze = (struct Maze){
+			.nrows = nrows, .ncols = ncols,
+			.row_words = (ncols + MAZE_CELLS_PER_WORD - 1) / MAZE_CELLS_PER_WORD };
+	return maze;
+}
+
+void Maze_destroy(struct Maze *maze)
+{
+	free(maze);
+}
+
+// Closes every wall.
+void Maze_clear(struct Maze *maze)
+{
+	memset(maze->bits, 0, (size_t)maze->nrows * maze->row_words * sizeof(uint64_t));
+}
+
+static size_t maze_bits_size(const struct Maze *maze)
+{
+	return (size_t)maze->nrows * maze->row_words * sizeof(uint64_t);
+}
+
+// Returns false, with errno set, when the file can't be written.
+bool Maze_save(const struct Maze *maze, const char *path)
+{
+	struct GridFileHeader header = {
+		.kind = GRID_FILE_MAZE,
+		.nrows = maze->nrows, .ncols = maze->ncols,
+		.elem_size = sizeof(uint64_t),
+		.data_size = maze_bits_size(maze) };
+	return grid_file_save(path, header, maze->bits);
+}
+
+// NULL, with errno set, when the file can't be mapped or isn't a maze.
+struct Maze *Maze_open_mapped(const char *path)
+{
+	struct GridFileHeader header;
+	byte *bits = grid_file_map(path, GRID_FILE_MAZE, &header);
+	if (!bits)
+		return NULL;
+
+	size_t size = Maze_size(header.nrows, header.ncols);
+	if (!size || header.elem_size != sizeof(uint64_t) || header.data_size != size - sizeof(struct Maze)) {
+		grid_file_unmap(bits, header.data_size);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	struct Maze *maze = (struct Maze*)(bits - offsetof(struct Maze, bits));
+	*maze = (struct Maze){
+		.nrows = header.nrows, .ncols = header.ncols,
+		.row_words = (header.ncols + MAZE_CELLS_PER_WORD - 1) / MAZE_CELLS_PER_WORD };
+	return maze;
+}
+
+void Maze_close_mapped(struct Maze *maze)
+{
+	if (maze)
+		grid_file_unmap(maze->bits, maze_bits_size(maze));
+}
+
+static bool maze_includes(const struct Maze *maze, struct GridPos p)
+{
+	return 0 <= p.row && p.row < maze->nrows && 0 <= p.col && p.col < maze->ncols;
+}
+
+// Opens the wall between a and b. Returns false, changing nothing, unless
+// both are inside the maze and share a wall.
+bool Maze_link(struct Maze *maze, struct GridPos a, struct GridPos b)
+{
+	if (!maze_includes(maze, a) || !maze_includes(maze, b))
+		return false;
+
+	if (a.row > b.row || (a.row == b.row && a.col > b.col)) {
+		struct GridPos t = a;
+		a = b, b = t;
+	}
+	if (a.row == b.row && a.col + 1 == b.col)
+		Maze_open_pair(maze, a.row, a.col, 1);
+	else if (a.col == b.col && a.row + 1 == b.row)
+		Maze_open_pair(maze, a.row, a.col, 2);
+	else
+		return false;
+	return true;
+}
+
+//----------------------------------------------------------------------
+// Linked Maze Cells
+
+// NULL when the grid can't be allocated.
+struct Grid *MazeCell_grid_create(int nrows, int ncols)
+{
+	struct Grid *cells = Grid_create(nrows, ncols, sizeof(struct MazeCell), GRID_ROW_MAJOR);
+	if (!cells)
+		return NULL;
+
+	for (struct GridPos pos = {0,0};  pos.row < nrows;  ++pos.row)
+		for (pos.col = 0; pos.col < ncols; ++pos.col)
+			GRID_AT(struct MazeCell, cells, pos.row, pos.col) = (struct MazeCell){ .pos = pos };
+	return cells;
+}
+
+void MazeCell_link(struct MazeCell *a, struct MazeCell *b)
+{
+	int drow = a->pos.row - b->pos.row, dcol = a->pos.col - b->pos.col;
+	if      (drow ==  1 && dcol == 0)  a->north = b, b->south = a;
+	else if (drow == -1 && dcol == 0)  a->south = b, b->north = a;
+	else if (drow == 0 && dcol ==  1)  a->west  = b, b->east  = a;
+	else if (drow == 0 && dcol == -1)  a->east  = b, b->west  = a;
+}
+
+// A packed copy of the cells' passages; NULL when out of memory.
+struct Maze *Maze_pack(struct Grid *cells)
+{
+	struct Maze *packed = Maze_create(cells->nrows, cells->ncols);
+	if (!packed)
+		return NULL;
+
+	for (int row = 0; row < packed->nrows; ++row)
+		ITER_FOREACH(GridRowIter, it, GridRowIter_begin(cells, row))
+		{
+			struct MazeCell *cell = GridRowIter_get(it);
+			if (cell->east)   Maze_link(packed, cell->pos, cell->east->pos);
+			if (cell->south)  Maze_link(packed, cell->pos, cell->south->pos);
+		}
+	return packed;
+}
+
+//----------------------------------------------------------------------
+// Maze Stream
+//
+// Sets are labelled by the column of their root. At the start of a row,
+// each cell with a passage from above joins the first cell of this row
+// carrying the same label; the rest start sets of their own.
+
+struct MazeStream
+{
+	int nrows, ncols, row;
+	int row_words;
+	struct MazeRandom random;
+	uint64_t *rows[2];       // packed rows, alternating
+	int *parent;             // disjoint-set forest over this row's columns
+	int *label;              // root of each column in the previous row
+	int *first;              // first column in this row holding a label
+	int *remaining;          // cells of each set not yet given a way down
+	bool *has_down;          // set already has a passage south
+};
+
+struct MazeStream *MazeStream_create(int nrows, int ncols, uint64_t seed)
+{
+	if (nrows < 1 || ncols < 1 || (size_t)ncols > SIZE_MAX / 32)
+		return NULL;
+
+	struct MazeStream *s = malloc(sizeof(*s));
+	if (!s)
+		return NULL;
+
+	int row_words = (ncols + MAZE_CELLS_PER_WORD - 1) / MAZE_CELLS_PER_WORD;
+	*s = (struct MazeStream){
+		.nrows = nrows, .ncols = ncols, .row_words = row_words,
+		.random = MazeRandom_seed(seed),
+		.rows = { calloc(row_words, sizeof(uint64_t)), calloc(row_words, sizeof(uint64_t)) },
+		.parent    = malloc(ncols * sizeof(int)),
+		.label     = malloc(ncols * sizeof(int)),
+		.first     = malloc(ncols * sizeof(int)),
+		.remaining = malloc(ncols * sizeof(int)),
+		.has_down  = malloc(ncols * sizeof(bool)),
+	};
+	if (!s->rows[0] || !s->rows[1] || !s->parent || !s->label || !s->first
+	    || !s->remaining || !s->has_down) {
+		MazeStream_destroy(s);
+		return NULL;
+	}
+	return s;
+}
+
+void MazeStream_destroy(struct MazeStream *s)
+{
+	if (s) {
+		free(s->rows[0]);
+		free(s->rows[1]);
+		free(s->parent);
+		free(s->label);
+		free(s->first);
+		free(s->remaining);
+		free(s->has_down);
+		free(s);
+	}
+}
+
+// Bytes MazeStream_create allocates for a stream ncols wide.
+static size_t maze_stream_size(int ncols)
+{
+	size_t row_words = ((size_t)ncols + MAZE_CELLS_PER_WORD - 1) / MAZE_CELLS_PER_WORD;
+	return sizeof(struct MazeStream) + 2 * row_words * sizeof(uint64_t)
+	     + (size_t)ncols * (4 * sizeof(int) + sizeof(bool));
+}
+
+bool MazeStream_done(const struct MazeStream *s)
+{
+	return s->row >= s->nrows;
+}
+
+static int maze_find(int *parent, int c)
+{
+	while (parent[c] != c)
+		c = parent[c] = parent[parent[c]];
+	return c;
+}
+
+// The next row of the maze. Must not be called once the stream is done.
+struct MazeRow MazeStream_next(struct MazeStream *s)
+{
+	ASSERTION(!MazeStream_done(s));
+
+	int ncols = s->ncols;
+	int *parent = s->parent;
+	bool last = s->row == s->nrows - 1;
+	const uint64_t *above = s->row > 0 ? s->rows[!(s->row & 1)] : NULL;
+	uint64_t *pairs = s->rows[s->row & 1];
+	memset(pairs, 0, s->row_words * sizeof(uint64_t));
+
+	for (int c = 0; c < ncols; ++c)
+		parent[c] = c, s->first[c] = -1;
+	if (above)
+		for (int c = 0; c < ncols; ++c)
+			if (maze_row_pair(above, c) & 2) {
+				int *first = &s->first[s->label[c]];
+				if (*first < 0)
+					*first = c;
+				else
+					parent[c] = *first;
+			}
+
+	// Join neighbours in different sets: at random, or all on the last row.
+	for (int c = 0; c + 1 < ncols; ++c) {
+		int a = maze_find(parent, c), b = maze_find(parent, c + 1);
+		if (a != b && (last || MazeRandom_bit(&s->random))) {
+			parent[b] = a;
+			maze_row_open(pairs, c, 1);
+		}
+	}
+
+	// Give every set at least one passage south, the rest at random.
+	if (!last) {
+		for (int c = 0; c < ncols; ++c)
+			s->remaining[c] = 0, s->has_down[c] = false;
+		for (int c = 0; c < ncols; ++c)
+			++s->remaining[s->label[c] = maze_find(parent, c)];
+		for (int c = 0; c < ncols; ++c) {
+			int root = s->label[c];
+			bool only_chance = --s->remaining[root] == 0 && !s->has_down[root];
+			if (only_chance || MazeRandom_bit(&s->random)) {
+				s->has_down[root] = true;
+				maze_row_open(pairs, c, 2);
+			}
+		}
+	}
+
+	return (struct MazeRow){ s->row++, ncols, above, pairs };
+}
+
+//----------------------------------------------------------------------
+// Maze Generators
+//
+// Cells are numbered row by row, i = row * ncols + col, so the per-cell
+// arrays are flat and a cell's neighbours are i - ncols, i + ncols,
+// i + 1 and i - 1.
+
+static const enum MazeDir maze_dirs[4] = { MAZE_NORTH, MAZE_SOUTH, MAZE_EAST, MAZE_WEST };
+
+static size_t maze_bitmap_size(size_t n)
+{
+	return (n + 63) / 64 * sizeof(uint64_t);
+}
+
+static inline bool maze_bit(const uint64_t *bits, int i)  { return bits[i / 64] >> i % 64 & 1; }
+static inline void maze_set_bit(uint64_t *bits, int i)    { bits[i / 64] |= (uint64_t)1 << i % 64; }
+
+// Opens the wall on side dir of an in-bounds cell; no checks.
+static void maze_open_side(struct Maze *maze, int row, int col, enum MazeDir dir)
+{
+	switch (dir) {
+		case MAZE_NORTH:  Maze_open_pair(maze, row - 1, col, 2);  break;
+		case MAZE_SOUTH:  Maze_open_pair(maze, row, col, 2);      break;
+		case MAZE_EAST:   Maze_open_pair(maze, row, col, 1);      break;
+		case MAZE_WEST:   Maze_open_pair(maze, row, col - 1, 1);  break;
+	}
+}
+
+// Sides of cell i, as indexes into maze_dirs, that lead to another cell.
+static int maze_sides(const struct Maze *maze, int row, int col, int sides[4])
+{
+	int n = 0;
+	if (row > 0)                sides[n++] = 0;
+	if (row < maze->nrows - 1)  sides[n++] = 1;
+	if (col < maze->ncols - 1)  sides[n++] = 2;
+	if (col > 0)                sides[n++] = 3;
+	return n;
+}
+
+static int maze_step(const struct Maze *maze, int i, int side)
+{
+	static const int rows[4] = { -1, 1, 0, 0 }, cols[4] = { 0, 0, 1, -1 };
+	return i + rows[side] * maze->ncols + cols[side];
+}
+
+static bool maze_binary_tree(struct Maze *maze, struct MazeRandom *random)
+{
+	for (int col = 1; col < maze->ncols; ++col)
+		Maze_open_pair(maze, 0, col - 1, 1);
+
+	for (int row = 1; row < maze->nrows; ++row) {
+		Maze_open_pair(maze, row - 1, 0, 2);
+		for (int col = 1; col < maze->ncols; ++col)
+			if (MazeRandom_bit(random))
+				Maze_open_pair(maze, row - 1, col, 2);
+			else
+				Maze_open_pair(maze, row, col - 1, 1);
+	}
+	return true;
+}
+
+static bool maze_sidewinder(struct Maze *maze, struct MazeRandom *random)
+{
+	for (int col = 1; col < maze->ncols; ++col)
+		Maze_open_pair(maze, 0, col - 1, 1);
+
+	for (int row = 1; row < maze->nrows; ++row)
+		for (int start = 0, col = 0; col < maze->ncols; ++col)
+			if (col == maze->ncols - 1 || MazeRandom_bit(random)) {
+				int up = start + MazeRandom_below(random, col - start + 1);
+				Maze_open_pair(maze, row - 1, up, 2);
+				start = col + 1;
+			}
+			else
+				Maze_open_pair(maze, row, col, 1);
+	return true;
+}
+
+static bool maze_backtracker(struct Maze *maze, struct MazeRandom *random)
+{
+	int ncols = maze->ncols, cells = maze->nrows * ncols;
+	uint64_t *visited = calloc(1, maze_bitmap_size(cells));
+	int *stack = malloc(cells * sizeof(int));
+	if (!visited || !stack) {
+		free(visited), free(stack);
+		return false;
+	}
+
+	int depth = 0;
+	stack[depth++] = MazeRandom_below(random, cells);
+	maze_set_bit(visited, stack[0]);
+
+	while (depth > 0) {
+		int i = stack[depth - 1], row = i / ncols, col = i % ncols;
+		int sides[4], open[4], n = 0;
+		for (int k = 0, m = maze_sides(maze, row, col, sides); k < m; ++k)
+			if (!maze_bit(visited, maze_step(maze, i, sides[k])))
+				open[n++] = sides[k];
+
+		if (n == 0) {
+			--depth;
+			continue;
+		}
+		int side = open[n == 1 ? 0 : MazeRandom_below(random, n)];
+		int next = maze_step(maze, i, side);
+		maze_open_side(maze, row, col, maze_dirs[side]);
+		maze_set_bit(visited, next);
+		stack[depth++] = next;
+	}
+
+	free(visited), free(stack);
+	return true;
+}
+
+// Walks at random from each cell not yet in the maze until it meets the
+// maze, remembering only the last way out of every cell visited, so the
+// walk's loops erase themselves. The walk is then retraced and joined.
+static bool maze_wilson(struct Maze *maze, struct MazeRandom *random)
+{
+	int ncols = maze->ncols, cells = maze->nrows * ncols;
+	uint64_t *in_maze = calloc(1, maze_bitmap_size(cells));
+	unsigned char *exit_side = malloc(cells);
+	if (!in_maze || !exit_side) {
+		free(in_maze), free(exit_side);
+		return false;
+	}
+
+	maze_set_bit(in_maze, MazeRandom_below(random, cells));
+	for (int start = 0; start < cells; ++start) {
+		int i = start, sides[4];
+		while (!maze_bit(in_maze, i)) {
+			int n = maze_sides(maze, i / ncols, i % ncols, sides);
+			exit_side[i] = sides[MazeRandom_below(random, n)];
+			i = maze_step(maze, i, exit_side[i]);
+		}
+		for (i = start; !maze_bit(in_maze, i); i = maze_step(maze, i, exit_side[i])) {
+			maze_set_bit(in_maze, i);
+			maze_open_side(maze, i / ncols, i % ncols, maze_dirs[exit_side[i]]);
+		}
+	}
+
+	free(in_maze), free(exit_side);
+	return true;
+}
+
+// Root of cell i in a union-find where each root holds minus its set's
+// size; joining the smaller set under the larger keeps the trees
+// shallow, so few lookups miss the cache.
+static int maze_root(int *parent, int i)
+{
+	int root = i;
+	while (parent[root] >= 0)
+		root = parent[root];
+	while (parent[i] >= 0) {
+		int next = parent[i];
+		parent[i] = root, i = next;
+	}
+	return root;
+}
+
+enum { MAZE_LOOKAHEAD = 16 };
+
+// Walls are numbered 2*i for the east wall of cell i and 2*i+1 for its
+// south wall. The walls' cells are fetched MAZE_LOOKAHEAD walls early,
+// overlapping the cache misses of the random order.
+static bool maze_kruskal(struct Maze *maze, struct MazeRandom *random)
+{
+	int nrows = maze->nrows, ncols = maze->ncols, cells = nrows * ncols;
+	size_t nwalls = 2 * (size_t)cells - nrows - ncols;
+	uint32_t *walls = malloc((nwalls ? nwalls : 1) * sizeof(uint32_t));
+	int *parent = malloc(cells * sizeof(int));
+	if (!walls || !parent) {
+		free(walls), free(parent);
+		return false;
+	}
+
+	size_t n = 0;
+	for (int i = 0; i < cells; ++i) {
+		parent[i] = -1;
+		if (i % ncols < ncols - 1)  walls[n++] = 2 * (uint32_t)i;
+		if (i < cells - ncols)      walls[n++] = 2 * (uint32_t)i + 1;
+	}
+	for (size_t k = n; k > 1; --k) {
+		size_t j = MazeRandom_below(random, k);
+		uint32_t t = walls[k - 1];
+		walls[k - 1] = walls[j], walls[j] = t;
+	}
+
+	for (size_t k = 0, joined = 1; k < n && joined < (size_t)cells; ++k) {
+		if (k + MAZE_LOOKAHEAD < n) {
+			int ahead = walls[k + MAZE_LOOKAHEAD] / 2;
+			KR_PREFETCH(&parent[ahead]);
+			KR_PREFETCH(&parent[ahead + ncols]);
+		}
+		int i = walls[k] / 2, south = walls[k] & 1;
+		int a = maze_root(parent, i), b = maze_root(parent, i + (south ? ncols : 1));
+		if (a != b) {
+			if (parent[a] > parent[b]) {
+				int t = a;
+				a = b, b = t;
+			}
+			parent[a] += parent[b], parent[b] = a, ++joined;
+			Maze_open_pair(maze, i / ncols, i % ncols, south ? 2 : 1);
+		}
+	}
+
+	free(walls), free(parent);
+	return true;
+}
+
+static bool maze_eller(struct Maze *maze, uint64_t seed)
+{
+	struct MazeStream *stream = MazeStream_create(maze->nrows, maze->ncols, seed);
+	if (!stream)
+		return false;
+
+	for (int row = 0; !MazeStream_done(stream); ++row)
+		memcpy(maze->bits + (size_t)row * maze->row_words, MazeStream_next(stream).pairs,
+		       maze->row_words * sizeof(uint64_t));
+	MazeStream_destroy(stream);
+	return true;
+}
+
+static bool maze_indexable(const struct Maze *maze)
+{
+	return (long long)maze->nrows * maze->ncols <= MAZE_MAX_CELLS;
+}
+
+// Replaces the maze's passages with a new maze. Returns false for mazes
+// over MAZE_MAX_CELLS cells or when out of memory, leaving every wall
+// closed.
+bool Maze_generate(struct Maze *maze, enum MazeAlgorithm algorithm, uint64_t seed)
+{
+	Maze_clear(maze);
+	if (!maze_indexable(maze))
+		return false;
+
+	struct MazeRandom random = MazeRandom_seed(seed);
+	bool ok = false;
+	switch (algorithm) {
+		case MAZE_BINARY_TREE:  ok = maze_binary_tree(maze, &random);  break;
+		case MAZE_SIDEWINDER:   ok = maze_sidewinder(maze, &random);   break;
+		case MAZE_BACKTRACKER:  ok = maze_backtracker(maze, &random);  break;
+		case MAZE_WILSON:       ok = maze_wilson(maze, &random);       break;
+		case MAZE_KRUSKAL:      ok = maze_kruskal(maze, &random);      break;
+		case MAZE_ELLER:        ok = maze_eller(maze, seed);           break;
+		default:                break;
+	}
+	if (!ok)
+		Maze_clear(maze);
+	return ok;
+}
+
+//----------------------------------------------------------------------
+// Tiled Generation
+
+enum { MAZE_MAX_THREADS = 64 };
+
+struct MazeTiles
+{
+	struct Maze *maze;
+	enum MazeAlgorithm algorithm;
+	uint64_t seed;
+	int tile_rows, tile_cols;
+	int across, down;        // tiles per row and per column
+	atomic_int next;         // next tile to generate
+	atomic_bool failed;
+};
+
+// Each tile's seed depends only on the maze's seed and the tile's index.
+// Tile t draws it from an Xorshifter on the t-th parameter triple, so
+// neighbouring tiles come from different generators, not just different
+// starting points; two 32-bit draws make the 64-bit seed of the tile's
+// MazeRandom. An xorshift state of 0 stays 0, so it is replaced by 1.
+static uint64_t maze_tile_seed(uint64_t seed, int tile)
+{
+	uint32_t x = (uint32_t)(seed ^ seed >> 32) ^ (uint32_t)tile * 0x9E3779B9u;
+	Xorshifter shifter;
+	Xorshift_init(&shifter, x ? x : 1, tile);
+	uint64_t high = Xorshift_rand(&shifter);
+	return high << 32 | Xorshift_rand(&shifter);
+}
+
+// Generates tiles until none are left. A tile starts on a word boundary
+// and its passages out are left closed, so no two threads write the same
+// word.
+static int maze_tile_worker(void *arg)
+{
+	struct MazeTiles *tiles = arg;
+	struct Maze *maze = tiles->maze;
+	int count = tiles->across * tiles->down;
+
+	for (int t; !atomic_load(&tiles->failed) && (t = atomic_fetch_add(&tiles->next, 1)) < count; ) {
+		int row0 = t / tiles->across * tiles->tile_rows, col0 = t % tiles->across * tiles->tile_cols;
+		struct Maze *tile = Maze_create(int_min(tiles->tile_rows, maze->nrows - row0),
+		                                int_min(tiles->tile_cols, maze->ncols - col0));
+		if (!tile || !Maze_generate(tile, tiles->algorithm, maze_tile_seed(tiles->seed, t))) {
+			atomic_store(&tiles->failed, true);
+			Maze_destroy(tile);
+			break;
+		}
+		for (int row = 0; row < tile->nrows; ++row)
+			memcpy(maze->bits + (size_t)(row0 + row) * maze->row_words + col0 / MAZE_CELLS_PER_WORD,
+			       tile->bits + (size_t)row * tile->row_words, tile->row_words * sizeof(uint64_t));
+		Maze_destroy(tile);
+	}
+	return 0;
+}
+
+// Joins the tiles along a Wilson maze over the tile grid, each passage
+// between tiles at a random place along their shared edge.
+static bool maze_join_tiles(struct MazeTiles *tiles)
+{
+	struct Maze *maze = tiles->maze, *graph = Maze_create(tiles->down, tiles->across);
+	if (!graph || !Maze_generate(graph, MAZE_WILSON, tiles->seed ^ 0x5DEECE66Du)) {
+		Maze_destroy(graph);
+		return false;
+	}
+
+	struct MazeRandom random = MazeRandom_seed(~tiles->seed);
+	for (int down = 0; down < graph->nrows; ++down)
+		for (int across = 0; across < graph->ncols; ++across) {
+			int row0 = down * tiles->tile_rows, col0 = across * tiles->tile_cols;
+			int rows = int_min(tiles->tile_rows, maze->nrows - row0);
+			int cols = int_min(tiles->tile_cols, maze->ncols - col0);
+			unsigned pair = Maze_pair(graph, down, across);
+			if (pair & 1)
+				Maze_open_pair(maze, row0 + MazeRandom_below(&random, rows), col0 + cols - 1, 1);
+			if (pair & 2)
+				Maze_open_pair(maze, row0 + rows - 1, col0 + MazeRandom_below(&random, cols), 2);
+		}
+	Maze_destroy(graph);
+	return true;
+}
+
+// Returns false when out of memory, leaving every wall closed. The
+// calling thread generates tiles too; if a thread can't be started, the
+// others take on its share.
+bool Maze_generate_tiled(struct Maze *maze, enum MazeAlgorithm algorithm, uint64_t seed,
+                         int tile, int nthreads)
+{
+	Maze_clear(maze);
+	if (tile < 1 || algorithm < 0 || algorithm >= MAZE_ALGORITHM_COUNT)
+		return false;
+
+	long long width = (tile + MAZE_CELLS_PER_WORD - 1LL) / MAZE_CELLS_PER_WORD * MAZE_CELLS_PER_WORD;
+	int tile_cols = width < maze->ncols ? (int)width : maze->ncols;
+	int tile_rows = int_min(tile, maze->nrows);
+	int across = (maze->ncols + tile_cols - 1) / tile_cols;
+	int down = (maze->nrows + tile_rows - 1) / tile_rows;
+
+	// Only the tiles and the graph joining them are generated as mazes,
+	// so the whole maze may pass MAZE_MAX_CELLS.
+	if ((long long)tile_rows * tile_cols > MAZE_MAX_CELLS || (long long)across * down > MAZE_MAX_CELLS)
+		return false;
+
+	struct MazeTiles tiles = {
+		.maze = maze, .algorithm = algorithm, .seed = seed,
+		.tile_rows = tile_rows, .tile_cols = tile_cols,
+		.across = across, .down = down,
+	};
+	atomic_init(&tiles.next, 0);
+	atomic_init(&tiles.failed, false);
+
+	nthreads = int_max(1, int_min(int_min(nthreads, MAZE_MAX_THREADS), tiles.across * tiles.down));
+	thrd_t threads[MAZE_MAX_THREADS];
+	bool started[MAZE_MAX_THREADS] = {0};
+	for (int t = 1; t < nthreads; ++t)
+		started[t] = thrd_create(&threads[t], maze_tile_worker, &tiles) == thrd_success;
+
+	maze_tile_worker(&tiles);
+	for (int t = 1; t < nthreads; ++t)
+		if (started[t])
+			thrd_join(threads[t], NULL);
+
+	if (atomic_load(&tiles.failed) || !maze_join_tiles(&tiles)) {
+		Maze_clear(maze);
+		return false;
+	}
+	return true;
+}
+
+size_t MazeAlgorithm_scratch(enum MazeAlgorithm algorithm, int nrows, int ncols)
+{
+	size_t cells = (size_t)nrows * ncols;
+	switch (algorithm) {
+		case MAZE_BACKTRACKER:  return maze_bitmap_size(cells) + cells * sizeof(int);
+		case MAZE_WILSON:       return maze_bitmap_size(cells) + cells;
+		case MAZE_KRUSKAL:      return (2 * cells - nrows - ncols) * sizeof(uint32_t) + cells * sizeof(int);
+		case MAZE_ELLER:        return maze_stream_size(ncols);
+		default:                return 0;
+	}
+}
+
+const char *MazeAlgorithm_name(enum MazeAlgorithm algorithm)
+{
+	static const char *names[] = {
+		[MAZE_BINARY_TREE] = "binary-tree",
+		[MAZE_SIDEWINDER]  = "sidewinder",
+		[MAZE_BACKTRACKER] = "backtracker",
+		[MAZE_WILSON]      = "wilson",
+		[MAZE_KRUSKAL]     = "kruskal",
+		[MAZE_ELLER]       = "eller",
+	};
+	return (algorithm >= 0 && algorithm < MAZE_ALGORITHM_COUNT) ? names[algorithm] : "unknown";
+}
+
+//----------------------------------------------------------------------
+// Maze Solver
+//
+// Searches mark cells in a flat int array: 0 for unvisited, distance + 1
+// for cells reached from the start and -(distance + 1) for cells reached
+// from the goal.
+//
+// A frontier entry holds a cell and the MazeDir of the way back to the
+// cell it was reached from. That passage is skipped instead of tested,
+// which in a perfect maze leaves the visited test nearly always false
+// and the branch predictable.
+
+enum { MAZE_FRONTIER_MIN = 1024 };
+
+struct MazeFrontier
+{
+	uint64_t *entries;       // cell << 4 | way back
+	size_t mask;             // capacity - 1, capacity a power of two
+	size_t head, tail;       // running counts of entries taken and added
+};
+
+static bool maze_frontier_init(struct MazeFrontier *f)
+{
+	*f = (struct MazeFrontier){ .entries = malloc(MAZE_FRONTIER_MIN * sizeof(uint64_t)),
+	                            .mask = MAZE_FRONTIER_MIN - 1 };
+	return f->entries;
+}
+
+static bool maze_frontier_add(struct MazeFrontier *f, int cell, unsigned back)
+{
+	size_t length = f->tail - f->head;
+	if (length > f->mask) {
+		uint64_t *entries = malloc(2 * length * sizeof(uint64_t));
+		if (!entries)
+			return false;
+		for (size_t k = 0; k < length; ++k)
+			entries[k] = f->entries[(f->head + k) & f->mask];
+		free(f->entries);
+		*f = (struct MazeFrontier){ entries, 2 * length - 1, 0, length };
+	}
+	f->entries[f->tail++ & f->mask] = (uint64_t)cell << 4 | back;
+	return true;
+}
+
+static uint64_t maze_frontier_take(struct MazeFrontier *f)
+{
+	return f->entries[f->head++ & f->mask];
+}
+
+static size_t maze_frontier_length(const struct MazeFrontier *f)
+{
+	return f->tail - f->head;
+}
+
+// Cells beyond the open walls of cell i, except on side skip, with the
+// way back from each; returns how many.
+static int maze_open_neighbours(const struct Maze *maze, int i, unsigned skip,
+                                int next[4], unsigned back[4])
+{
+	int ncols = maze->ncols, row = i / ncols, col = i - row * ncols, n = 0;
+	unsigned open = Maze_passages_unchecked(maze, row, col) & ~skip;
+	next[n] = i - ncols, back[n] = MAZE_SOUTH, n += !!(open & MAZE_NORTH);
+	next[n] = i + ncols, back[n] = MAZE_NORTH, n += !!(open & MAZE_SOUTH);
+	next[n] = i + 1,     back[n] = MAZE_WEST,  n += !!(open & MAZE_EAST);
+	next[n] = i - 1,     back[n] = MAZE_EAST,  n += !!(open & MAZE_WEST);
+	return n;
+}
+
+enum { MAZE_SEARCH_GROWING, MAZE_SEARCH_MET, MAZE_SEARCH_NO_MEMORY };
+
+// Visits the cells one step beyond the frontier's current level. The
+// frontier's cells carry marks of the sign of side. Where the level
+// touches cells marked from the other side, *near and *far are set to
+// the pair on either side of the shortest crossing.
+static int maze_search_level(const struct Maze *maze, int *marks, struct MazeFrontier *f,
+                             int side, int *near, int *far, int *last)
+{
+	int status = MAZE_SEARCH_GROWING, best = INT_MAX;
+	for (size_t count = maze_frontier_length(f); count > 0; --count) {
+		uint64_t entry = maze_frontier_take(f);
+		int i = entry >> 4, next[4];
+		unsigned back[4];
+		*last = i;
+		for (int k = 0, n = maze_open_neighbours(maze, i, entry & 15, next, back); k < n; ++k) {
+			int j = next[k];
+			if (KR_LIKELY(marks[j] == 0)) {
+				marks[j] = marks[i] + side;
+				if (!maze_frontier_add(f, j, back[k]))
+					return MAZE_SEARCH_NO_MEMORY;
+			}
+			else if ((marks[j] > 0) != (side > 0) && abs(marks[i]) + abs(marks[j]) < best) {
+				best = abs(marks[i]) + abs(marks[j]);
+				*near = i, *far = j;
+				status = MAZE_SEARCH_MET;
+			}
+		}
+	}
+	return status;
+}
+
+// Searches outward from start over the whole maze, or until goal is
+// marked when goal >= 0, into zeroed marks. Returns false when out of
+// memory; *last is the last cell reached, one of the farthest from start.
+static bool maze_search_into(const struct Maze *maze, int *marks, int start, int goal, int *last)
+{
+	struct MazeFrontier f;
+	if (!maze_frontier_init(&f))
+		return false;
+
+	marks[start] = 1, *last = start;
+	maze_frontier_add(&f, start, 0);
+	int status = MAZE_SEARCH_GROWING, near, far;
+	while (status == MAZE_SEARCH_GROWING && maze_frontier_length(&f) > 0
+	       && (goal < 0 || marks[goal] == 0))
+		status = maze_search_level(maze, marks, &f, 1, &near, &far, last);
+
+	free(f.entries);
+	return status != MAZE_SEARCH_NO_MEMORY;
+}
+
+// As maze_search_into, returning new marks or NULL when out of memory.
+static int *maze_search(const struct Maze *maze, int start, int goal, int *last)
+{
+	int *marks = calloc((size_t)maze->nrows * maze->ncols, sizeof(int));
+	if (marks && !maze_search_into(maze, marks, start, goal, last))
+		free(marks), marks = NULL;
+	return marks;
+}
+
+static int maze_index(const struct Maze *maze, struct GridPos p)
+{
+	p.row = CHECK_LEN(maze->nrows, p.row);
+	p.col = CHECK_LEN(maze->ncols, p.col);
+	return p.row * maze->ncols + p.col;
+}
+
+static struct GridPos maze_pos(const struct Maze *maze, int i)
+{
+	return (struct GridPos){ i / maze->ncols, i % maze->ncols };
+}
+
+// NULL for mazes over MAZE_MAX_CELLS cells or when out of memory.
+struct Grid *Maze_distances(const struct Maze *maze, struct GridPos start)
+{
+	if (!maze_indexable(maze))
+		return NULL;
+
+	int s = maze_index(maze, start), last;
+	struct Grid *distances = Grid_create(maze->nrows, maze->ncols, sizeof(int), GRID_ROW_MAJOR);
+	if (!distances)
+		return NULL;
+
+	int *d = (int*)distances->cells;
+	if (!maze_search_into(maze, d, s, -1, &last)) {
+		Grid_destroy(distances);
+		return NULL;
+	}
+	for (size_t i = 0, n = (size_t)maze->nrows * maze->ncols; i < n; ++i)
+		d[i] -= 1;
+	return distances;
+}
+
+// Writes the cells from i back to the cell marked ±1, stepping to the
+// neighbour whose mark is one closer to zero each time, into path[at],
+// path[at + dir], ... while they fit in [0, capacity).
+static void maze_trace(const struct Maze *maze, const int *marks, int i,
+                       struct GridPos *path, int capacity, int at, int dir)
+{
+	for (;;) {
+		if (0 <= at && at < capacity)
+			path[at] = maze_pos(maze, i);
+		at += dir;
+		int mark = marks[i], step = mark > 0 ? -1 : 1, next[4];
+		unsigned back[4];
+		if (mark == 1 || mark == -1)
+			return;
+		for (int k = 0, n = maze_open_neighbours(maze, i, 0, next, back); k < n; ++k)
+			if (marks[next[k]] == mark + step) {
+				i = next[k];
+				break;
+			}
+	}
+}
+
+static int maze_solve_bidirectional(const struct Maze *maze, int start, int goal,
+                                    struct GridPos *path, int capacity)
+{
+	struct MazeFrontier fs, fg;
+	int *marks = calloc((size_t)maze->nrows * maze->ncols, sizeof(int));
+	bool ready = marks && maze_frontier_init(&fs);
+	if (ready && !maze_frontier_init(&fg))
+		free(fs.entries), ready = false;
+	if (!ready) {
+		free(marks);
+		return -2;
+	}
+
+	marks[start] = 1, marks[goal] = -1;
+	maze_frontier_add(&fs, start, 0);
+	maze_frontier_add(&fg, goal, 0);
+
+	// Grow the smaller frontier a level at a time until they meet.
+	int status = MAZE_SEARCH_GROWING, near = start, far = goal, last;
+	while (status == MAZE_SEARCH_GROWING && maze_frontier_length(&fs) && maze_frontier_length(&fg)) {
+		if (maze_frontier_length(&fs) <= maze_frontier_length(&fg))
+			status = maze_search_level(maze, marks, &fs, 1, &near, &far, &last);
+		else
+			status = maze_search_level(maze, marks, &fg, -1, &far, &near, &last);
+	}
+
+	int length = -1;
+	if (status == MAZE_SEARCH_MET) {
+		int from_start = marks[near], to_goal = -marks[far];
+		length = from_start + to_goal;
+		maze_trace(maze, marks, near, path, capacity, from_start - 1, -1);
+		maze_trace(maze, marks, far, path, capacity, from_start, 1);
+	}
+	else if (status == MAZE_SEARCH_NO_MEMORY)
+		length = -2;
+
+	free(fs.entries), free(fg.entries), free(marks);
+	return length;
+}
+
+// The number of cells on the shortest path from start to goal, both
+// included, or -1 when goal can't be reached and -2 for mazes over
+// MAZE_MAX_CELLS cells or when out of memory. As many cells as fit are
+// written to path, from start.
+int Maze_solve(const struct Maze *maze, struct GridPos start, struct GridPos goal,
+               bool bidirectional, struct GridPos *path, int capacity)
+{
+	if (!maze_indexable(maze))
+		return -2;
+
+	int s = maze_index(maze, start), g = maze_index(maze, goal);
+	if (s == g) {
+		if (capacity > 0)
+			path[0] = maze_pos(maze, s);
+		return 1;
+	}
+	if (bidirectional)
+		return maze_solve_bidirectional(maze, s, g, path, capacity);
+
+	int last;
+	int *marks = maze_search(maze, s, g, &last);
+	if (!marks)
+		return -2;
+	int length = marks[g];
+	if (length > 0)
+		maze_trace(maze, marks, g, path, capacity, length - 1, -1);
+	else
+		length = -1;
+	free(marks);
+	return length;
+}
+
+// The two ends of a longest path. For a maze that isn't perfect, the
+// result is a long path, not necessarily the longest.
+struct MazeSpan Maze_diameter(const struct Maze *maze)
+{
+	struct MazeSpan span = { .length = -1 };
+	int from, to;
+	if (!maze_indexable(maze))
+		return span;
+
+	int *marks = maze_search(maze, 0, -1, &from);
+	if (!marks)
+		return span;
+	free(marks);
+
+	marks = maze_search(maze, from, -1, &to);
+	if (!marks)
+		return span;
+
+	span = (struct MazeSpan){ maze_pos(maze, from), maze_pos(maze, to), marks[to] - 1 };
+	free(marks);
+	return span;
+}
+
+//----------------------------------------------------------------------
+// Maze Writer
+
+enum { MAZE_WRITER_BUFFER = 1 << 16 };
+
+struct MazeWriter
+{
+	FILE *out;
+	enum MazeFormat format;
+	int nrows, ncols;
+	bool ok;                 // no write has failed
+	size_t row_size;         // bytes one MazeRow becomes
+	size_t length, capacity;
+	char glyphs[3][16][3];   // MAZE_ASCII text for each line of a cell, by MazeDir flags
+	byte buffer[];
+};
+
+static void maze_ascii_glyphs(char glyphs[3][16][3])
+{
+	for (unsigned open = 0; open < 16; ++open) {
+		memcpy(glyphs[0][open], open & MAZE_NORTH ? " | " : "   ", 3);
+		glyphs[1][open][0] = open & MAZE_WEST ? '-' : ' ';
+		glyphs[1][open][1] = '+';
+		glyphs[1][open][2] = open & MAZE_EAST ? '-' : ' ';
+		memcpy(glyphs[2][open], open & MAZE_SOUTH ? " | " : "   ", 3);
+	}
+}
+
+static size_t maze_pbm_line(int ncols)
+{
+	return (2 * (size_t)ncols + 1 + 7) / 8;
+}
+
+static bool maze_writer_drain(struct MazeWriter *w)
+{
+	if (w->length && fwrite(w->buffer, 1, w->length, w->out) != w->length)
+		w->ok = false;
+	w->length = 0;
+	return w->ok;
+}
+
+struct MazeWriter *MazeWriter_create(FILE *out, enum MazeFormat format, int nrows, int ncols)
+{
+	if (nrows < 1 || ncols < 1 || (format != MAZE_ASCII && format != MAZE_PBM))
+		return NULL;
+
+	size_t row_size = format == MAZE_ASCII
+		? 3 * (3 * (size_t)ncols + 1)
+		: 2 * maze_pbm_line(ncols);
+	size_t capacity = row_size + maze_pbm_line(ncols);
+	if (capacity < MAZE_WRITER_BUFFER)
+		capacity = MAZE_WRITER_BUFFER;
+
+	struct MazeWriter *w = malloc(sizeof(*w) + capacity);
+	if (!w)
+		return NULL;
+	*w = (struct MazeWriter){
+		.out = out, .format = format, .nrows = nrows, .ncols = ncols, .ok = true,
+		.row_size = row_size, .capacity = capacity };
+
+	if (format == MAZE_ASCII)
+		maze_ascii_glyphs(w->glyphs);
+	else {
+		// The header, then the solid top wall.
+		w->length = snprintf((char*)w->buffer, capacity, "P4\n%d %d\n",
+		                     2 * ncols + 1, 2 * nrows + 1);
+		size_t line = maze_pbm_line(ncols);
+		memset(w->buffer + w->length, 0xFF, line);
+		w->length += line;
+	}
+	return w;
+}
+
+void MazeWriter_destroy(struct MazeWriter *w)
+{
+	if (w) {
+		MazeWriter_flush(w);
+		free(w);
+	}
+}
+
+bool MazeWriter_flush(struct MazeWriter *w)
+{
+	return maze_writer_drain(w) && fflush(w->out) == 0;
+}
+
+static void maze_write_ascii(byte *out, char glyphs[3][16][3], struct MazeRow row)
+{
+	size_t line = 3 * (size_t)row.ncols + 1;
+	byte *north = out, *middle = out + line, *south = out + 2 * line;
+
+	for (int col = 0; col < row.ncols; ++col) {
+		unsigned open = MazeRow_passages(row, col);
+		memcpy(north  + 3 * col, glyphs[0][open], 3);
+		memcpy(middle + 3 * col, glyphs[1][open], 3);
+		memcpy(south  + 3 * col, glyphs[2][open], 3);
+	}
+	north[line - 1] = middle[line - 1] = south[line - 1] = '\n';
+}
+
+enum { MAZE_EVEN_BITS = 0x5555555555555555u };
+
+// One line of pixels, 32 cells per packed word. Each cell covers two
+// pixels, built first as bits in column order with bit 0 the left
+// border, then each byte is bit-reversed into PBM's leftmost-first order.
+// The right border spills into the next word when ncols fills the last.
+static void maze_pbm_pixels(byte *out, int ncols, const uint64_t *pairs, bool below)
+{
+	size_t line = maze_pbm_line(ncols);
+	int words = (ncols + MAZE_CELLS_PER_WORD - 1) / MAZE_CELLS_PER_WORD;
+	uint64_t carry = 1;                          // left border
+
+	for (int i = 0; line > 0; ++i) {
+		uint64_t x = carry;
+		if (i < words) {
+			uint64_t w = ~pairs[i];
+			uint64_t px = below
+				? (w >> 1 & MAZE_EVEN_BITS) | ~MAZE_EVEN_BITS  // wall south, corner
+				: (w & MAZE_EVEN_BITS) << 1;                   // cell, wall east
+			x |= px << 1;
+			carry = px >> 63;
+		}
+
+		x = (x >> 1 & 0x5555555555555555u) | (x & 0x5555555555555555u) << 1;
+		x = (x >> 2 & 0x3333333333333333u) | (x & 0x3333333333333333u) << 2;
+		x = (x >> 4 & 0x0F0F0F0F0F0F0F0Fu) | (x & 0x0F0F0F0F0F0F0F0Fu) << 4;
+		for (int k = 0; k < 8 && line > 0; ++k, --line)
+			*out++ = x >> 8 * k;
+	}
+
+	// Padding past the right border is black.
+	int used = (2 * ncols + 1) % 8;
+	if (used)
+		out[-1] |= 0xFF >> used;
+}
+
+// Two lines of pixels: the cells with the walls between them, then the
+// walls below the cells with the corners between those. Cell col is
+// pixel 2*col+1 and its east wall pixel 2*col+2.
+static void maze_write_pbm(byte *out, struct MazeRow row)
+{
+	size_t line = maze_pbm_line(row.ncols);
+	maze_pbm_pixels(out, row.ncols, row.pairs, false);
+	maze_pbm_pixels(out + line, row.ncols, row.pairs, true);
+}
+
+// Returns false once any write has failed.
+bool MazeWriter_write(struct MazeWriter *w, struct MazeRow row)
+{
+	if (row.ncols != w->ncols)
+		return fail("MazeWriter_write: row width differs from the writer's", SRCSITE("assert"));
+	if (w->capacity - w->length < w->row_size && !maze_writer_drain(w))
+		return false;
+
+	if (w->format == MAZE_ASCII)
+		maze_write_ascii(w->buffer + w->length, w->glyphs, row);
+	else
+		maze_write_pbm(w->buffer + w->length, row);
+	w->length += w->row_size;
+	return w->ok;
+}
@@ -0,0 +1,332 @@
+#ifndef KR_KRMAZE_H_INCLUDED
+#define KR_KRMAZE_H_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+#include <limits.h>
+#include "krbase.h"
+#include "krgrid.h"
+
+//----------------------------------------------------------------------
+// Maze
+//
+// A rectangular maze packed two bits per cell: whether there is a
+// passage east, and whether there is a passage south. North and west
+// passages are read from the cells above and before, so every wall is
+// stored once. Each row starts on a fresh 64-bit word; a 10,000 x 10,000
+// maze takes 25 MB.
+//
+// Maze_link opens the wall between two adjacent cells, like linking them
+// in both directions at once.
+//
+// Maze_save writes the packed bits in the Grid Files container;
+// Maze_open_mapped maps them back without copying, and the mapped maze
+// is released with Maze_close_mapped.
+
+enum MazeDir
+{
+	MAZE_NORTH = 1,
+	MAZE_SOUTH = 2,
+	MAZE_EAST  = 4,
+	MAZE_WEST  = 8,
+};
+
+enum { MAZE_CELLS_PER_WORD = 32 };
+
+struct Maze
+{
+	int nrows, ncols;
+	int row_words;           // words per row
+	uint64_t bits[];         // bit 2*i: east of cell i, bit 2*i+1: south
+};
+
+struct Maze *Maze_create(int nrows, int ncols);
+void   Maze_destroy(struct Maze *maze);
+void   Maze_clear(struct Maze *maze);
+bool   Maze_link(struct Maze *maze, struct GridPos a, struct GridPos b);
+size_t Maze_size(int nrows, int ncols);
+
+struct Maze *Maze_open_mapped(const char *path);
+void   Maze_close_mapped(struct Maze *maze);
+bool   Maze_save(const struct Maze *maze, const char *path);
+
+// East and south bits of column col in a packed row.
+static inline unsigned maze_row_pair(const uint64_t *row, int col)
+{
+	return row[col / MAZE_CELLS_PER_WORD] >> (col % MAZE_CELLS_PER_WORD * 2) & 3;
+}
+
+static inline void maze_row_open(uint64_t *row, int col, unsigned pair)
+{
+	row[col / MAZE_CELLS_PER_WORD] |= (uint64_t)pair << (col % MAZE_CELLS_PER_WORD * 2);
+}
+
+// East and south bits of an in-bounds cell; no checks.
+static inline unsigned Maze_pair(const struct Maze *maze, int row, int col)
+{
+	return maze_row_pair(maze->bits + (size_t)row * maze->row_words, col);
+}
+
+static inline void Maze_open_pair(struct Maze *maze, int row, int col, unsigned pair)
+{
+	maze_row_open(maze->bits + (size_t)row * maze->row_words, col, pair);
+}
+
+// MazeDir flags of the open walls around an in-bounds cell; no checks.
+static inline unsigned Maze_passages_unchecked(const struct Maze *maze, int row, int col)
+{
+	unsigned pair = Maze_pair(maze, row, col);
+	unsigned open = (pair & 1 ? MAZE_EAST : 0) | (pair & 2 ? MAZE_SOUTH : 0);
+	if (row > 0 && Maze_pair(maze, row - 1, col) & 2)
+		open |= MAZE_NORTH;
+	if (col > 0 && Maze_pair(maze, row, col - 1) & 1)
+		open |= MAZE_WEST;
+	return open;
+}
+
+static inline unsigned Maze_passages(const struct Maze *maze, struct GridPos p)
+{
+	p.row = CHECK_LEN(maze->nrows, p.row);
+	p.col = CHECK_LEN(maze->ncols, p.col);
+	return Maze_passages_unchecked(maze, p.row, p.col);
+}
+
+static inline bool Maze_open(const struct Maze *maze, struct GridPos p, enum MazeDir dir)
+{
+	return Maze_passages(maze, p) & dir;
+}
+
+static inline struct GridPos MazeDir_step(struct GridPos p, enum MazeDir dir)
+{
+	switch (dir) {
+		case MAZE_NORTH:  return GridPos_above(p);
+		case MAZE_SOUTH:  return GridPos_below(p);
+		case MAZE_EAST:   return GridPos_after(p);
+		case MAZE_WEST:   return GridPos_before(p);
+	}
+	return p;
+}
+
+//----------------------------------------------------------------------
+// Linked Maze Cells
+//
+// A maze held as a Grid of MazeCell, each pointing at the neighbours it
+// has a passage to. Easy to build and walk by hand, at four pointers a
+// cell; Maze_pack converts it to a packed Maze.
+//
+// MazeCell_grid_create returns a GRID_ROW_MAJOR grid with every wall
+// closed, released with Grid_destroy. MazeCell_link opens the wall
+// between two adjacent cells; it ignores cells that aren't neighbours.
+
+struct MazeCell
+{
+	struct GridPos pos;
+	struct MazeCell *north, *south, *east, *west;
+};
+
+struct Grid *MazeCell_grid_create(int nrows, int ncols);
+void         MazeCell_link(struct MazeCell *a, struct MazeCell *b);
+struct Maze *Maze_pack(struct Grid *cells);
+
+//----------------------------------------------------------------------
+// Maze Rows
+//
+// One row of a maze with the row above it, which is all it takes to
+// know every wall around the row's cells. Renderers draw a MazeRow at a
+// time, whether it comes from a whole Maze or from a MazeStream.
+
+struct MazeRow
+{
+	int row, ncols;
+	const uint64_t *above;   // packed row above; NULL for the first row
+	const uint64_t *pairs;   // packed row
+};
+
+static inline struct MazeRow Maze_row(const struct Maze *maze, int row)
+{
+	row = CHECK_BOUNDARY_LEN(maze->nrows, row);
+	const uint64_t *pairs = maze->bits + (size_t)row * maze->row_words;
+	return (struct MazeRow){ row, maze->ncols, row > 0 ? pairs - maze->row_words : NULL, pairs };
+}
+
+// MazeDir flags of the open walls around cell col; no checks.
+static inline unsigned MazeRow_passages(struct MazeRow r, int col)
+{
+	unsigned pair = maze_row_pair(r.pairs, col);
+	unsigned open = (pair & 1 ? MAZE_EAST : 0) | (pair & 2 ? MAZE_SOUTH : 0);
+	if (r.above && maze_row_pair(r.above, col) & 2)
+		open |= MAZE_NORTH;
+	if (col > 0 && maze_row_pair(r.pairs, col - 1) & 1)
+		open |= MAZE_WEST;
+	return open;
+}
+
+//----------------------------------------------------------------------
+// Maze Random
+//
+// Small seeded generator (splitmix64) so a seed gives the same maze on
+// every platform, and each thread or tile can carry its own stream.
+
+struct MazeRandom
+{
+	uint64_t state;
+	uint64_t bits;           // unused random bits for MazeRandom_bit
+	int nbits;
+};
+
+static inline struct MazeRandom MazeRandom_seed(uint64_t seed)
+{
+	return (struct MazeRandom){ .state = seed };
+}
+
+static inline uint64_t MazeRandom_next(struct MazeRandom *r)
+{
+	uint64_t z = (r->state += 0x9E3779B97F4A7C15u);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+	return z ^ (z >> 31);
+}
+
+static inline bool MazeRandom_bit(struct MazeRandom *r)
+{
+	if (r->nbits == 0)
+		r->bits = MazeRandom_next(r), r->nbits = 64;
+	bool bit = r->bits & 1;
+	r->bits >>= 1, --r->nbits;
+	return bit;
+}
+
+// Uniform in [0, n) for n > 0.
+static inline unsigned MazeRandom_below(struct MazeRandom *r, unsigned n)
+{
+	return (unsigned)((MazeRandom_next(r) >> 32) * n >> 32);
+}
+
+//----------------------------------------------------------------------
+// Maze Stream
+//
+// Generates a perfect maze one row at a time with Eller's algorithm,
+// keeping only two packed rows and a disjoint-set forest over the
+// columns, so memory grows with the width and not the height. A row
+// returned by MazeStream_next stays valid until the next call.
+//
+//     struct MazeStream *s = MazeStream_create(nrows, ncols, seed);
+//     while (!MazeStream_done(s))
+//         draw(MazeStream_next(s));
+//     MazeStream_destroy(s);
+
+struct MazeStream;
+
+struct MazeStream *MazeStream_create(int nrows, int ncols, uint64_t seed);
+void           MazeStream_destroy(struct MazeStream *stream);
+bool           MazeStream_done(const struct MazeStream *stream);
+struct MazeRow MazeStream_next(struct MazeStream *stream);
+
+//----------------------------------------------------------------------
+// Maze Generators
+//
+// Each fills a Maze with a perfect maze (exactly one path between any
+// two cells), working on the packed bits and flat per-cell arrays:
+//
+//   MAZE_BINARY_TREE  each cell opens north or west; long straight
+//                     corridors along the top and left. No scratch.
+//   MAZE_SIDEWINDER   runs east, each closed by one passage north.
+//                     No scratch.
+//   MAZE_BACKTRACKER  depth-first search with an explicit stack; long
+//                     winding passages. A visited bit and a stack slot
+//                     per cell.
+//   MAZE_WILSON       loop-erased random walks; uniform over all
+//                     spanning trees, but the first walks are slow. A
+//                     byte and a bit per cell.
+//   MAZE_KRUSKAL      shuffled walls merged with a union-find; many short
+//                     dead ends. 12 bytes per cell.
+//   MAZE_ELLER        MazeStream's rows copied in; scratch grows with the
+//                     width only.
+//
+// MazeAlgorithm_scratch gives the working memory beyond the Maze itself.
+//
+// Generators and solvers index cells with an int and add two distances,
+// so they refuse mazes of more than MAZE_MAX_CELLS cells. Larger mazes
+// can still be created, saved and mapped.
+
+enum { MAZE_MAX_CELLS = INT_MAX / 2 };
+
+enum MazeAlgorithm
+{
+	MAZE_BINARY_TREE,
+	MAZE_SIDEWINDER,
+	MAZE_BACKTRACKER,
+	MAZE_WILSON,
+	MAZE_KRUSKAL,
+	MAZE_ELLER,
+	MAZE_ALGORITHM_COUNT
+};
+
+bool        Maze_generate(struct Maze *maze, enum MazeAlgorithm algorithm, uint64_t seed);
+size_t      MazeAlgorithm_scratch(enum MazeAlgorithm algorithm, int nrows, int ncols);
+const char *MazeAlgorithm_name(enum MazeAlgorithm algorithm);
+
+// Tiled generation splits the maze into tiles of about tile x tile cells
+// (widths rounded up to whole words, MAZE_CELLS_PER_WORD), generates each
+// tile on one of nthreads threads from its own seeded stream, then joins
+// the tiles with one passage per edge of a random spanning tree over
+// them. The result is a perfect maze that depends on the seed and tile
+// size, but not on nthreads. Passages between tiles are rare, so tiles
+// show as regions with few ways in. MAZE_MAX_CELLS limits each tile and
+// the number of tiles, not the whole maze.
+
+enum { MAZE_DEFAULT_TILE = 512 };
+
+bool Maze_generate_tiled(struct Maze *maze, enum MazeAlgorithm algorithm, uint64_t seed,
+                         int tile, int nthreads);
+
+//----------------------------------------------------------------------
+// Maze Solver
+//
+// Breadth-first searches over flat cell indexes (row * ncols + col) with
+// a ring-buffer frontier, reading walls straight from the packed bits.
+//
+// Maze_distances gives every cell's distance in steps from start as a
+// GRID_ROW_MAJOR Grid of int, -1 where unreachable. Maze_solve finds the
+// shortest path from start to goal, stopping as soon as goal is reached;
+// a bidirectional search grows from both ends and usually visits far
+// fewer cells. Maze_diameter finds the longest path in a perfect maze
+// with two searches: the cell farthest from any cell is one end.
+
+struct MazeSpan
+{
+	struct GridPos from, to;
+	int length;              // steps; -1 when too large or out of memory
+};
+
+struct Grid    *Maze_distances(const struct Maze *maze, struct GridPos start);
+int             Maze_solve(const struct Maze *maze, struct GridPos start, struct GridPos goal,
+                           bool bidirectional, struct GridPos *path, int capacity);
+struct MazeSpan Maze_diameter(const struct Maze *maze);
+
+//----------------------------------------------------------------------
+// Maze Writer
+//
+// Writes a maze a MazeRow at a time, composing rows in a buffer and
+// writing it in large blocks.
+//
+//   MAZE_ASCII  three lines of three characters per cell: a passage north,
+//               then west, centre and east, then a passage south.
+//   MAZE_PBM    binary PBM (P4) image, 2 * ncols + 1 pixels wide and
+//               2 * nrows + 1 high: each cell, wall and corner is one
+//               pixel, black for walls. 1 bit per pixel keeps very large
+//               mazes manageable.
+//
+// Check MazeWriter_flush before MazeWriter_destroy to learn of write
+// errors.
+
+enum MazeFormat { MAZE_ASCII, MAZE_PBM };
+
+struct MazeWriter;
+
+struct MazeWriter *MazeWriter_create(FILE *out, enum MazeFormat format, int nrows, int ncols);
+void MazeWriter_destroy(struct MazeWriter *writer);
+bool MazeWriter_write(struct MazeWriter *writer, struct MazeRow row);
+bool MazeWriter_flush(struct MazeWriter *writer);
+
+#endif
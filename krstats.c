@@ -0,0 +1,426 @@
+#include "krstats.h"
+#include <math.h>
+#include <float.h>
+
+//----------------------------------------------------------------------
+// Compact Encoding
+//
+// Counts are LEB128 varints and doubles are written little-endian, so
+// encoded sketches can move between hosts.
+
+struct ByteWriter { byte *p, *end; int length; };
+struct ByteReader { const byte *p, *end; bool ok; };
+
+static void put_byte(struct ByteWriter *w, byte b)
+{
+	if (w->p && w->p < w->end)
+		*w->p++ = b;
+	w->length++;
+}
+
+static void put_varint(struct ByteWriter *w, uint64_t v)
+{
+	for (; v >= 0x80; v >>= 7)
+		put_byte(w, (byte)(v | 0x80));
+	put_byte(w, (byte)v);
+}
+
+static void put_int(struct ByteWriter *w, int n)
+{
+	put_varint(w, (n < 0) ? ((uint64_t)-(int64_t)n << 1) - 1 : (uint64_t)n << 1);
+}
+
+static void put_double(struct ByteWriter *w, double d)
+{
+	uint64_t u;
+	memcpy(&u, &d, sizeof(u));
+	for (int k = 0; k < 8; ++k)
+		put_byte(w, (byte)(u >> (8 * k)));
+}
+
+static byte get_byte(struct ByteReader *r)
+{
+	if (r->p < r->end)
+		return *r->p++;
+	r->ok = false;
+	return 0;
+}
+
+static uint64_t get_varint(struct ByteReader *r)
+{
+	uint64_t v = 0;
+	for (int shift = 0; shift < 64 && r->ok; shift += 7) {
+		byte b = get_byte(r);
+		v |= (uint64_t)(b & 0x7F) << shift;
+		if (!(b & 0x80))
+			return v;
+	}
+	r->ok = false;
+	return 0;
+}
+
+static int get_int(struct ByteReader *r)
+{
+	uint64_t z = get_varint(r);
+	if (z > 2 * (uint64_t)INT32_MAX + 1)
+		r->ok = false;
+	return (z & 1) ? (int)-(int64_t)((z + 1) >> 1) : (int)(z >> 1);
+}
+
+static double get_double(struct ByteReader *r)
+{
+	uint64_t u = 0;
+	for (int k = 0; k < 8; ++k)
+		u |= (uint64_t)get_byte(r) << (8 * k);
+	double d;
+	memcpy(&d, &u, sizeof(d));
+	return d;
+}
+
+//----------------------------------------------------------------------
+// Quantile Sketch
+
+enum { DDSKETCH_FORMAT = 'D' };
+
+static void store_add(struct SketchStore *s, int index, uint64_t n)
+{
+	if (!n)
+		return;
+
+	if (!s->total) {
+		s->offset = index - DDSKETCH_BINS / 2;
+		s->lo = s->hi = index;
+	}
+	else if (index < s->offset) {
+		// Slide the window down as far as the top bucket allows; whatever
+		// still falls below it is counted in the lowest bucket.
+		int room  = s->offset + DDSKETCH_BINS - 1 - s->hi;
+		int shift = int_min(s->offset - index, room);
+		if (shift > 0) {
+			memmove(s->counts + shift, s->counts, sizeof(*s->counts) * (DDSKETCH_BINS - shift));
+			memset(s->counts, 0, sizeof(*s->counts) * shift);
+			s->offset -= shift;
+		}
+		index = int_max(index, s->offset);
+	}
+	else if (index >= s->offset + DDSKETCH_BINS) {
+		// Slide the window up, collapsing buckets that fall off the bottom.
+		int shift = index - (s->offset + DDSKETCH_BINS - 1);
+		int drop  = int_min(shift, DDSKETCH_BINS);
+		uint64_t folded = 0;
+		for (int k = 0; k < drop; ++k)
+			folded += s->counts[k];
+		memmove(s->counts, s->counts + drop, sizeof(*s->counts) * (DDSKETCH_BINS - drop));
+		memset(s->counts + DDSKETCH_BINS - drop, 0, sizeof(*s->counts) * drop);
+		s->offset += shift;
+		s->counts[0] += folded;
+		s->lo = int_max(s->lo, s->offset);
+	}
+
+	s->counts[index - s->offset] += n;
+	s->total += n;
+	s->lo = int_min(s->lo, index);
+	s->hi = int_max(s->hi, index);
+}
+
+static uint64_t store_count(const struct SketchStore *s, int index)
+{
+	return s->counts[index - s->offset];
+}
+
+void DDSketch_init(struct DDSketch *sketch, double relative_accuracy)
+{
+	ASSERTION(0.0 < relative_accuracy && relative_accuracy < 1.0);
+
+	memset(sketch, 0, sizeof(*sketch));
+	sketch->gamma = (1.0 + relative_accuracy) / (1.0 - relative_accuracy);
+	sketch->inv_log_gamma = 1.0 / log(sketch->gamma);
+	sketch->min =  INFINITY;
+	sketch->max = -INFINITY;
+}
+
+static int sketch_index(const struct DDSketch *sketch, double magnitude)
+{
+	return (int)ceil(log(magnitude) * sketch->inv_log_gamma);
+}
+
+static double sketch_value(const struct DDSketch *sketch, int index)
+{
+	return 2.0 * pow(sketch->gamma, index) / (sketch->gamma + 1.0);
+}
+
+// Non-finite values are ignored.
+void DDSketch_add(struct DDSketch *sketch, double x)
+{
+	if (!isfinite(x))
+		return;
+
+	sketch->count++;
+	sketch->min = fmin(sketch->min, x);
+	sketch->max = fmax(sketch->max, x);
+
+	if (x > 0.0)
+		store_add(&sketch->positive, sketch_index(sketch, x), 1);
+	else if (x < 0.0)
+		store_add(&sketch->negative, sketch_index(sketch, -x), 1);
+	else
+		sketch->zero_count++;
+}
+
+void DDSketch_add_span(struct DDSketch *sketch, nuspan values)
+{
+	for (int i = 0; i < values.length; ++i)
+		DDSketch_add(sketch, values.p[i]);
+}
+
+static void store_merge(struct SketchStore *into, const struct SketchStore *from)
+{
+	if (from->total)
+		for (int i = from->lo; i <= from->hi; ++i)
+			store_add(into, i, store_count(from, i));
+}
+
+// Both sketches must have been initialized with the same accuracy.
+bool DDSketch_merge(struct DDSketch *into, const struct DDSketch *from)
+{
+	if (!ASSERTION(into->gamma == from->gamma))
+		return false;
+
+	store_merge(&into->positive, &from->positive);
+	store_merge(&into->negative, &from->negative);
+	into->count      += from->count;
+	into->zero_count += from->zero_count;
+	into->min = fmin(into->min, from->min);
+	into->max = fmax(into->max, from->max);
+	return true;
+}
+
+double DDSketch_quantile(const struct DDSketch *sketch, double q)
+{
+	if (!sketch->count || !(0.0 <= q && q <= 1.0))
+		return NAN;
+
+	uint64_t rank = (uint64_t)(q * (sketch->count - 1));
+	if (rank == 0)
+		return sketch->min;
+	if (rank == sketch->count - 1)
+		return sketch->max;
+
+	const struct SketchStore *neg = &sketch->negative, *pos = &sketch->positive;
+	double x = 0.0;
+
+	if (rank < neg->total) {
+		// Negative values come first, largest magnitude first.
+		uint64_t seen = 0;
+		for (int i = neg->hi; i >= neg->lo; --i)
+			if ((seen += store_count(neg, i)) > rank) {
+				x = -sketch_value(sketch, i);
+				break;
+			}
+	}
+	else if (rank >= neg->total + sketch->zero_count) {
+		rank -= neg->total + sketch->zero_count;
+		uint64_t seen = 0;
+		for (int i = pos->lo; i <= pos->hi; ++i)
+			if ((seen += store_count(pos, i)) > rank) {
+				x = sketch_value(sketch, i);
+				break;
+			}
+	}
+
+	return fmin(fmax(x, sketch->min), sketch->max);
+}
+
+static void store_encode(struct ByteWriter *w, const struct SketchStore *s)
+{
+	int n = s->total ? s->hi - s->lo + 1 : 0;
+	put_int(w, s->lo);
+	put_varint(w, n);
+	for (int i = 0; i < n; ++i)
+		put_varint(w, store_count(s, s->lo + i));
+}
+
+static void store_decode(struct ByteReader *r, struct SketchStore *s)
+{
+	int lo = get_int(r);
+	uint64_t n = get_varint(r);
+	if (n > DDSKETCH_BINS)
+		r->ok = false;
+	for (int i = 0; r->ok && i < (int)n; ++i)
+		store_add(s, lo + i, get_varint(r));
+}
+
+// Returns the number of bytes the encoding needs; only the first *size*
+// of them are written to *out*, which may be NULL to measure.
+int DDSketch_encode(const struct DDSketch *sketch, byte out[], int size)
+{
+	struct ByteWriter w = { out, out ? out + size : NULL, 0 };
+	put_byte(&w, DDSKETCH_FORMAT);
+	put_double(&w, sketch->gamma);
+	put_varint(&w, sketch->count);
+	put_varint(&w, sketch->zero_count);
+	put_double(&w, sketch->min);
+	put_double(&w, sketch->max);
+	store_encode(&w, &sketch->positive);
+	store_encode(&w, &sketch->negative);
+	return w.length;
+}
+
+bool DDSketch_decode(struct DDSketch *sketch, const byte in[], int size)
+{
+	struct ByteReader r = { in, in + size, true };
+	if (get_byte(&r) != DDSKETCH_FORMAT)
+		return false;
+
+	double gamma = get_double(&r);
+	if (!r.ok || !(gamma > 1.0))
+		return false;
+
+	memset(sketch, 0, sizeof(*sketch));
+	sketch->gamma = gamma;
+	sketch->inv_log_gamma = 1.0 / log(gamma);
+	sketch->count      = get_varint(&r);
+	sketch->zero_count = get_varint(&r);
+	sketch->min = get_double(&r);
+	sketch->max = get_double(&r);
+	store_decode(&r, &sketch->positive);
+	store_decode(&r, &sketch->negative);
+	return r.ok;
+}
+
+//----------------------------------------------------------------------
+// Log-Linear Histogram
+
+enum { LOGHIST_FORMAT = 'H' };
+
+void LogHistogram_init(struct LogHistogram *hist)
+{
+	memset(hist, 0, sizeof(*hist));
+	hist->min =  INFINITY;
+	hist->max = -INFINITY;
+}
+
+static int loghist_index(double x)
+{
+	int e;
+	double m = frexp(x, &e);    // x = m * 2^e, 0.5 <= m < 1
+	int octave = e - 1 - LOGHIST_MIN_EXP;
+	return octave * LOGHIST_SUB + (int)((2.0 * m - 1.0) * LOGHIST_SUB);
+}
+
+struct Interval LogHistogram_bucket(int i)
+{
+	int exp = i / LOGHIST_SUB + LOGHIST_MIN_EXP;
+	double width = ldexp(1.0 / LOGHIST_SUB, exp);
+	double left  = ldexp(1.0, exp) + width * (i % LOGHIST_SUB);
+	return (struct Interval){ left, left + width };
+}
+
+// NANs are ignored.
+void LogHistogram_add(struct LogHistogram *hist, double x)
+{
+	if (isnan(x))
+		return;
+
+	hist->count++;
+	hist->sum += x;
+	hist->min = fmin(hist->min, x);
+	hist->max = fmax(hist->max, x);
+
+	if (x < ldexp(1.0, LOGHIST_MIN_EXP))
+		hist->underflow++;
+	else if (x >= ldexp(1.0, LOGHIST_MAX_EXP))
+		hist->overflow++;
+	else
+		hist->counts[loghist_index(x)]++;
+}
+
+void LogHistogram_add_span(struct LogHistogram *hist, nuspan values)
+{
+	for (int i = 0; i < values.length; ++i)
+		LogHistogram_add(hist, values.p[i]);
+}
+
+void LogHistogram_merge(struct LogHistogram *into, const struct LogHistogram *from)
+{
+	into->count     += from->count;
+	into->underflow += from->underflow;
+	into->overflow  += from->overflow;
+	into->sum       += from->sum;
+	into->min = fmin(into->min, from->min);
+	into->max = fmax(into->max, from->max);
+	for (int i = 0; i < LOGHIST_BUCKETS; ++i)
+		into->counts[i] += from->counts[i];
+}
+
+// Estimates are bucket midpoints; out-of-range ranks report min or max.
+double LogHistogram_quantile(const struct LogHistogram *hist, double q)
+{
+	if (!hist->count || !(0.0 <= q && q <= 1.0))
+		return NAN;
+
+	uint64_t rank = (uint64_t)(q * (hist->count - 1));
+	if (rank < hist->underflow)
+		return hist->min;
+
+	uint64_t seen = hist->underflow;
+	for (int i = 0; i < LOGHIST_BUCKETS; ++i)
+		if ((seen += hist->counts[i]) > rank) {
+			struct Interval b = LogHistogram_bucket(i);
+			return clamp(interval(hist->min, hist->max), lerp(b, 0.5));
+		}
+
+	return hist->max;
+}
+
+// Same contract as DDSketch_encode. Only non-empty buckets are written,
+// each as the gap from the previous one and its count.
+int LogHistogram_encode(const struct LogHistogram *hist, byte out[], int size)
+{
+	struct ByteWriter w = { out, out ? out + size : NULL, 0 };
+	put_byte(&w, LOGHIST_FORMAT);
+	put_varint(&w, hist->count);
+	put_varint(&w, hist->underflow);
+	put_varint(&w, hist->overflow);
+	put_double(&w, hist->min);
+	put_double(&w, hist->max);
+	put_double(&w, hist->sum);
+
+	int used = 0;
+	for (int i = 0; i < LOGHIST_BUCKETS; ++i)
+		used += !!hist->counts[i];
+	put_varint(&w, used);
+
+	for (int i = 0, prev = 0; i < LOGHIST_BUCKETS; ++i)
+		if (hist->counts[i]) {
+			put_varint(&w, i - prev);
+			put_varint(&w, hist->counts[i]);
+			prev = i;
+		}
+	return w.length;
+}
+
+bool LogHistogram_decode(struct LogHistogram *hist, const byte in[], int size)
+{
+	struct ByteReader r = { in, in + size, true };
+	if (get_byte(&r) != LOGHIST_FORMAT)
+		return false;
+
+	LogHistogram_init(hist);
+	hist->count     = get_varint(&r);
+	hist->underflow = get_varint(&r);
+	hist->overflow  = get_varint(&r);
+	hist->min = get_double(&r);
+	hist->max = get_double(&r);
+	hist->sum = get_double(&r);
+
+	uint64_t used = get_varint(&r);
+	uint64_t i = 0;
+	for (uint64_t k = 0; r.ok && k < used; ++k) {
+		i += get_varint(&r);
+		if (i >= LOGHIST_BUCKETS)
+			return false;
+		hist->counts[i] = get_varint(&r);
+	}
+	return r.ok;
+}
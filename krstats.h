@@ -0,0 +1,74 @@
+#ifndef KR_KRSTATS_H_INCLUDED
+#define KR_KRSTATS_H_INCLUDED
+
+#include <stdint.h>
+#include "krbase.h"
+
+//----------------------------------------------------------------------
+// Quantile Sketch
+//
+// DDSketch: values are counted in logarithmic buckets so any quantile is
+// returned within a fixed relative error. Each store holds a fixed window
+// of DDSKETCH_BINS buckets; when a stream outgrows it the smallest
+// magnitudes are collapsed together, so memory never grows.
+
+enum { DDSKETCH_BINS = 1024 };
+
+struct SketchStore
+{
+	int offset;                    // bucket index of counts[0]
+	int lo, hi;                    // used bucket index range
+	uint64_t total;
+	uint64_t counts[DDSKETCH_BINS];
+};
+
+struct DDSketch
+{
+	double gamma, inv_log_gamma;
+	uint64_t count, zero_count;
+	double min, max;
+	struct SketchStore positive, negative;
+};
+
+void   DDSketch_init    (struct DDSketch *sketch, double relative_accuracy);
+void   DDSketch_add     (struct DDSketch *sketch, double x);
+void   DDSketch_add_span(struct DDSketch *sketch, nuspan values);
+bool   DDSketch_merge   (struct DDSketch *into, const struct DDSketch *from);
+double DDSketch_quantile(const struct DDSketch *sketch, double q);
+
+int  DDSketch_encode(const struct DDSketch *sketch, byte out[], int size);
+bool DDSketch_decode(struct DDSketch *sketch, const byte in[], int size);
+
+//----------------------------------------------------------------------
+// Log-Linear Histogram
+//
+// Each power of two between 2^LOGHIST_MIN_EXP and 2^LOGHIST_MAX_EXP is
+// split into LOGHIST_SUB equal-width buckets. Values below the range
+// (including zero and negatives) or above it are counted separately.
+
+enum
+{
+	LOGHIST_MIN_EXP = -32,
+	LOGHIST_MAX_EXP = 32,
+	LOGHIST_SUB     = 16,
+	LOGHIST_BUCKETS = (LOGHIST_MAX_EXP - LOGHIST_MIN_EXP) * LOGHIST_SUB,
+};
+
+struct LogHistogram
+{
+	uint64_t count, underflow, overflow;
+	double min, max, sum;
+	uint64_t counts[LOGHIST_BUCKETS];
+};
+
+void   LogHistogram_init    (struct LogHistogram *hist);
+void   LogHistogram_add     (struct LogHistogram *hist, double x);
+void   LogHistogram_add_span(struct LogHistogram *hist, nuspan values);
+void   LogHistogram_merge   (struct LogHistogram *into, const struct LogHistogram *from);
+double LogHistogram_quantile(const struct LogHistogram *hist, double q);
+struct Interval LogHistogram_bucket(int i);
+
+int  LogHistogram_encode(const struct LogHistogram *hist, byte out[], int size);
+bool LogHistogram_decode(struct LogHistogram *hist, const byte in[], int size);
+
+#endif
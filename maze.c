@@ -4,165 +4,39 @@
 #include <errno.h>
 #include <limits.h>
 
-#include "krclib.h"
+#include "krgrid.h"
+#include "krmaze.h"
 
 
-struct grid_cell
+// Reports the shortest path between opposite corners and the longest
+// path in the maze on stderr. Returns false when out of memory.
+bool maze_report_paths(const struct Maze *maze)
 {
-	int row, col;
-};
+	struct GridPos start = { 0, 0 }, goal = { -1, -1 };
+	int length = Maze_solve(maze, start, goal, true, NULL, 0);
+	struct MazeSpan span = Maze_diameter(maze);
+	if (length < -1 || span.length < 0)
+		return false;
 
-struct grid
-{
-	int nrows, ncols;
-	size_t cell_size;
-};
-
-struct grid *grid_create(size_t head_size, size_t elem_size, int nrows, int ncols, struct except_frame *xf)
-{
-	int num_cells = try_int_mult(nrows, ncols, xf, CURRENT_LOCATION);
-	struct grid *grid = fam_alloc(head_size, elem_size, num_cells, xf);
-	grid->nrows = nrows;
-	grid->ncols = ncols;
-	grid->cell_size = elem_size;
-	return grid;
-}
-
-#define GRID_CREATE(GridType_, Rows_, Cols_, Xf_)  \
-	(GridType_*)grid_create(sizeof(GridType_), sizeof(*(GridType_){}.cells), (Rows_), (Cols_), (Xf_))
-
-int grid_num_cells(struct grid *grid)
-{
-	return grid->nrows * grid->ncols;
-}
-
-#define GRID_END(Grid_)  ((Grid_)->cells + grid_num_cells((struct grid*)(Grid_)))
-
-int grid_index(struct grid *grid, int row, int col)
-{
-	row = CHECK(row, grid->nrows);
-	col = CHECK(col, grid->ncols);
-	return (row * grid->ncols) + col;
-}
-
-#define GRID_AT(Gridptr_, Row_, Col_)  ((Gridptr_)->cells[ grid_index( (struct grid*)(Gridptr_), (Row_), (Col_)) ])
-
-int grid_cell_index(struct grid *grid, struct grid_cell cell)
-{
-	return grid_index(grid, cell.row, cell.col);
-}
-
-#define GRID_CELL_AT(Gridptr_, Cell_)  ((Gridptr_)->cells[ grid_cell_index( (struct grid*)(Gridptr_), (Cell_)) ])
-
-
-struct grid_row
-{
-	void *front, *back;
-	int row_size;
-	int row_num;
-};
-
-struct grid_row row_start(struct grid *grid, void *cells)
-{
-	return 
-		(struct grid_row)
-		{
-			.back = cells,
-			.row_size = grid->cell_size * grid->ncols,
-			.row_num = 0
-		};
+	fprintf(stderr, "corner to corner: %d steps\n", length - 1);
+	fprintf(stderr, "longest path: %d steps, (%d,%d) to (%d,%d)\n", span.length,
+	        span.from.row, span.from.col, span.to.row, span.to.col);
+	return true;
 }
 
-bool row_next(struct grid *grid, struct grid_row *row)
+// Returns false on a write error.
+bool maze_write(const struct Maze *maze, FILE *out, enum MazeFormat format)
 {
-	if (row->row_num++ < grid->nrows)
-	{
-		row->front = row->back;
-		(byte*)row->back += row->row_size;
-		return true;
-	}
-	else return false;
-}
-
+	struct MazeWriter *writer = MazeWriter_create(out, format, maze->nrows, maze->ncols);
+	if (!writer)
+		return false;
 
-
-
-struct maze_cell 
-{
-	struct grid_cell pos;
-	struct maze_cell *north,
-					 *south,
-					 *east,
-					 *west;
-};
-
-void maze_cell_link(struct maze_cell *a, struct maze_cell *b)
-{
-	if      (a->pos.row > b->pos.row)  a->north = b, b->south = a;
-	else if (a->pos.row < b->pos.row)  a->south = b, b->north = a;
-	else if (a->pos.col > b->pos.col)  a->west  = b, b->east  = a;
-	else if (a->pos.col < b->pos.col)  a->east  = b, b->west  = a;
-}
-
-struct maze
-{
-	struct grid grid;
-	struct maze_cell cells[];
-};
-
-struct maze *maze_create(int height, int width, struct except_frame *xf)
-{
-	struct maze *maze = GRID_CREATE(struct maze, height, width, xf);
-	for (struct grid_cell pos = {0,0};  pos.row < maze->grid.nrows;  ++pos.row)
-		for (pos.col = 0; pos.col < maze->grid.ncols; ++pos.col)
-			GRID_CELL_AT(maze, pos) = (struct maze_cell){ .pos = pos };
-	return maze;
-}
-
-
-void maze_draw_ascii(struct maze *maze)
-{
-	struct grid_row row = row_start(&maze->grid, maze->cells);
-
-	while (row_next(&maze->grid, &row))
-	{
-		for (struct maze_cell *cell = row.front;
-		     cell != row.back; ++cell)
-		{
-			if (cell->north)
-				printf(" | ");
-			else
-				printf("   ");
-		}
-		putchar('\n');
-
-		for (struct maze_cell *cell = row.front;
-		     cell != row.back; ++cell)
-		{
-			if (cell->west)
-				putchar('-');
-			else
-				putchar(' ');
-
-			putchar('+');
-
-			if (cell->east)
-				putchar('-');
-			else
-				putchar(' ');
-		}
-		putchar('\n');
-
-		for (struct maze_cell *cell = row.front;
-		     cell != row.back; ++cell)
-		{
-			if (cell->south)
-				printf(" | ");
-			else
-				printf("   ");
-		}
-		putchar('\n');
-	}
+	bool ok = true;
+	for (int row = 0; row < maze->nrows; ++row)
+		ok &= MazeWriter_write(writer, Maze_row(maze, row));
+	ok &= MazeWriter_flush(writer);
+	MazeWriter_destroy(writer);
+	return ok;
 }
 
 
@@ -171,6 +45,13 @@ typedef struct
 	int width;
 	int height;
 	unsigned  seed;
+	enum MazeFormat format;
+	enum MazeAlgorithm algorithm;
+	bool solve;
+	int threads;             // 0 unless generating by tiles
+	int tile;
+	const char *load;        // maze file to map instead of generating
+	const char *save;        // maze file to write instead of drawing
 } MazeOptions;
 
 
@@ -201,6 +82,29 @@ unsigned parse_uint_option(int argi, int argc, char *argv[], const char *name)
 	return n; 
 }
 
+const char *parse_path_option(int argi, int argc, char *argv[], const char *name)
+{
+	if (argi >= argc) {
+		fprintf(stderr, "ERROR: missing value for argument %s\n", name);
+		exit(0);
+	}
+	return argv[argi];
+}
+
+enum MazeAlgorithm parse_algorithm_option(int argi, int argc, char *argv[])
+{
+	if (argi < argc)
+		for (enum MazeAlgorithm a = 0; a < MAZE_ALGORITHM_COUNT; ++a)
+			if (!strcmp(argv[argi], MazeAlgorithm_name(a)))
+				return a;
+
+	fprintf(stderr, "ERROR: -algorithm must be one of:");
+	for (enum MazeAlgorithm a = 0; a < MAZE_ALGORITHM_COUNT; ++a)
+		fprintf(stderr, " %s", MazeAlgorithm_name(a));
+	fprintf(stderr, "\n");
+	exit(0);
+}
+
 void MazeOptions_read(MazeOptions *options, int argc, char *argv[])
 {
 	for (int i = 1; i < argc; ++i) {
@@ -212,6 +116,20 @@ void MazeOptions_read(MazeOptions *options, int argc, char *argv[])
 			options->height = parse_uint_option(++i, argc, argv, "-height");
 		else if (!strcmp(argv[i], "-seed")) 
 			options->seed = parse_uint_option(++i, argc, argv, "-seed");
+		else if (!strcmp(argv[i], "-pbm"))
+			options->format = MAZE_PBM;
+		else if (!strcmp(argv[i], "-threads"))
+			options->threads = parse_uint_option(++i, argc, argv, "-threads");
+		else if (!strcmp(argv[i], "-tile"))
+			options->tile = parse_uint_option(++i, argc, argv, "-tile");
+		else if (!strcmp(argv[i], "-solve"))
+			options->solve = true;
+		else if (!strcmp(argv[i], "-algorithm"))
+			options->algorithm = parse_algorithm_option(++i, argc, argv);
+		else if (!strcmp(argv[i], "-load"))
+			options->load = parse_path_option(++i, argc, argv, "-load");
+		else if (!strcmp(argv[i], "-save"))
+			options->save = parse_path_option(++i, argc, argv, "-save");
 		else {
 			fprintf(stderr, "ERROR: unknown argument %s\n", argv[i]);
 			exit(0);
@@ -222,45 +140,111 @@ void MazeOptions_read(MazeOptions *options, int argc, char *argv[])
 
 int main(int argc, char *argv[])
 {
-	struct except_frame xf = {0};
-
 	MazeOptions options = {
 		.width = 8,
 		.height = 8,
-		.seed = 123456789
+		.seed = 123456789,
+		.algorithm = MAZE_ELLER,
 	};
 
 	MazeOptions_read(&options, argc, argv);
 
-	srand(options.seed);
-
-	struct maze *maze = NULL;
-	if (!setjmp(xf.env))
+	// -threads or -tile generate by tiles, the same maze for any number of
+	// threads.
+	bool tiled = options.threads || options.tile;
+	if (tiled)
 	{
-		maze = maze_create(options.height, options.width, &xf);
+		options.threads = options.threads ? options.threads : 1;
+		options.tile = options.tile ? options.tile : MAZE_DEFAULT_TILE;
 	}
-	else
+
+	// Tiling, solving and maze files need the whole maze in memory. A
+	// loaded maze is mapped, so even a huge one opens at once.
+	if (options.algorithm != MAZE_ELLER || options.solve || tiled || options.load || options.save)
 	{
-		struct error *err = xf.error;
-		error_fprint(stderr, &(struct error){ .status=STATUS_EXCEPTION, .source=CURRENT_LOCATION });
-		error_fatal(err);
+		struct Maze *maze;
+		if (options.load)
+		{
+			maze = Maze_open_mapped(options.load);
+			if (!maze)
+			{
+				fprintf(stderr, "ERROR: can't load %s: %s\n", options.load, strerror(errno));
+				return EXIT_FAILURE;
+			}
+		}
+		else
+		{
+			if (!tiled && (long long)options.height * options.width > MAZE_MAX_CELLS)
+			{
+				fprintf(stderr, "ERROR: a %d x %d maze is over %d cells; generate it with -tile.\n",
+				        options.height, options.width, MAZE_MAX_CELLS);
+				return EXIT_FAILURE;
+			}
+			maze = Maze_create(options.height, options.width);
+			bool generated = maze && (tiled
+				? Maze_generate_tiled(maze, options.algorithm, options.seed, options.tile, options.threads)
+				: Maze_generate(maze, options.algorithm, options.seed));
+			if (!generated && tiled && maze)
+			{
+				fprintf(stderr, "ERROR: can't generate a %d x %d maze by tiles: out of memory, "
+				        "or a tile or the tile count exceeds %d.\n",
+				        options.height, options.width, MAZE_MAX_CELLS);
+				return EXIT_FAILURE;
+			}
+			if (!generated)
+			{
+				fprintf(stderr, "ERROR: can't allocate a %d x %d maze.\n", options.height, options.width);
+				return EXIT_FAILURE;
+			}
+		}
+		if (options.solve && (long long)maze->nrows * maze->ncols > MAZE_MAX_CELLS)
+		{
+			fprintf(stderr, "ERROR: can't solve a %d x %d maze; -solve takes at most %d cells.\n",
+			        maze->nrows, maze->ncols, MAZE_MAX_CELLS);
+			return EXIT_FAILURE;
+		}
+		if (options.solve && !maze_report_paths(maze))
+		{
+			fprintf(stderr, "ERROR: can't allocate a %d x %d maze.\n", maze->nrows, maze->ncols);
+			return EXIT_FAILURE;
+		}
+		bool ok = options.save
+			? Maze_save(maze, options.save)
+			: maze_write(maze, stdout, options.format);
+		if (options.load)
+			Maze_close_mapped(maze);
+		else
+			Maze_destroy(maze);
+		if (!ok)
+		{
+			fprintf(stderr, "ERROR: writing the maze: %s\n", strerror(errno));
+			return EXIT_FAILURE;
+		}
+		return 0;
 	}
 
-
-	struct maze_cell *end = GRID_END(maze);
-	for (struct maze_cell *cell = &maze->cells[1]; cell != end; ++cell)
+	// Rows are written as they are generated, so only the width is limited
+	// by memory.
+	struct MazeStream *stream = MazeStream_create(options.height, options.width, options.seed);
+	struct MazeWriter *writer = MazeWriter_create(stdout, options.format, options.height, options.width);
+	if (!stream || !writer)
 	{
-		int n = 0;
-		struct maze_cell *neighbors[2];
-		if (cell->pos.row > 0)  neighbors[n++] = &GRID_AT(maze, cell->pos.row-1, cell->pos.col);
-		if (cell->pos.col > 0)  neighbors[n++] = &GRID_AT(maze, cell->pos.row,   cell->pos.col-1);
-		maze_cell_link(cell, neighbors[rand()%n]);
+		fprintf(stderr, "ERROR: can't allocate a maze %d cells wide.\n", options.width);
+		return EXIT_FAILURE;
 	}
 
-	maze_draw_ascii(maze);
+	bool ok = true;
+	while (ok && !MazeStream_done(stream))
+		ok = MazeWriter_write(writer, MazeStream_next(stream));
+	ok = ok && MazeWriter_flush(writer);
+
+	MazeWriter_destroy(writer);
+	MazeStream_destroy(stream);
 
-	free(maze);
-	except_dispose(&xf);
+	if (!ok)
+	{
+		fprintf(stderr, "ERROR: writing the maze: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
 	return 0;
 }
-
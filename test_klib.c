@@ -246,7 +246,7 @@ TEST_CASE(convert_status_enum_to_str)
 
 void this_func_throws_up(struct except_frame *xf)
 {
-	except_try(xf, STATUS_ERROR, CURRENT_LOCATION);
+	except_try(xf, STATUS_ERROR, SRCSITE("throw"));
 }
 
 TEST_CASE(func_throws_exception)
@@ -256,7 +256,7 @@ TEST_CASE(func_throws_exception)
 	switch (EXCEPT_BEGIN(xf)) 
 	{
 		case EXCEPT_TRY:
-			except_try(&xf, STATUS_OK, CURRENT_LOCATION);
+			except_try(&xf, STATUS_OK, SRCSITE("throw"));
 			// it should not throw
 			break;
 		default:
@@ -300,7 +300,7 @@ TEST_CASE(cast_ptrdiff_to_int_safely)
 		{
 			const byte bytes[100];
 			ptrdiff_t d = &bytes[90] - &bytes[65];
-			int id = try_ptrdiff_to_int(d, &xf, CURRENT_LOCATION);
+			int id = try_ptrdiff_to_int(d, &xf, SRCSITE("throw"));
 			TEST(id == 25);
 			// it should not throw
 			break;
@@ -323,7 +323,7 @@ TEST_CASE(cast_ptrdiff_to_int_fail_positive)
 		case EXCEPT_TRY: 
 		{
 			ptrdiff_t big_diff = (ptrdiff_t)INT_MAX + 100;
-			int id = try_ptrdiff_to_int(big_diff, &xf, CURRENT_LOCATION);
+			int id = try_ptrdiff_to_int(big_diff, &xf, SRCSITE("throw"));
 			TEST(!"Exception was not thrown!");
 			break;
 		}
@@ -345,7 +345,7 @@ TEST_CASE(cast_ptrdiff_to_int_fail_negative)
 		case EXCEPT_TRY: 
 		{
 			ptrdiff_t neg_diff = (ptrdiff_t)-INT_MAX - 100;
-			int id = try_ptrdiff_to_int(neg_diff, &xf, CURRENT_LOCATION);
+			int id = try_ptrdiff_to_int(neg_diff, &xf, SRCSITE("throw"));
 			TEST(!"Exception was not thrown!");
 			break;
 		}
@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <assert.h>
+#include <threads.h>
 
 TEST_CASE(this_test_always_fails)
 {
@@ -105,30 +106,221 @@ TEST_CASE(test_assertions)
 	//ASSERTION(x == 1); 
 }
 
+static int push_handler_in_thread(void *errmsg)
+{
+	struct AssertHandler handler = { test_assert_handler, errmsg };
+	AssertHandler_push(&handler);
+	(void)ASSERTION(!"thread");
+	AssertHandler_pop();
+	return AssertHandler_current() == &handler;
+}
+static int fail_in_thread(void *unused)
+{
+	UNUSED(unused);
+	return ASSERTION(!"default");
+}
+TEST_CASE(assert_handlers_are_per_thread)
+{
+	char main_msg[101] = "", thread_msg[101] = "";
+	struct AssertHandler handler = { test_assert_handler, main_msg };
+	AssertHandler_push(&handler);
+
+	thrd_t t;
+	int popped_to_own = -1;
+	TEST( thrd_create(&t, push_handler_in_thread, thread_msg) == thrd_success );
+	thrd_join(t, &popped_to_own);
+
+	TEST( !strcmp(thread_msg, "ASSERT Failed: !\"thread\"") );
+	TEST( popped_to_own == 0 );
+	TEST( !strcmp(main_msg, "") );
+	TEST( AssertHandler_current() == &handler );
+	AssertHandler_pop();
+
+	// A thread with no handlers of its own falls back to the process default.
+	char default_msg[101] = "";
+	AssertHandler_set_default(&(struct AssertHandler){ test_assert_handler, default_msg });
+	TEST( thrd_create(&t, fail_in_thread, NULL) == thrd_success );
+	thrd_join(t, NULL);
+	AssertHandler_set_default(NULL);
+	TEST( !strcmp(default_msg, "ASSERT Failed: !\"default\"") );
+}
+
+static struct SourceSite *hit_test_site(void)
+{
+	SOURCE_SITE(site, "test");
+	SourceSite_hit(&site);
+	return &site;
+}
+static int hit_test_site_often(void *unused)
+{
+	UNUSED(unused);
+	for (int i = 0; i < 1000; ++i)
+		hit_test_site();
+	return 0;
+}
+TEST_CASE(source_sites_count_hits_and_register_once)
+{
+	struct SourceSite *site = hit_test_site();
+	TEST( SourceSite_hits(site) == 1 );
+	TEST( site->location.line_num > 0 && !strcmp(site->kind, "test") );
+
+	thrd_t threads[4];
+	for (int i = 0; i < 4; ++i)
+		thrd_create(&threads[i], hit_test_site_often, NULL);
+	for (int i = 0; i < 4; ++i)
+		thrd_join(threads[i], NULL);
+	TEST( SourceSite_hits(site) == 4001 );
+
+	int registered = 0;
+	for (struct SourceSite *s = SourceSite_first(); s; s = s->next)
+		registered += (s == site);
+	TEST( registered == 1 );
+
+	SourceSite_reset_all();
+	TEST( SourceSite_hits(site) == 0 );
+}
+
+TEST_CASE(failed_expression_checks_register_their_sites)
+{
+	char errmsg[101] = "";
+	AssertHandler_push(&(struct AssertHandler){ test_assert_handler, errmsg });
+
+	SourceSite_reset_all();
+	for (int i = 0; i < 3; ++i) {
+		CHECK_BOUNDARY_LEN(4, 4 + i);
+		(void)ASSERTION(i < 0);
+	}
+	CHECK_BOUNDARY_LEN(4, 3);
+	AssertHandler_pop();
+
+	const struct SourceSite *index_site = NULL, *assert_site = NULL;
+	int fired = 0;
+	for (struct SourceSite *s = SourceSite_first(); s; s = s->next) {
+		if (!SourceSite_hits(s))
+			continue;
+		++fired;
+		if (!strcmp(s->kind, "index check"))
+			index_site = s;
+		else if (!strcmp(s->kind, "assert"))
+			assert_site = s;
+	}
+	TEST( fired == 2 );
+	TEST( index_site && SourceSite_hits(index_site) == 3 );
+	TEST( assert_site && SourceSite_hits(assert_site) == 3 );
+	TEST( index_site && assert_site
+	      && assert_site->location.line_num == index_site->location.line_num + 1 );
+}
+
+static bool counted(int *count, bool result)
+{
+	++*count;
+	return result;
+}
+TEST_CASE(sampled_assertions_check_one_in_n)
+{
+	char errmsg[101] = "";
+	AssertHandler_push(&(struct AssertHandler){ test_assert_handler, errmsg });
+
+	int evaluated = 0;
+	for (int i = 0; i < 100; ++i)
+		ASSERT_SAMPLED(10, counted(&evaluated, true));
+	TEST( evaluated == 10 );
+	TEST( !strcmp(errmsg, "") );
+
+	int failed = 0;
+	for (int i = 0; i < 25; ++i)
+		ASSERT_SAMPLED(5, counted(&failed, false));
+	TEST( failed == 5 );
+	TEST( !strncmp(errmsg, "ASSERT Failed: counted", 22) );
+	TEST( SourceSite_hits(SourceSite_first()) == 5 );
+
+	AssertHandler_pop();
+}
+
+TEST_CASE(rate_limited_prints_count_suppressed_reports)
+{
+	FILE *out = tmpfile();
+	for (int i = 0; i < 10; ++i)
+		DEBUG_PRINT_LIMITED(3, 60000, out, "report %d", i);
+
+	struct SourceSite *site = SourceSite_first();
+	TEST( !strcmp(site->kind, "log") );
+	TEST( SourceSite_hits(site) == 10 );
+	TEST( SourceSite_suppressed(site) == 7 );
+
+	char line[64];
+	int lines = 0;
+	rewind(out);
+	while (fgets(line, sizeof(line), out))
+		++lines;
+	TEST( lines == 3 );
+	TEST( strstr(line, "report 2") );
+	fclose(out);
+}
+
+TEST_CASE(rate_limits_stop_counting_at_the_limit)
+{
+	SOURCE_SITE(site, "test");
+	struct RateLimit limit = { .limit=2, .interval_ms=60000 };
+	int allowed = 0;
+	for (int i = 0; i < 100; ++i)
+		allowed += RateLimit_allow(&limit, &site);
+
+	TEST( allowed == 2 );
+	TEST( atomic_load(&limit.window_used) == 2 );
+	TEST( SourceSite_suppressed(&site) == 98 );
+}
+
 TEST_CASE(check_index_out_of_bounds)
 {
-	TEST( check_index( 22,   0, SRCLOC) ==   0 );
-	TEST( check_index( 10,   9, SRCLOC) ==   9 );
-	TEST( check_index( 64,  32, SRCLOC) ==  32 );
-	TEST( check_index(128,  -1, SRCLOC) == 127 );
-	TEST( check_index( 32, -32, SRCLOC) ==   0 );
+	TEST( check_index( 22,   0, SRCSITE("index check")) ==   0 );
+	TEST( check_index( 10,   9, SRCSITE("index check")) ==   9 );
+	TEST( check_index( 64,  32, SRCSITE("index check")) ==  32 );
+	TEST( check_index(128,  -1, SRCSITE("index check")) == 127 );
+	TEST( check_index( 32, -32, SRCSITE("index check")) ==   0 );
 
 	char assert_message[101] = "";
 	AssertHandler_push(&(struct AssertHandler){ test_assert_handler, assert_message });
 
 	int length = 32;
-	check_index(length, 32, SRCLOC);
+	check_index(length, 32, SRCSITE("index check"));
 	TEST( !strcmp(assert_message, "Array index 32 out of bounds [0,32).") );
 
-	check_index(length, -33, SRCLOC);
+	check_index(length, -33, SRCSITE("index check"));
 	TEST( !strcmp(assert_message, "Array index -1 out of bounds [0,32).") );
 
-	check_index(0, 0, SRCLOC);
+	check_index(0, 0, SRCSITE("index check"));
 	TEST( !strcmp(assert_message, "Array index 0 out of bounds [0,0).") );
 
 	AssertHandler_pop();
 }
 
+TEST_CASE(range_checked_loops_check_once)
+{
+	int data[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	int len = ARRAY_LENGTH(data);
+
+	int sum = 0;
+	FOR_RANGE_CHECKED(i, len, 2, 6)
+		sum += data[i];
+	TEST( sum == 3 + 4 + 5 + 6 );
+
+	char assert_message[101] = "";
+	AssertHandler_push(&(struct AssertHandler){ test_assert_handler, assert_message });
+
+	int iterations = 0;
+	FOR_RANGE_CHECKED(i, len, 4, 9)
+		++iterations;
+	TEST( iterations == 0 );
+	TEST( !strcmp(assert_message, "Index range [4,9) out of bounds [0,8).") );
+
+	FOR_RANGE_CHECKED(i, len, 5, 3)
+		++iterations;
+	TEST( iterations == 0 );
+
+	AssertHandler_pop();
+}
+
 //----------------------------------------------------------------------
 // Intervals & Vectors
 
@@ -248,6 +440,68 @@ TEST_CASE(linear_interpolation)
 	// Todo: extreme ranges of float
 }
 
+TEST_CASE(clamp_span_matches_scalar_clamp)
+{
+	struct Interval invl = interval(-1.0, 2.5);
+	nuspan in = $N(-3.0, -1.0, 0.0, 1.25, 2.5, 2.50001, 99.0);
+	double buf[7];
+	nuspan out = SPAN_INIT(buf);
+
+	num_clamp(invl, in, out);
+	for (int i = 0; i < in.length; ++i)
+		TEST( out.p[i] == clamp(invl, in.p[i]) );
+
+	nuspan nan = $N(NAN);
+	num_clamp(invl, nan, nan);
+	TEST( isnan(nan.p[0]) );
+
+	num_clamp(R_empty, in, out);
+	TEST( isnan(buf[0]) && isnan(buf[6]) );
+}
+
+TEST_CASE(lerp_span_in_place)
+{
+	nuspan t = $N(0.0, 0.5, 1.0, 0.25);
+	num_lerp(interval(1.0, 6.0), t, t);
+	TEST( t.p[0] == 1.0 );
+	TEST( t.p[1] == 3.5 );
+	TEST( t.p[2] == 6.0 );
+	TEST( t.p[3] == 2.25 );
+
+	num_lerp(R_empty, t, t);
+	TEST( isnan(t.p[0]) && isnan(t.p[3]) );
+}
+
+TEST_CASE(includes_span_counts_members)
+{
+	nuspan in = $N(0.5, 1.0, 1.5, 2.0, 2.5, NAN);
+	bool inside[6];
+	TEST( num_includes(interval(1.0, 2.0), in, inside) == 3 );
+	TEST( !inside[0] && inside[1] && inside[2] && inside[3] && !inside[4] && !inside[5] );
+	TEST( num_includes(R_empty, in, NULL) == 0 );
+	TEST( num_includes(R_all, in, NULL) == 5 );
+}
+
+TEST_CASE(remap_span_between_intervals)
+{
+	nuspan in = $N(-10.0, 0.0, 5.0, 10.0, 20.0);
+	double buf[5];
+	nuspan out = SPAN_INIT(buf);
+
+	num_remap(interval(0.0, 10.0), interval(100.0, 200.0), in, out);
+	TEST( buf[0] == 100.0 );
+	TEST( buf[1] == 100.0 );
+	TEST( buf[2] == 150.0 );
+	TEST( buf[3] == 200.0 );
+	TEST( buf[4] == 200.0 );
+
+	num_remap(R_empty, R_unit, in, out);
+	TEST( isnan(buf[2]) );
+
+	num_remap(R_zero, R_unit, in, out);
+	TEST( buf[0] == 0.0 && buf[4] == 0.0 );
+}
+
 TEST_CASE(vectors)
 {
 	VectorXY v1 = { 1.5, 100.25 };
@@ -257,6 +511,69 @@ TEST_CASE(vectors)
 	TEST( VEC_LENGTH(v1) == 2 );
 }
 
+TEST_CASE(vector_arrays_convert_to_and_from_vectors)
+{
+	VectorXYZ aos[] = { {{1, 2, 3}}, {{4, 5, 6}}, {{7, 8, 9}} };
+	VectorArrayXYZ soa = {0};
+	TEST( SOA_CREATE(soa, ARRAY_LENGTH(aos)) );
+	TEST( soa.length == 3 );
+	TEST( VEC_LENGTH(soa) == 3 );
+
+	SOA_FROM_AOS(soa, aos);
+	TEST( soa.x[0] == 1 && soa.x[1] == 4 && soa.x[2] == 7 );
+	TEST( soa.y[1] == 5 );
+	TEST( soa.v[2][2] == 9 );
+
+	VectorXYZ back[3] = {0};
+	SOA_TO_AOS(back, soa);
+	TEST( !memcmp(back, aos, sizeof(aos)) );
+
+	SOA_DESTROY(soa);
+	TEST( soa.length == 0 && soa.x == NULL );
+}
+
+TEST_CASE(vector_array_kernels)
+{
+	VectorXY pa[] = { {{3, 4}}, {{0, 0}}, {{-1, 2}}, {{6, 8}}, {{1, 1}} };
+	VectorXY pb[] = { {{1, 1}}, {{2, 0}}, {{ 0, 0}}, {{6, 8}}, {{4, 5}} };
+	int n = ARRAY_LENGTH(pa);
+
+	VectorArrayXY a = {0}, b = {0}, sum = {0};
+	SOA_CREATE(a, n);
+	SOA_CREATE(b, n);
+	SOA_CREATE(sum, n);
+	SOA_FROM_AOS(a, pa);
+	SOA_FROM_AOS(b, pb);
+
+	SOA_ADD(sum, a, b);
+	TEST( sum.x[0] == 4 && sum.y[0] == 5 );
+	TEST( sum.x[4] == 5 && sum.y[4] == 6 );
+
+	SOA_SCALE(sum, a, 0.5);
+	TEST( sum.x[3] == 3 && sum.y[3] == 4 );
+
+	double out[5];
+	SOA_DOT(out, a, b);
+	TEST( out[0] == 7 && out[2] == 0 && out[3] == 100 );
+
+	SOA_LENGTH(out, a);
+	TEST( out[0] == 5 && out[1] == 0 && out[3] == 10 );
+
+	SOA_DISTANCE(out, a, b);
+	TEST( feq(out[0], sqrt(13.0), 1e-12) && out[3] == 0 && out[4] == 5 );
+
+	SOA_NORMALIZE(a, a);
+	TEST( feq(a.x[0], 0.6, 1e-12) && feq(a.y[0], 0.8, 1e-12) );
+	TEST( a.x[1] == 0.0 && a.y[1] == 0.0 );
+	SOA_LENGTH(out, a);
+	for (int i = 0; i < n; ++i)
+		TEST( i == 1 || feq(out[i], 1.0, 1e-12) );
+
+	SOA_DESTROY(a);
+	SOA_DESTROY(b);
+	SOA_DESTROY(sum);
+}
+
 //-----------------------------------------------------------------------------
 // Span
 
@@ -300,6 +617,167 @@ TEST_CASE(slice_returns_partial_span)
 	TEST( str_slice( $("This string in 29 chars long."), -24, 16).length == 12 );
 }
 
+//-----------------------------------------------------------------------------
+// Numeric Reductions
+
+// Straightforward scalar versions to check the lane kernels against.
+static double ref_sum(nuspan s)
+{
+	double sum = 0.0;
+	for (int i = 0; i < s.length; ++i)
+		sum += s.p[i];
+	return sum;
+}
+static int ref_argmin(nuspan s)
+{
+	int at = -1;
+	for (int i = 0; i < s.length; ++i)
+		if (at < 0 || s.p[i] < s.p[at])
+			at = i;
+	return at;
+}
+static double ref_variance(nuspan s)
+{
+	double mean = ref_sum(s) / s.length, ss = 0.0;
+	for (int i = 0; i < s.length; ++i)
+		ss += (s.p[i] - mean) * (s.p[i] - mean);
+	return ss / (s.length - 1);
+}
+
+TEST_CASE(numeric_reductions_match_scalar_reference)
+{
+	enum { MAX_OFFSET = 2, MAX_LENGTH = 1001 };
+	double data[MAX_LENGTH + MAX_OFFSET];
+	for (int i = 0; i < (int)ARRAY_LENGTH(data); ++i)
+		data[i] = sin(i * 0.37) * 100.0 + (i % 7);
+
+	// Lengths and offsets step through all head/tail remainders.
+	for (int n = 1; n <= MAX_LENGTH; n += 37) {
+		for (int off = 0; off <= MAX_OFFSET; ++off) {
+			nuspan s = { .p = data + off, .length = n };
+			TEST( feq(num_sum(s),       ref_sum(s), 1e-9) );
+			TEST( feq(num_sum_kahan(s), ref_sum(s), 1e-9) );
+			TEST( num_argmin(s) == ref_argmin(s) );
+			TEST( num_min(s) == s.p[ref_argmin(s)] );
+			TEST( feq(num_mean(s), ref_sum(s) / n, 1e-9) );
+			if (n > 1)
+				TEST( feq(num_variance(s), ref_variance(s), 1e-6) );
+		}
+	}
+}
+
+TEST_CASE(numeric_reductions_of_small_spans)
+{
+	nuspan a = $N(3.0, -1.0, 7.5, -1.0, 2.0);
+	TEST( num_sum(a) == 10.5 );
+	TEST( num_min(a) == -1.0 );
+	TEST( num_max(a) ==  7.5 );
+	TEST( num_argmin(a) == 1 );
+	TEST( num_argmax(a) == 2 );
+	TEST( num_mean(a) == 2.1 );
+	TEST( num_dot(a, a) == 9.0 + 1.0 + 56.25 + 1.0 + 4.0 );
+
+	nuspan empty = { .p = NULL, .length = 0 };
+	TEST( num_sum(empty) == 0.0 );
+	TEST( num_min(empty) ==  INFINITY );
+	TEST( num_max(empty) == -INFINITY );
+	TEST( num_argmin(empty) == -1 );
+	TEST( isnan(num_mean(empty)) );
+	TEST( isnan(num_variance(empty)) );
+
+	nuspan gaps = $N(NAN, 4.0, NAN, 2.0, 8.0, NAN);
+	TEST( num_min(gaps) == 2.0 );
+	TEST( num_argmax(gaps) == 4 );
+}
+
+TEST_CASE(kahan_sum_compensates_rounding)
+{
+	double data[] = { 1.0, 1e100, 1.0, -1e100, 1.0, 1.0, 1.0, 1.0, 1.0 };
+	TEST( num_sum_kahan((nuspan)SPAN_INIT(data)) == 7.0 );
+}
+
+TEST_CASE(merge_partial_moments)
+{
+	nuspan a = $N(1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0, 10.0);
+	struct Moments whole = num_moments(a);
+	struct Moments parts = Moments_merge(num_moments(num_slice(a, 0, 3)),
+	                                     num_moments(num_slice(a, 4, -1)));
+	TEST( whole.count == 10 && parts.count == 10 );
+	TEST( feq(whole.mean, 5.5, 1e-12) && feq(parts.mean, 5.5, 1e-12) );
+	TEST( feq(Moments_variance(whole), 55.0 / 6.0, 1e-12) );
+	TEST( feq(Moments_variance(parts), 55.0 / 6.0, 1e-12) );
+}
+
+
+//-----------------------------------------------------------------------------
+// Iterators
+
+static bool   is_odd(int n)           { return n % 2; }
+static int    int_square(int n)       { return n * n; }
+static int    int_add(int a, int b)   { return a + b; }
+static double dec_mult(double a, int b) { return a * b; }
+static double dec_add(double a, double b) { return a + b; }
+
+ITER_FILTER_TEMPLATE(OddIter, RangeIter, int, is_odd)
+ITER_MAP_TEMPLATE(OddSquares, OddIter, int, int_square)
+ITER_TAKE_TEMPLATE(FirstOddSquares, OddSquares, int)
+ITER_REDUCE_TEMPLATE(sum_first_odd_squares, FirstOddSquares, int, int_add)
+
+ITER_ZIP_TEMPLATE(Scaled, NumIter, RangeIter, double, dec_mult)
+ITER_REDUCE_TEMPLATE(sum_scaled, Scaled, double, dec_add)
+
+typedef struct { int n; } Counter;
+static int     Counter_get(Counter c)  { return c.n; }
+static Counter Counter_next(Counter c) { return (Counter){ c.n + 1 }; }
+ITER_GENERATOR_TEMPLATE(Naturals, int, Counter, Counter_get, Counter_next)
+ITER_FILTER_TEMPLATE(OddNaturals, Naturals, int, is_odd)
+ITER_TAKE_TEMPLATE(FirstOddNaturals, OddNaturals, int)
+
+TEST_CASE(iterate_span_and_range)
+{
+	nuspan a = $N(1.5, 2.5, 3.5);
+	double total = 0.0;
+	ITER_FOREACH(NumIter, it, NumIter_begin(a.p, a.length))
+		total += NumIter_get(it);
+	TEST( total == 7.5 );
+
+	int count = 0;
+	ITER_FOREACH(NumIter, it, NumIter_begin(NULL, 10))
+		++count;
+	TEST( count == 0 );
+
+	int down[5], n = 0;
+	ITER_FOREACH(RangeIter, it, RangeIter_begin(10, 0, -2))
+		down[n++] = RangeIter_get(it);
+	TEST( n == 5 && down[0] == 10 && down[4] == 2 );
+}
+
+TEST_CASE(iterator_pipeline_stages)
+{
+	// 1 + 9 + 25 + 49: the first four odd squares below 100.
+	TEST( sum_first_odd_squares(
+	          FirstOddSquares_begin(OddSquares_begin(OddIter_begin(RangeIter_begin(0, 100, 1))), 4),
+	          0) == 84 );
+
+	// Zip stops at the shorter source.
+	nuspan a = $N(0.5, 0.5, 0.5, 0.5);
+	TEST( sum_scaled(Scaled_begin(NumIter_begin(a.p, a.length), RangeIter_begin(1, 3, 1)), 0.0) == 1.5 );
+
+	strand s = $("abc");
+	int chars = 0;
+	ITER_FOREACH(StrIter, it, StrIter_begin(s.p, s.length))
+		chars += StrIter_get(it) - 'a';
+	TEST( chars == 3 );
+}
+
+TEST_CASE(take_from_endless_generator)
+{
+	int odds[3], n = 0;
+	ITER_FOREACH(FirstOddNaturals, it, FirstOddNaturals_begin(OddNaturals_begin(Naturals_begin((Counter){0})), 3))
+		odds[n++] = FirstOddNaturals_get(it);
+	TEST( n == 3 );
+	TEST( odds[0] == 1 && odds[1] == 3 && odds[2] == 5 );
+}
 
 //=============================================================================
 // Experimental Stuff 
@@ -0,0 +1,32 @@
+// Built with every check above DEBUG_LEVEL_MIN compiled out, as by
+// -D DEBUG_LEVEL_CEILING=DEBUG_LEVEL_MIN; the tests all run in one
+// compiler invocation, so the ceiling is set here for this unit alone.
+#define DEBUG_LEVEL_CEILING  DEBUG_LEVEL_MIN
+
+#include "krclib.h"
+#include "test.h"
+
+//-----------------------------------------------------------------------------
+// Debug Level Ceiling
+
+TEST_CASE(ceiling_compiles_out_checks_above_it)
+{
+	TEST( DEBUG_LEVEL_COMPILED(DEBUG_LEVEL_MIN) );
+	TEST( !DEBUG_LEVEL_COMPILED(DEBUG_LEVEL_LOW) );
+	TEST( !DEBUG_LEVEL_COMPILED(WATCH_LEVEL) );
+}
+
+TEST_CASE(checks_above_ceiling_are_not_evaluated)
+{
+	int evaluated = 0;
+	PRECON((++evaluated, true), DEBUG_LEVEL_MIN);
+	TEST( evaluated == 1 );
+
+	PRECON((++evaluated, false), DEBUG_LEVEL_LOW);
+	PRECON((++evaluated, false), DEBUG_LEVEL_HIGH_9);
+	REQUIRE((++evaluated, false));
+	for (int i = 0; i < 4; ++i)
+		PRECON_SAMPLED(2, (++evaluated, false), DEBUG_LEVEL_MEDIUM);
+	WATCH_INT(++evaluated);
+	TEST( evaluated == 1 );
+}
@@ -0,0 +1,351 @@
+// For setenv and tzset.
+#define _POSIX_C_SOURCE 200809L
+
+#include "krclib.h"
+#include "test.h"
+#include <threads.h>
+
+//-----------------------------------------------------------------------------
+// Exceptions
+
+static void this_func_throws_up(struct except_frame *xf)
+{
+	except_try(xf, STATUS_ERROR, SRCSITE("throw"));
+}
+
+TEST_CASE(thrown_error_is_stored_in_frame)
+{
+	struct except_frame xf = {0};
+
+	switch (EXCEPT_BEGIN(xf)) 
+	{
+		case EXCEPT_TRY:
+			this_func_throws_up(&xf);
+			TEST(!"Exception not thrown");
+			break;
+		case STATUS_ERROR:
+			TEST(xf.error == &xf.record);
+			TEST(xf.error->status == STATUS_ERROR);
+			TEST(!strcmp(xf.error->source.file_name, "test_krclib.c"));
+			break;
+		default:
+			TEST(!"Wrong exception thrown");
+	}
+
+	except_dispose(&xf);
+	TEST(xf.error == NULL);
+}
+
+static void throw_if_negative(int n, struct except_frame *xf)
+{
+	EXCEPT_CHECK(xf, (n < 0) ? STATUS_ERROR : STATUS_OK);
+}
+
+static struct SourceSite *only_site_hit(const char *kind)
+{
+	struct SourceSite *hit = NULL;
+	for (struct SourceSite *site = SourceSite_first(); site; site = site->next)
+		if (!strcmp(site->kind, kind) && SourceSite_hits(site)) {
+			if (hit)
+				return NULL;
+			hit = site;
+		}
+	return hit;
+}
+
+TEST_CASE(throw_sites_count_their_throws)
+{
+	SourceSite_reset_all();
+	struct except_frame xf = {0};
+	for (int n = -3; n <= 3; ++n) {
+		switch (EXCEPT_BEGIN(xf))
+		{
+			case EXCEPT_TRY:
+				throw_if_negative(n, &xf);
+				break;
+			case STATUS_ERROR:
+				break;
+			default:
+				TEST(!"Wrong exception thrown");
+		}
+		except_dispose(&xf);
+	}
+
+	struct SourceSite *site = only_site_hit("throw");
+	TEST( site && !strcmp(site->location.file_name, "test_krclib.c") );
+	TEST( site && SourceSite_hits(site) == 3 );
+}
+
+TEST_CASE(checked_throws_count_in_the_site_registry)
+{
+	SourceSite_reset_all();
+	const struct SourceSite *here = SRCSITE("throw");
+	struct except_frame xf = {0};
+	for (int i = 0; i < 2; ++i) {
+		if (EXCEPT_BEGIN(xf) == EXCEPT_TRY)
+			try_size_mult(SIZE_MAX, 2, &xf, here);
+		except_dispose(&xf);
+	}
+
+	struct SourceSite *site = only_site_hit("throw");
+	TEST( site && SourceSite_hits(site) == 2 );
+	TEST( site == here );
+}
+
+//-----------------------------------------------------------------------------
+// Checked Results
+
+TEST_CASE(checked_results_chain_without_frames)
+{
+	struct size_result n = size_add_checked(size_mult_checked(size_checked(10), 20), 5);
+	TEST(n.status == STATUS_OK);
+	TEST(n.value == 205);
+
+	n = size_add_checked(size_mult_checked(size_checked(SIZE_MAX / 2), 3), 5);
+	TEST(n.status == STATUS_MATH_OVERFLOW);
+
+	struct int_result i = int_add_checked(int_mult_checked(int_checked(-7), 6), 2);
+	TEST(i.status == STATUS_OK);
+	TEST(i.value == -40);
+
+	TEST(int_mult_checked(int_checked(0), INT_MIN).status == STATUS_OK);
+	TEST(int_mult_checked(int_checked(INT_MAX), 2).status == STATUS_MATH_OVERFLOW);
+	TEST(int_add_checked(int_checked(INT_MIN), -1).status == STATUS_MATH_OVERFLOW);
+	TEST(ptrdiff_to_int_checked((ptrdiff_t)-INT_MAX - 100).status == STATUS_MATH_OVERFLOW);
+}
+
+TEST_CASE(checked_allocation)
+{
+	struct mem_result m = fam_alloc_checked(16, sizeof(int), 10);
+	TEST(m.status == STATUS_OK);
+	TEST(m.value != NULL);
+	free(m.value);
+
+	m = fam_alloc_checked(16, SIZE_MAX / 2, 4);
+	TEST(m.status == STATUS_MATH_OVERFLOW);
+	TEST(m.value == NULL);
+}
+
+//-----------------------------------------------------------------------------
+// Iterators
+
+struct item { int value; struct link link; };
+
+static int item_value(struct item *item)  { return item->value; }
+static int int_times(int a, int b)        { return a * b; }
+static int int_plus(int a, int b)         { return a + b; }
+
+ITER_SPAN_TEMPLATE(IntIter, int)
+ITER_CHAIN_TEMPLATE(ItemIter, struct item, link)
+ITER_MAP_TEMPLATE(ItemValues, ItemIter, int, item_value)
+ITER_ZIP_TEMPLATE(ItemsTimesInts, ItemValues, IntIter, int, int_times)
+ITER_REDUCE_TEMPLATE(sum_item_values, ItemValues, int, int_plus)
+ITER_REDUCE_TEMPLATE(sum_items_times_ints, ItemsTimesInts, int, int_plus)
+ITER_TAKE_TEMPLATE(FirstFibs, FibIter, int)
+
+TEST_CASE(chain_iterators_visit_linked_structs)
+{
+	Chain empty = CHAIN_INIT(empty);
+	TEST( ItemIter_done(ItemIter_begin(&empty)) );
+	TEST( sum_item_values(ItemValues_begin(ItemIter_begin(&empty)), 0) == 0 );
+
+	Chain chain = CHAIN_INIT(chain);
+	struct item a = { 1 }, b = { 20 }, c = { 300 };
+	Chain_append(&chain, &a.link);
+	Chain_append(&chain, &b.link);
+	Chain_append(&chain, &c.link);
+
+	int order[3], n = 0;
+	ITER_FOREACH(ItemIter, it, ItemIter_begin(&chain))
+		order[n++] = ItemIter_get(it)->value;
+	TEST( n == 3 && order[0] == 1 && order[1] == 20 && order[2] == 300 );
+	TEST( sum_item_values(ItemValues_begin(ItemIter_begin(&chain)), 0) == 321 );
+
+	// Chained into a zip, either side running dry first ends the zip.
+	int ints[] = { 2, 3 };
+	TEST( sum_items_times_ints(ItemsTimesInts_begin(ItemValues_begin(ItemIter_begin(&chain)),
+	                                                IntIter_begin(ints, 2)), 0) == 62 );
+	TEST( sum_items_times_ints(ItemsTimesInts_begin(ItemValues_begin(ItemIter_begin(&empty)),
+	                                                IntIter_begin(ints, 2)), 0) == 0 );
+	TEST( sum_items_times_ints(ItemsTimesInts_begin(ItemValues_begin(ItemIter_begin(&chain)),
+	                                                IntIter_begin(ints, 0)), 0) == 0 );
+}
+
+TEST_CASE(list_begin_iterates_list_elements)
+{
+	LIST(int) *list = NULL;
+	TEST( IntIter_done(LIST_BEGIN(IntIter, list)) );
+
+	for (int i = 1; i <= 4; ++i)
+		LIST_PUSH(list, i * i);
+	int total = 0, n = 0;
+	ITER_FOREACH(IntIter, it, LIST_BEGIN(IntIter, list))
+		total += IntIter_get(it), ++n;
+	TEST( n == 4 && total == 30 );
+	List_dispose(list);
+}
+
+TEST_CASE(fib_iter_generates_fibonacci_numbers)
+{
+	const int expected[] = { 0, 1, 1, 2, 3, 5, 8, 13, 21, 34 };
+	int got[10], n = 0;
+	ITER_FOREACH(FirstFibs, it, FirstFibs_begin(FibIter_begin(Fib_begin()), 10))
+		got[n++] = FirstFibs_get(it);
+	TEST( n == 10 );
+	TEST( !memcmp(got, expected, sizeof(expected)) );
+}
+
+//-----------------------------------------------------------------------------
+// Timestamps
+
+TEST_CASE(timestamp_iso_formats_utc)
+{
+	char text[TIMESTAMP_ISO_SIZE];
+	strbuf buf = STRBUF_INIT(text);
+	struct timespec t = { .tv_sec = 1000000000, .tv_nsec = 123456789 };
+
+	TEST(timestamp_iso(&buf, t, TIMESTAMP_MILLIS, false));
+	TEST(!strcmp(text, "2001-09-09T01:46:40.123Z"));
+
+	buf = STRBUF_INIT(text);
+	TEST(timestamp_iso(&buf, t, TIMESTAMP_MICROS, false));
+	TEST(!strcmp(text, "2001-09-09T01:46:40.123456Z"));
+
+	buf = STRBUF_INIT(text);
+	t = (struct timespec){ .tv_sec = 951825600 };
+	TEST(timestamp_iso(&buf, t, TIMESTAMP_SECONDS, false));
+	TEST(!strcmp(text, "2000-02-29T12:00:00Z"));
+
+	char small[8];
+	buf = STRBUF_INIT(small);
+	TEST(!timestamp_iso(&buf, t, TIMESTAMP_SECONDS, false));
+	TEST(strbuf_length(&buf) == 0);
+}
+
+TEST_CASE(timestamp_iso_formats_local_offsets)
+{
+	char *saved = getenv("TZ");
+	char zone[64] = "";
+	if (saved)
+		snprintf(zone, sizeof(zone), "%s", saved);
+	setenv("TZ", "XYZ-2", 1);
+	tzset();
+
+	char text[TIMESTAMP_ISO_SIZE];
+	strbuf buf = STRBUF_INIT(text);
+	struct timespec t = { .tv_sec = 1000000000 };
+	TEST(timestamp_iso(&buf, t, TIMESTAMP_SECONDS, true));
+	TEST(!strcmp(text, "2001-09-09T03:46:40+02:00"));
+
+	if (saved)
+		setenv("TZ", zone, 1);
+	else
+		unsetenv("TZ");
+	tzset();
+}
+
+TEST_CASE(timestamp_now_reads_the_coarse_clock)
+{
+	struct timespec fine, coarse = timestamp_now(true);
+	timespec_get(&fine, TIME_UTC);
+	TEST( coarse.tv_sec > 0 );
+	TEST( fine.tv_sec - coarse.tv_sec <= 1 );
+}
+
+TEST_CASE(timestamp_parse_iso_reads_zones_and_fractions)
+{
+	struct time_result r = timestamp_parse_iso($("2001-09-09T01:46:40.123456789Z"));
+	TEST(r.status == STATUS_OK);
+	TEST(r.value.tv_sec == 1000000000 && r.value.tv_nsec == 123456789);
+
+	r = timestamp_parse_iso($("2001-09-09 03:46:40.5+02:00"));
+	TEST(r.status == STATUS_OK);
+	TEST(r.value.tv_sec == 1000000000 && r.value.tv_nsec == 500000000);
+
+	r = timestamp_parse_iso($("2001-09-08T20:46:40-0500"));
+	TEST(r.status == STATUS_OK && r.value.tv_sec == 1000000000);
+
+	TEST(timestamp_parse_iso($("2000-02-29T00:00:00Z")).status == STATUS_OK);
+	TEST(timestamp_parse_iso($("2001-02-29T00:00:00Z")).status == STATUS_PARSE_FAIL);
+	TEST(timestamp_parse_iso($("2001-09-09T01:46:40")).status == STATUS_PARSE_FAIL);
+	TEST(timestamp_parse_iso($("2001-09-09T01:46:4aZ")).status == STATUS_PARSE_FAIL);
+	TEST(timestamp_parse_iso($("2001-09-09T01:46:40Z junk")).status == STATUS_PARSE_FAIL);
+
+	TEST(timestamp_parse_iso($("2001-09-09T06:46:40+05")).value.tv_sec == 1000000000);
+	TEST(timestamp_parse_iso($("2001-09-09T06:46:40+05:")).status == STATUS_PARSE_FAIL);
+	TEST(timestamp_parse_iso($("2001-09-09T06:46:40+05:3")).status == STATUS_PARSE_FAIL);
+}
+
+TEST_CASE(timestamp_parse_reads_timestamp_format)
+{
+	struct time_result r = timestamp_parse($("2001-09-09 01.46.40 UTC"), 3600);
+	TEST(r.status == STATUS_OK && r.value.tv_sec == 1000000000);
+
+	r = timestamp_parse($("2001-09-09 02.46.40 CET"), 3600);
+	TEST(r.status == STATUS_OK && r.value.tv_sec == 1000000000);
+
+	TEST(timestamp_parse($("2001-09-09 02:46:40 UTC"), 0).status == STATUS_PARSE_FAIL);
+}
+
+static int timestamp_in_thread(void *unused)
+{
+	UNUSED(unused);
+	char text[TIMESTAMP_ISO_SIZE];
+	strbuf buf = STRBUF_INIT(text);
+	struct timespec t = { .tv_sec = 951825600 };
+	return timestamp_iso(&buf, t, TIMESTAMP_SECONDS, false)
+	    && !strcmp(text, "2000-02-29T12:00:00Z");
+}
+
+TEST_CASE(timestamp_iso_caches_per_thread)
+{
+	char text[TIMESTAMP_ISO_SIZE];
+	strbuf buf = STRBUF_INIT(text);
+	struct timespec t = { .tv_sec = 1000000000 };
+	TEST(timestamp_iso(&buf, t, TIMESTAMP_SECONDS, false));
+
+	thrd_t thread;
+	int formatted = 0;
+	TEST( thrd_create(&thread, timestamp_in_thread, NULL) == thrd_success );
+	thrd_join(thread, &formatted);
+	TEST( formatted );
+
+	buf = STRBUF_INIT(text);
+	TEST(timestamp_iso(&buf, t, TIMESTAMP_SECONDS, false));
+	TEST(!strcmp(text, "2001-09-09T01:46:40Z"));
+}
+
+//-----------------------------------------------------------------------------
+// Debug Levels
+
+static int volume_in_thread(void *unused)
+{
+	UNUSED(unused);
+	enum debug_level inherited = debug_volume();
+	debug_set_volume(DEBUG_LEVEL_HIGH_3);
+	return inherited == debug_volume() ? -1 : (int)debug_volume();
+}
+
+TEST_CASE(debug_volume_is_per_thread)
+{
+	debug_set_volume(DEBUG_LEVEL_LOW_2);
+	thrd_t t;
+	int thread_volume = -1;
+	TEST( thrd_create(&t, volume_in_thread, NULL) == thrd_success );
+	thrd_join(t, &thread_volume);
+
+	TEST( thread_volume == DEBUG_LEVEL_HIGH_3 );
+	TEST( debug_volume() == DEBUG_LEVEL_LOW_2 );
+	debug_set_volume(DEBUG_LEVEL_MEDIUM);
+}
+
+// test_krceiling.c covers checks above a lowered ceiling.
+TEST_CASE(checks_below_ceiling_are_evaluated)
+{
+	int evaluated = 0;
+	PRECON((++evaluated, true), DEBUG_LEVEL_MIN);
+	TEST( evaluated == 1 );
+
+	PRECON((++evaluated, true), DEBUG_LEVEL_HIGH_9);
+	TEST( evaluated == (DEBUG_LEVEL_COMPILED(DEBUG_LEVEL_HIGH_9) ? 2 : 1) );
+}
@@ -0,0 +1,370 @@
+#include "krgrid.h"
+#include "test.h"
+
+//-----------------------------------------------------------------------------
+// Grid
+
+static struct Grid *numbered_grid(int nrows, int ncols, enum GridLayout layout)
+{
+	struct Grid *grid = Grid_create(nrows, ncols, sizeof(int), layout);
+	for (int row = 0; row < nrows; ++row)
+		for (int col = 0; col < ncols; ++col)
+			GRID_AT(int, grid, row, col) = row * 100 + col;
+	return grid;
+}
+
+TEST_CASE(grid_layouts_map_cells_one_to_one)
+{
+	for (enum GridLayout layout = 0; layout < GRID_LAYOUT_COUNT; ++layout) {
+		struct Grid *grid = numbered_grid(13, 21, layout);
+		TEST( grid && grid->capacity >= 13 * 21 );
+
+		static bool used[32 * 32];
+		memset(used, 0, sizeof(used));
+		bool distinct = true, values_ok = true;
+		for (int row = 0; row < 13; ++row)
+			for (int col = 0; col < 21; ++col) {
+				int offset = Grid_offset(grid, row, col);
+				distinct &= 0 <= offset && offset < grid->capacity && !used[offset];
+				used[offset] = true;
+				values_ok &= GRID_AT(int, grid, row, col) == row * 100 + col;
+			}
+		TEST( distinct );
+		TEST( values_ok );
+		TEST( GRID_AT(int, grid, -1, -1) == 12 * 100 + 20 );
+		Grid_destroy(grid);
+	}
+}
+
+TEST_CASE(grid_morton_and_tiled_keep_neighbours_close)
+{
+	struct Grid *morton = Grid_create(64, 64, sizeof(int), GRID_MORTON);
+	TEST( Grid_offset(morton, 0, 0) == 0 );
+	TEST( Grid_offset(morton, 0, 1) == 1 );
+	TEST( Grid_offset(morton, 1, 0) == 2 );
+	TEST( Grid_offset(morton, 1, 1) == 3 );
+	TEST( Grid_offset(morton, 2, 0) == 8 );
+	Grid_destroy(morton);
+
+	struct Grid *tiled = Grid_create(64, 64, sizeof(int), GRID_TILED);
+	TEST( Grid_offset(tiled, 1, 0) == GRID_TILE );
+	TEST( Grid_offset(tiled, 0, GRID_TILE) == GRID_TILE * GRID_TILE );
+	Grid_destroy(tiled);
+
+	struct Grid *wide = Grid_create(3, 40, sizeof(int), GRID_MORTON);
+	TEST( wide->capacity == 4 * 64 );
+	Grid_destroy(wide);
+}
+
+TEST_CASE(grid_cell_is_null_outside)
+{
+	struct Grid *grid = numbered_grid(4, 5, GRID_TILED);
+	struct GridPos p = { 3, 4 };
+	TEST( Grid_includes(grid, p) );
+	TEST( *(int*)Grid_cell(grid, p) == 304 );
+	TEST( Grid_cell(grid, GridPos_below(p)) == NULL );
+	TEST( Grid_cell(grid, GridPos_after(p)) == NULL );
+	TEST( *(int*)Grid_cell(grid, GridPos_above(GridPos_before(p))) == 203 );
+	TEST( Grid_cell(grid, (struct GridPos){ -1, 0 }) == NULL );
+	Grid_destroy(grid);
+}
+
+TEST_CASE(grid_row_spans_row_major_rows)
+{
+	struct Grid *grid = numbered_grid(4, 5, GRID_ROW_MAJOR);
+	TEST( Grid_nrows(grid) == 4 && Grid_ncols(grid) == 5 );
+
+	GridSpan row = Grid_row(grid, -2);
+	int *cells = row.p;
+	TEST( row.length == 5 );
+	TEST( cells[0] == 200 && cells[4] == 204 );
+	Grid_destroy(grid);
+
+	grid = numbered_grid(4, 5, GRID_TILED);
+	row = Grid_row(grid, 1);
+	TEST( row.p == NULL && row.length == 0 );
+	Grid_destroy(grid);
+}
+
+TEST_CASE(grid_create_rejects_bad_sizes)
+{
+	TEST( Grid_create(-1, 4, sizeof(int), GRID_ROW_MAJOR) == NULL );
+	TEST( Grid_create(1 << 20, 1 << 20, sizeof(int), GRID_ROW_MAJOR) == NULL );
+	TEST( Grid_create(1 << 16, (1 << 15) + 1, sizeof(int), GRID_MORTON) == NULL );
+	TEST( Grid_create(4, 4, 0, GRID_TILED) == NULL );
+
+	struct Grid *empty = Grid_create(0, 0, sizeof(int), GRID_TILED);
+	TEST( empty && empty->capacity == 0 );
+	Grid_destroy(empty);
+}
+
+TEST_CASE(grid_iterators_visit_rows_columns_and_tiles)
+{
+	for (enum GridLayout layout = 0; layout < GRID_LAYOUT_COUNT; ++layout) {
+		struct Grid *grid = numbered_grid(19, 11, layout);
+
+		int count = 0, sum = 0;
+		ITER_FOREACH(GridRowIter, it, GridRowIter_begin(grid, 5))
+			++count, sum += *(int*)GridRowIter_get(it);
+		TEST( count == 11 && sum == 11 * 500 + 55 );
+
+		count = sum = 0;
+		ITER_FOREACH(GridColIter, it, GridColIter_begin(grid, -1))
+			++count, sum += *(int*)GridColIter_get(it);
+		TEST( count == 19 && sum == 100 * 171 + 19 * 10 );
+
+		long total = 0;
+		count = 0;
+		ITER_FOREACH(GridTileIter, t, GridTileIter_begin(grid))
+			ITER_FOREACH(GridRectIter, c, GridRectIter_begin(grid, GridTileIter_get(t))) {
+				struct GridPos p = GridRectIter_pos(c);
+				total += *(int*)GridRectIter_get(c) == p.row * 100 + p.col;
+				++count;
+			}
+		TEST( count == 19 * 11 && total == count );
+
+		Grid_destroy(grid);
+	}
+}
+
+TEST_CASE(grid_fill_and_relayout)
+{
+	struct Grid *grid = numbered_grid(9, 10, GRID_ROW_MAJOR);
+	struct Grid *morton = Grid_relayout(grid, GRID_MORTON);
+	TEST( morton->layout == GRID_MORTON );
+	TEST( GRID_AT(int, morton, 8, 9) == 809 );
+	TEST( !strcmp(GridLayout_name(morton->layout), "morton") );
+
+	int seven = 7;
+	Grid_fill(morton, &seven);
+	TEST( GRID_AT(int, morton, 4, 4) == 7 );
+
+	Grid_destroy(morton);
+	Grid_destroy(grid);
+}
+
+//-----------------------------------------------------------------------------
+// Grid Files
+
+TEST_CASE(grid_save_and_open_mapped)
+{
+	const char *path = "test_krgrid.tmp";
+	for (enum GridLayout layout = 0; layout < GRID_LAYOUT_COUNT; ++layout) {
+		struct Grid *grid = numbered_grid(37, 70, layout);
+		TEST( Grid_save(grid, path) );
+
+		struct Grid *mapped = Grid_open_mapped(path);
+		TEST( mapped && (uintptr_t)mapped->cells % GRID_FILE_ALIGN == 0 );
+		TEST( mapped->nrows == 37 && mapped->ncols == 70 && mapped->layout == layout );
+		TEST( GRID_AT(int, mapped, 36, 69) == 3669 );
+		TEST( !memcmp(mapped->cells, grid->cells, (size_t)grid->capacity * sizeof(int)) );
+
+		GRID_AT(int, mapped, 0, 0) = -1;
+		Grid_close_mapped(mapped);
+		mapped = Grid_open_mapped(path);
+		TEST( GRID_AT(int, mapped, 0, 0) == 0 );
+		Grid_close_mapped(mapped);
+		Grid_destroy(grid);
+	}
+
+	FILE *file = fopen(path, "wb");
+	fputs("not a grid", file);
+	fclose(file);
+	TEST( Grid_open_mapped(path) == NULL );
+	remove(path);
+	TEST( Grid_open_mapped(path) == NULL );
+}
+
+//-----------------------------------------------------------------------------
+// Grid Sums
+
+static long long rect_total(struct Grid *grid, struct GridRect r)
+{
+	long long total = 0;
+	ITER_FOREACH(GridRectIter, it, GridRectIter_begin(grid, r))
+		total += *(int*)GridRectIter_get(it);
+	return total;
+}
+
+TEST_CASE(grid_sums_match_rescans)
+{
+	const struct GridRect rects[] = {
+		{0, 0, 37, 70}, {3, 5, 4, 6}, {10, 20, 30, 69}, {-5, -5, 2, 100}, {8, 8, 8, 20}, {40, 0, 50, 5} };
+
+	for (enum GridLayout layout = 0; layout < GRID_LAYOUT_COUNT; ++layout)
+		for (int threads = 1; threads <= 7; threads += 3) {
+			struct Grid *grid = numbered_grid(37, 70, layout);
+			GRID_AT(int, grid, 5, 5) = -1000000;
+			struct GridSums *sums = GridSums_create(grid, GRID_INT, threads);
+
+			bool all_match = true;
+			for (int i = 0; i < (int)ARRAY_LENGTH(rects); ++i)
+				all_match &= GridSums_rect_int(sums, rects[i]) == rect_total(grid, rects[i]);
+			TEST( all_match );
+			TEST( feq(GridSums_mean(sums, (struct GridRect){2, 3, 4, 5}), 253.5, 1e-12) );
+			TEST( GridSums_mean(sums, rects[5]) == 0.0 );
+
+			GridSums_destroy(sums);
+			Grid_destroy(grid);
+		}
+
+	struct Grid *heat = Grid_create(5, 9, sizeof(double), GRID_TILED);
+	double half = 0.5;
+	Grid_fill(heat, &half);
+	struct GridSums *sums = GridSums_create(heat, GRID_DOUBLE, 2);
+	TEST( feq(GridSums_rect_double(sums, (struct GridRect){1, 1, 4, 9}), 12.0, 1e-12) );
+	GridSums_destroy(sums);
+	TEST( GridSums_create(heat, GRID_INT, 1) == NULL );
+	Grid_destroy(heat);
+}
+
+TEST_CASE(grid_fenwick_follows_point_updates)
+{
+	struct Grid *grid = numbered_grid(19, 33, GRID_MORTON);
+	struct GridFenwick *fenwick = GridFenwick_create(grid, GRID_INT);
+	TEST( GridFenwick_rect_int(fenwick, (struct GridRect){0, 0, 19, 33}) == rect_total(grid, (struct GridRect){0, 0, 19, 33}) );
+
+	bool all_match = true;
+	for (int i = 0; i < 200; ++i) {
+		struct GridPos p = { i * 7 % 19, i * 13 % 33 };
+		int delta = i % 5 - 2;
+		GRID_AT(int, grid, p.row, p.col) += delta;
+		GridFenwick_add_int(fenwick, p, delta);
+
+		struct GridRect r = { i % 19, i * 3 % 33, i % 19 + 6, i * 3 % 33 + 11 };
+		all_match &= GridFenwick_rect_int(fenwick, r) == rect_total(grid, r);
+	}
+	TEST( all_match );
+	GridFenwick_destroy(fenwick);
+	Grid_destroy(grid);
+
+	struct Grid *heat = Grid_create(4, 4, sizeof(double), GRID_ROW_MAJOR);
+	struct GridFenwick *f = GridFenwick_create(heat, GRID_DOUBLE);
+	GridFenwick_add_double(f, (struct GridPos){-1, -1}, 2.5);
+	GridFenwick_add_double(f, (struct GridPos){1, 2}, 0.25);
+	TEST( feq(GridFenwick_rect_double(f, (struct GridRect){1, 1, 4, 4}), 2.75, 1e-12) );
+	TEST( GridFenwick_rect_double(f, (struct GridRect){0, 0, 1, 4}) == 0.0 );
+	GridFenwick_destroy(f);
+	Grid_destroy(heat);
+}
+
+static bool count_failure(void *count, struct SourceLocation source, const char *format, ...)
+{
+	UNUSED(source), UNUSED(format);
+	++*(int*)count;
+	return false;
+}
+
+TEST_CASE(grid_fenwick_ignores_positions_outside)
+{
+	struct Grid *grid = numbered_grid(5, 6, GRID_ROW_MAJOR);
+	struct GridFenwick *fenwick = GridFenwick_create(grid, GRID_INT);
+	struct GridRect all = { 0, 0, 5, 6 };
+	int64_t total = GridFenwick_rect_int(fenwick, all);
+
+	int failures = 0;
+	AssertHandler_push(&(struct AssertHandler){ count_failure, &failures });
+	GridFenwick_add_int(fenwick, (struct GridPos){5, 0}, 1);
+	GridFenwick_add_int(fenwick, (struct GridPos){-6, 0}, 1);
+	GridFenwick_add_int(fenwick, (struct GridPos){0, -7}, 1);
+	GridFenwick_add_double(fenwick, (struct GridPos){0, 0}, 1.0);
+	AssertHandler_pop();
+
+	TEST( failures == 4 );
+	TEST( GridFenwick_rect_int(fenwick, all) == total );
+	GridFenwick_destroy(fenwick);
+	Grid_destroy(grid);
+}
+
+//-----------------------------------------------------------------------------
+// Stencil Engine
+
+static void set_life(struct Stencil *s, const char *rows[])
+{
+	for (int r = 0; r < s->nrows; ++r)
+		for (int c = 0; c < s->ncols; ++c)
+			*(unsigned char*)Stencil_at(s, r, c) = rows[r][c] == '#';
+}
+
+static bool life_is(struct Stencil *s, const char *rows[])
+{
+	bool same = true;
+	for (int r = 0; r < s->nrows; ++r)
+		for (int c = 0; c < s->ncols; ++c)
+			same &= *(unsigned char*)Stencil_at(s, r, c) == (rows[r][c] == '#');
+	return same;
+}
+
+TEST_CASE(stencil_life_blinker_with_fixed_border)
+{
+	const char *vertical[]   = { ".#...", ".#...", ".#...", ".....", "....." };
+	const char *horizontal[] = { ".....", "###..", ".....", ".....", "....." };
+
+	struct Stencil *s = Stencil_create(5, 5, 1, STENCIL_FIXED);
+	set_life(s, vertical);
+	Stencil_step(s, Stencil_life_row, NULL, 1);
+	TEST( life_is(s, horizontal) );
+	Stencil_step(s, Stencil_life_row, NULL, 3);
+	TEST( life_is(s, vertical) );
+	Stencil_destroy(s);
+}
+
+TEST_CASE(stencil_life_glider_wraps_around_torus)
+{
+	const char *glider[] = {
+		".#......", "..#.....", "###.....", "........",
+		"........", "........", "........", "........" };
+
+	for (int threads = 1; threads <= 4; threads += 3) {
+		struct Stencil *s = Stencil_create(8, 8, 1, STENCIL_WRAP);
+		set_life(s, glider);
+		for (int step = 0; step < 32; ++step)
+			Stencil_step(s, Stencil_life_row, NULL, threads);
+		TEST( life_is(s, glider) );
+		Stencil_destroy(s);
+	}
+}
+
+TEST_CASE(stencil_workers_persist_across_changing_thread_counts)
+{
+	const char *glider[] = {
+		".#......", "..#.....", "###.....", "........",
+		"........", "........", "........", "........" };
+	const int threads[] = { 4, 2, 6, 1, 3, 8 };
+
+	struct Stencil *s = Stencil_create(8, 8, 1, STENCIL_WRAP);
+	set_life(s, glider);
+	Stencil_step(s, Stencil_life_row, NULL, 4);
+	struct StencilPool *pool = s->pool;
+	TEST( pool != NULL );
+	for (int step = 1; step < 32; ++step)
+		Stencil_step(s, Stencil_life_row, NULL, threads[step % 6]);
+	TEST( s->pool == pool );
+	TEST( life_is(s, glider) );
+	Stencil_destroy(s);
+}
+
+TEST_CASE(stencil_laplacian_conserves_heat_on_torus)
+{
+	struct Stencil *s = Stencil_create(16, 24, sizeof(double), STENCIL_WRAP);
+	*(double*)Stencil_at(s, 3, 5) = 100.0;
+	*(double*)Stencil_at(s, -1, -1) = 50.0;
+
+	double alpha = 0.2;
+	for (int step = 0; step < 50; ++step)
+		Stencil_step(s, Stencil_laplacian_row, &alpha, 2);
+
+	double total = 0.0, peak = 0.0;
+	for (int r = 0; r < 16; ++r)
+		for (int c = 0; c < 24; ++c) {
+			double x = *(double*)Stencil_at(s, r, c);
+			total += x;
+			peak = x > peak ? x : peak;
+		}
+	TEST( feq(total, 150.0, 1e-9) );
+	TEST( peak < 50.0 );
+	Stencil_destroy(s);
+
+	TEST( Stencil_create(0, 4, 1, STENCIL_FIXED) == NULL );
+	TEST( Stencil_create(4, 4, STENCIL_ALIGN + 1, STENCIL_FIXED) == NULL );
+}
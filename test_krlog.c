@@ -0,0 +1,139 @@
+#include "krlog.h"
+#include "test.h"
+#include <threads.h>
+#include <stdatomic.h>
+
+//-----------------------------------------------------------------------------
+// Asynchronous Log
+
+static int count_lines(FILE *f, const char *needle)
+{
+	char line[256];
+	int count = 0;
+	rewind(f);
+	while (fgets(line, sizeof(line), f))
+		count += strstr(line, needle) != NULL;
+	return count;
+}
+
+enum { WORKERS = 4, LINES_PER_WORKER = 2000 };
+
+static FILE *log_file;
+
+static int log_worker(void *arg)
+{
+	int id = *(int*)arg;
+	for (int i = 0; i < LINES_PER_WORKER; ++i)
+		debug_print(log_file, SRCLOC, "worker %d line %d", id, i);
+	return 0;
+}
+
+TEST_CASE(async_log_keeps_every_line_when_blocking)
+{
+	log_file = tmpfile();
+	TEST( log_file );
+	TEST( Log_start((struct LogOptions){ .policy=LOG_BLOCK, .flush_ms=1 }) );
+
+	thrd_t threads[WORKERS];
+	int ids[WORKERS];
+	for (int i = 0; i < WORKERS; ++i) {
+		ids[i] = i;
+		thrd_create(&threads[i], log_worker, &ids[i]);
+	}
+	for (int i = 0; i < WORKERS; ++i)
+		thrd_join(threads[i], NULL);
+	Log_stop();
+
+	TEST( count_lines(log_file, "worker ") == WORKERS * LINES_PER_WORKER );
+	TEST( count_lines(log_file, "worker 3 line 1999\n") == 1 );
+	TEST( count_lines(log_file, "test_krlog.c:") == WORKERS * LINES_PER_WORKER );
+	fclose(log_file);
+}
+
+TEST_CASE(async_log_replays_captured_arguments)
+{
+	FILE *f = tmpfile();
+	TEST( Log_start((struct LogOptions){ .policy=LOG_BLOCK }) );
+
+	char name[] = "alpha";
+	debug_print(f, SRCLOC, "%s|%-6s|%.3s|%*d|%.*f|%c|%%|%zu|%lld|%x",
+		name, "ab", "abcdef", 4, 7, 2, 3.14159, 'z', (size_t)42, -5LL, 255u);
+	name[0] = 'X';      // the record must hold its own copy
+	Log_flush();
+	debug_print(f, SRCLOC, "%d %d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6, 7, 8, 9);
+	Log_stop();
+
+	TEST( count_lines(f, ": alpha|ab    |abc|   7|3.14|z|%|42|-5|ff\n") == 1 );
+	TEST( count_lines(f, ": 1 2 3 4 5 6 7 8 9\n") == 1 );
+	fclose(f);
+}
+
+TEST_CASE(async_log_copies_formats_from_temporary_buffers)
+{
+	FILE *f = tmpfile();
+	TEST( Log_start((struct LogOptions){ .policy=LOG_BLOCK, .flush_ms=60000 }) );
+
+	char format[32];
+	for (int i = 0; i < 3; ++i) {
+		snprintf(format, sizeof(format), "pass %d of %%d", i);
+		debug_print(f, SRCLOC, format, 3);
+	}
+	strcpy(format, "overwritten %d");
+	Log_stop();
+
+	TEST( count_lines(f, ": pass 0 of 3\n") == 1 );
+	TEST( count_lines(f, ": pass 2 of 3\n") == 1 );
+	TEST( count_lines(f, "overwritten") == 0 );
+	fclose(f);
+}
+
+TEST_CASE(async_log_counts_dropped_lines)
+{
+	FILE *f = tmpfile();
+	TEST( Log_start((struct LogOptions){ .policy=LOG_DROP, .flush_ms=60000 }) );
+
+	unsigned long before = Log_dropped();
+	int total = 3 * LOG_RING_SLOTS;
+	for (int i = 0; i < total; ++i)
+		debug_print(f, SRCLOC, "line %d", i);
+	unsigned long dropped = Log_dropped() - before;
+	Log_stop();
+
+	TEST( dropped > 0 );
+	TEST( count_lines(f, "line ") + (int)dropped == total );
+	fclose(f);
+}
+
+static atomic_int dropping_state;    // 0 logging, 1 done logging, 2 may exit
+
+static int dropping_worker(void *arg)
+{
+	FILE *f = arg;
+	for (int i = 0; i < 3 * LOG_RING_SLOTS; ++i)
+		debug_print(f, SRCLOC, "line %d", i);
+	atomic_store(&dropping_state, 1);
+	while (atomic_load(&dropping_state) != 2)
+		thrd_yield();
+	return 0;
+}
+
+TEST_CASE(log_dropped_after_stop_counts_other_threads)
+{
+	FILE *f = tmpfile();
+	TEST( Log_start((struct LogOptions){ .policy=LOG_DROP, .flush_ms=60000 }) );
+	unsigned long before = Log_dropped();
+
+	atomic_store(&dropping_state, 0);
+	thrd_t worker;
+	thrd_create(&worker, dropping_worker, f);
+	while (atomic_load(&dropping_state) != 1)
+		thrd_yield();
+	Log_stop();
+	unsigned long dropped = Log_dropped() - before;
+	atomic_store(&dropping_state, 2);
+	thrd_join(worker, NULL);
+
+	TEST( dropped > 0 );
+	TEST( count_lines(f, "line ") + (int)dropped == 3 * LOG_RING_SLOTS );
+	fclose(f);
+}
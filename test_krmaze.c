@@ -0,0 +1,373 @@
+#include "krmaze.h"
+#include "test.h"
+
+//-----------------------------------------------------------------------------
+// Maze
+
+TEST_CASE(maze_link_opens_wall_from_both_sides)
+{
+	struct Maze *maze = Maze_create(3, 40);
+	TEST( maze && maze->row_words == 2 );
+	TEST( Maze_passages(maze, (struct GridPos){1, 1}) == 0 );
+
+	TEST( Maze_link(maze, (struct GridPos){1, 1}, (struct GridPos){0, 1}) );
+	TEST( Maze_link(maze, (struct GridPos){1, 1}, (struct GridPos){1, 2}) );
+	TEST( Maze_link(maze, (struct GridPos){1, 0}, (struct GridPos){1, 1}) );
+	TEST( Maze_passages(maze, (struct GridPos){1, 1}) == (MAZE_NORTH | MAZE_EAST | MAZE_WEST) );
+	TEST( Maze_passages(maze, (struct GridPos){0, 1}) == MAZE_SOUTH );
+	TEST( Maze_passages(maze, (struct GridPos){1, 2}) == MAZE_WEST );
+	TEST( Maze_open(maze, (struct GridPos){1, 0}, MAZE_EAST) );
+	TEST( !Maze_open(maze, (struct GridPos){1, 0}, MAZE_SOUTH) );
+
+	// Cells on either side of a word boundary, and negative indexes.
+	TEST( Maze_link(maze, (struct GridPos){2, 31}, (struct GridPos){2, 32}) );
+	TEST( Maze_passages(maze, (struct GridPos){2, 31}) == MAZE_EAST );
+	TEST( Maze_passages(maze, (struct GridPos){-1, 32}) == MAZE_WEST );
+	TEST( Maze_link(maze, (struct GridPos){2, 39}, (struct GridPos){1, 39}) );
+	TEST( Maze_open(maze, (struct GridPos){-1, -1}, MAZE_NORTH) );
+
+	TEST( MazeDir_step((struct GridPos){1, 1}, MAZE_WEST).col == 0 );
+	TEST( MazeDir_step((struct GridPos){1, 1}, MAZE_SOUTH).row == 2 );
+
+	Maze_clear(maze);
+	TEST( Maze_passages(maze, (struct GridPos){1, 1}) == 0 );
+	Maze_destroy(maze);
+}
+
+TEST_CASE(maze_link_rejects_non_neighbours)
+{
+	struct Maze *maze = Maze_create(4, 4);
+	TEST( !Maze_link(maze, (struct GridPos){0, 0}, (struct GridPos){1, 1}) );
+	TEST( !Maze_link(maze, (struct GridPos){0, 0}, (struct GridPos){0, 2}) );
+	TEST( !Maze_link(maze, (struct GridPos){2, 2}, (struct GridPos){2, 2}) );
+	TEST( !Maze_link(maze, (struct GridPos){0, 3}, (struct GridPos){0, 4}) );
+	TEST( !Maze_link(maze, (struct GridPos){0, 0}, (struct GridPos){-1, 0}) );
+	for (int row = 0; row < 4; ++row)
+		for (int col = 0; col < 4; ++col)
+			TEST( Maze_passages_unchecked(maze, row, col) == 0 );
+	Maze_destroy(maze);
+
+	TEST( Maze_create(0, 5) == NULL );
+	TEST( Maze_size(10000, 10000) < 26 * 1000 * 1000 );
+}
+
+TEST_CASE(maze_pack_converts_linked_cells)
+{
+	struct Grid *cells = MazeCell_grid_create(2, 3);
+	TEST( cells );
+	struct MazeCell *c00 = Grid_at(cells, 0, 0), *c01 = Grid_at(cells, 0, 1),
+	                *c02 = Grid_at(cells, 0, 2), *c11 = Grid_at(cells, 1, 1);
+	MazeCell_link(c01, c00);
+	MazeCell_link(c01, c02);
+	MazeCell_link(c11, c01);
+	MazeCell_link(c00, c11);          // not neighbours: ignored
+	TEST( c00->east == c01 && c01->west == c00 );
+	TEST( c01->south == c11 && c11->north == c01 );
+	TEST( !c00->south && !c11->west );
+
+	struct Maze *maze = Maze_pack(cells);
+	TEST( maze && maze->nrows == 2 && maze->ncols == 3 );
+	TEST( Maze_passages(maze, (struct GridPos){0, 0}) == MAZE_EAST );
+	TEST( Maze_passages(maze, (struct GridPos){0, 1}) == (MAZE_WEST | MAZE_EAST | MAZE_SOUTH) );
+	TEST( Maze_passages(maze, (struct GridPos){0, 2}) == MAZE_WEST );
+	TEST( Maze_passages(maze, (struct GridPos){1, 0}) == 0 );
+	TEST( Maze_passages(maze, (struct GridPos){1, 1}) == MAZE_NORTH );
+	TEST( Maze_passages(maze, (struct GridPos){1, 2}) == 0 );
+
+	Maze_destroy(maze);
+	Grid_destroy(cells);
+}
+
+// True when the open walls form a spanning tree: one fewer passage than
+// cells, and every cell reachable from the first.
+static bool maze_is_perfect(const struct Maze *maze)
+{
+	int cells = maze->nrows * maze->ncols, passages = 0;
+	int *parent = malloc(cells * sizeof(int));
+	for (int i = 0; i < cells; ++i)
+		parent[i] = i;
+
+	int components = cells;
+	for (int row = 0; row < maze->nrows; ++row)
+		for (int col = 0; col < maze->ncols; ++col) {
+			unsigned open = Maze_passages_unchecked(maze, row, col);
+			for (int d = 0; d < 2; ++d) {
+				if (!(open & (d ? MAZE_SOUTH : MAZE_EAST)))
+					continue;
+				++passages;
+				int a = row * maze->ncols + col, b = a + (d ? maze->ncols : 1);
+				while (parent[a] != a)  a = parent[a];
+				while (parent[b] != b)  b = parent[b];
+				if (a != b)
+					parent[b] = a, --components;
+			}
+		}
+	free(parent);
+	return passages == cells - 1 && components == 1;
+}
+
+TEST_CASE(maze_stream_generates_perfect_mazes_row_by_row)
+{
+	const struct { int nrows, ncols; } sizes[] = { {1,1}, {1,9}, {9,1}, {2,2}, {17,33}, {40,70} };
+
+	for (int i = 0; i < (int)ARRAY_LENGTH(sizes); ++i)
+		for (uint64_t seed = 1; seed <= 5; ++seed) {
+			int nrows = sizes[i].nrows, ncols = sizes[i].ncols;
+			struct Maze *maze = Maze_create(nrows, ncols);
+			struct MazeStream *stream = MazeStream_create(nrows, ncols, seed);
+
+			bool rows_in_order = true, walls_agree = true;
+			for (int row = 0; !MazeStream_done(stream); ++row) {
+				struct MazeRow r = MazeStream_next(stream);
+				rows_in_order &= r.row == row && (r.above != NULL) == (row > 0);
+				memcpy(maze->bits + (size_t)row * maze->row_words, r.pairs,
+				       maze->row_words * sizeof(uint64_t));
+				for (int col = 0; col < ncols; ++col)
+					walls_agree &= MazeRow_passages(r, col)
+					            == Maze_passages_unchecked(maze, row, col);
+			}
+			TEST( rows_in_order && walls_agree );
+			TEST( maze_is_perfect(maze) );
+
+			MazeStream_destroy(stream);
+			Maze_destroy(maze);
+		}
+
+	TEST( MazeStream_create(0, 4, 1) == NULL );
+}
+
+static size_t write_maze(const struct Maze *maze, enum MazeFormat format, char *text, size_t size)
+{
+	FILE *file = tmpfile();
+	struct MazeWriter *writer = MazeWriter_create(file, format, maze->nrows, maze->ncols);
+	bool ok = true;
+	for (int row = 0; row < maze->nrows; ++row)
+		ok &= MazeWriter_write(writer, Maze_row(maze, row));
+	ok &= MazeWriter_flush(writer);
+	MazeWriter_destroy(writer);
+
+	rewind(file);
+	size_t length = fread(text, 1, size, file);
+	fclose(file);
+	return ok ? length : 0;
+}
+
+TEST_CASE(maze_writer_draws_ascii_and_pbm)
+{
+	// +--+
+	// |  |
+	// +  +
+	struct Maze *maze = Maze_create(2, 2);
+	Maze_link(maze, (struct GridPos){0, 0}, (struct GridPos){1, 0});
+	Maze_link(maze, (struct GridPos){0, 0}, (struct GridPos){0, 1});
+	Maze_link(maze, (struct GridPos){0, 1}, (struct GridPos){1, 1});
+
+	char text[256];
+	const char ascii[] =
+		"      \n"  " +--+ \n"  " |  | \n"
+		" |  | \n"  " +  + \n"  "      \n";
+	TEST( write_maze(maze, MAZE_ASCII, text, sizeof(text)) == sizeof(ascii) - 1 );
+	TEST( !memcmp(text, ascii, sizeof(ascii) - 1) );
+
+	// 5 x 5 pixels, one byte per line, padding black.
+	const unsigned char pbm[] = {
+		'P','4','\n','5',' ','5','\n',
+		0xFF, 0x8F, 0xAF, 0xAF, 0xFF };
+	TEST( write_maze(maze, MAZE_PBM, text, sizeof(text)) == sizeof(pbm) );
+	TEST( !memcmp(text, pbm, sizeof(pbm)) );
+
+	Maze_destroy(maze);
+	TEST( MazeWriter_create(stdout, MAZE_PBM, 0, 3) == NULL );
+}
+
+TEST_CASE(maze_save_and_open_mapped)
+{
+	const char *path = "test_krmaze.tmp";
+	struct Maze *maze = Maze_create(45, 70);
+	Maze_generate(maze, MAZE_KRUSKAL, 5);
+	TEST( Maze_save(maze, path) );
+
+	struct Maze *mapped = Maze_open_mapped(path);
+	TEST( mapped && mapped->nrows == 45 && mapped->ncols == 70 && mapped->row_words == 3 );
+	TEST( !memcmp(mapped->bits, maze->bits, 45 * 3 * sizeof(uint64_t)) );
+	TEST( maze_is_perfect(mapped) );
+	Maze_close_mapped(mapped);
+
+	// A grid file is not a maze file.
+	struct Grid *grid = Grid_create(4, 4, 1, GRID_ROW_MAJOR);
+	Grid_save(grid, path);
+	TEST( Maze_open_mapped(path) == NULL );
+	Grid_destroy(grid);
+	remove(path);
+	Maze_destroy(maze);
+}
+
+TEST_CASE(maze_generators_make_perfect_mazes)
+{
+	const struct { int nrows, ncols; } sizes[] = { {1,1}, {1,7}, {7,1}, {2,2}, {13,40}, {33,31} };
+
+	for (enum MazeAlgorithm a = 0; a < MAZE_ALGORITHM_COUNT; ++a)
+		for (int i = 0; i < (int)ARRAY_LENGTH(sizes); ++i)
+			for (uint64_t seed = 1; seed <= 3; ++seed) {
+				struct Maze *maze = Maze_create(sizes[i].nrows, sizes[i].ncols);
+				TEST( Maze_generate(maze, a, seed) );
+				TEST( maze_is_perfect(maze) );
+				Maze_destroy(maze);
+			}
+
+	// Same seed, same maze; Maze_generate replaces what was there.
+	struct Maze *a = Maze_create(20, 20), *b = Maze_create(20, 20);
+	Maze_generate(a, MAZE_WILSON, 9);
+	Maze_generate(b, MAZE_KRUSKAL, 9);
+	Maze_generate(b, MAZE_WILSON, 9);
+	TEST( !memcmp(a->bits, b->bits, 20 * a->row_words * sizeof(uint64_t)) );
+	Maze_destroy(a);
+	Maze_destroy(b);
+
+	TEST( MazeAlgorithm_scratch(MAZE_SIDEWINDER, 1000, 1000) == 0 );
+	TEST( MazeAlgorithm_scratch(MAZE_KRUSKAL, 1000, 1000) > 10 * 1000 * 1000 );
+	TEST( MazeAlgorithm_scratch(MAZE_ELLER, 1000000, 1000) < 100 * 1000 );
+	TEST( !strcmp(MazeAlgorithm_name(MAZE_BACKTRACKER), "backtracker") );
+}
+
+static bool path_is_walkable(const struct Maze *maze, const struct GridPos *path, int length)
+{
+	bool ok = true;
+	for (int k = 1; k < length; ++k) {
+		struct GridPos a = path[k - 1], b = path[k];
+		int dr = b.row - a.row, dc = b.col - a.col;
+		enum MazeDir dir = dr < 0 ? MAZE_NORTH : dr > 0 ? MAZE_SOUTH : dc > 0 ? MAZE_EAST : MAZE_WEST;
+		ok &= abs(dr) + abs(dc) == 1 && Maze_open(maze, a, dir);
+	}
+	return ok;
+}
+
+TEST_CASE(maze_distances_and_solve)
+{
+	// Serpentine 3 x 3: along the top, back along the middle, then the bottom.
+	struct Maze *maze = Maze_create(3, 3);
+	Maze_link(maze, (struct GridPos){0, 0}, (struct GridPos){0, 1});
+	Maze_link(maze, (struct GridPos){0, 1}, (struct GridPos){0, 2});
+	Maze_link(maze, (struct GridPos){0, 2}, (struct GridPos){1, 2});
+	Maze_link(maze, (struct GridPos){1, 2}, (struct GridPos){1, 1});
+	Maze_link(maze, (struct GridPos){1, 1}, (struct GridPos){1, 0});
+	Maze_link(maze, (struct GridPos){1, 0}, (struct GridPos){2, 0});
+	Maze_link(maze, (struct GridPos){2, 0}, (struct GridPos){2, 1});
+
+	struct Grid *d = Maze_distances(maze, (struct GridPos){0, 0});
+	const int expected[3][3] = { {0, 1, 2}, {5, 4, 3}, {6, 7, -1} };
+	bool same = true;
+	for (int row = 0; row < 3; ++row)
+		for (int col = 0; col < 3; ++col)
+			same &= GRID_AT(int, d, row, col) == expected[row][col];
+	TEST( same );
+	Grid_destroy(d);
+
+	struct GridPos path[16];
+	for (int bidirectional = 0; bidirectional < 2; ++bidirectional) {
+		TEST( Maze_solve(maze, (struct GridPos){0, 0}, (struct GridPos){2, 1}, bidirectional, path, 16) == 8 );
+		TEST( path[0].row == 0 && path[0].col == 0 && path[7].row == 2 && path[7].col == 1 );
+		TEST( path_is_walkable(maze, path, 8) );
+		TEST( Maze_solve(maze, (struct GridPos){0, 0}, (struct GridPos){2, 2}, bidirectional, path, 16) == -1 );
+		TEST( Maze_solve(maze, (struct GridPos){1, 1}, (struct GridPos){1, 1}, bidirectional, path, 16) == 1 );
+	}
+
+	// Only the first cells fit.
+	TEST( Maze_solve(maze, (struct GridPos){0, 0}, (struct GridPos){2, 1}, true, path, 3) == 8 );
+	TEST( path[2].row == 0 && path[2].col == 2 );
+
+	Maze_link(maze, (struct GridPos){2, 1}, (struct GridPos){2, 2});
+	struct MazeSpan span = Maze_diameter(maze);
+	TEST( span.length == 8 );
+	TEST( (span.from.row == 0 && span.from.col == 0) || (span.to.row == 0 && span.to.col == 0) );
+	Maze_destroy(maze);
+}
+
+TEST_CASE(maze_solve_agrees_both_ways_and_finds_diameter)
+{
+	struct GridPos path[2][40 * 40];
+	for (uint64_t seed = 1; seed <= 6; ++seed) {
+		struct Maze *maze = Maze_create(30, 40);
+		Maze_generate(maze, seed % MAZE_ALGORITHM_COUNT, seed);
+
+		struct GridPos a = { seed % 30, seed * 7 % 40 }, b = { 29 - seed, 39 - seed * 3 };
+		int one = Maze_solve(maze, a, b, false, path[0], 1200);
+		int two = Maze_solve(maze, a, b, true, path[1], 1200);
+		TEST( one > 0 && one == two );
+		TEST( !memcmp(path[0], path[1], one * sizeof(struct GridPos)) );
+		TEST( path_is_walkable(maze, path[0], one) );
+
+		struct Grid *d = Maze_distances(maze, a);
+		TEST( GRID_AT(int, d, b.row, b.col) == one - 1 );
+		Grid_destroy(d);
+
+		// Longest of all shortest paths, by brute force.
+		int longest = 0;
+		for (int row = 0; row < 30; ++row)
+			for (int col = 0; col < 40; col += 13) {
+				d = Maze_distances(maze, (struct GridPos){row, col});
+				for (int i = 0; i < 30 * 40; ++i)
+					longest = int_max(longest, ((int*)d->cells)[i]);
+				Grid_destroy(d);
+			}
+		struct MazeSpan span = Maze_diameter(maze);
+		TEST( span.length >= longest );
+		d = Maze_distances(maze, span.from);
+		TEST( GRID_AT(int, d, span.to.row, span.to.col) == span.length );
+		Grid_destroy(d);
+		Maze_destroy(maze);
+	}
+
+	// With loops, both directions still find a shortest path.
+	struct Maze *open = Maze_create(9, 9);
+	for (int row = 0; row < 9; ++row)
+		for (int col = 0; col < 9; ++col) {
+			Maze_link(open, (struct GridPos){row, col}, (struct GridPos){row + 1, col});
+			Maze_link(open, (struct GridPos){row, col}, (struct GridPos){row, col + 1});
+		}
+	TEST( Maze_solve(open, (struct GridPos){0, 0}, (struct GridPos){8, 8}, false, path[0], 81) == 17 );
+	TEST( Maze_solve(open, (struct GridPos){0, 0}, (struct GridPos){8, 8}, true, path[1], 81) == 17 );
+	TEST( path_is_walkable(open, path[1], 17) );
+	Maze_destroy(open);
+}
+
+TEST_CASE(maze_searches_refuse_mazes_past_int_indexes)
+{
+	// One row more than MAZE_MAX_CELLS allows; calloc leaves the bits
+	// untouched, and the searches must not start.
+	int ncols = 1 << 15, nrows = MAZE_MAX_CELLS / ncols + 1;
+	struct Maze *maze = Maze_create(nrows, ncols);
+	if (!maze)
+		return;
+	struct GridPos corner = { nrows - 1, ncols - 1 }, path[1];
+
+	TEST( Maze_distances(maze, corner) == NULL );
+	TEST( Maze_solve(maze, (struct GridPos){0, 0}, corner, false, path, 1) == -2 );
+	TEST( Maze_solve(maze, (struct GridPos){0, 0}, corner, true, path, 1) == -2 );
+	TEST( Maze_diameter(maze).length == -1 );
+	Maze_destroy(maze);
+}
+
+TEST_CASE(maze_tiled_generation_is_perfect_and_thread_independent)
+{
+	const struct { int nrows, ncols, tile; } cases[] = {
+		{ 1, 1, 1 }, { 50, 70, 8 }, { 64, 64, 32 }, { 33, 100, 16 }, { 100, 20, 7 } };
+
+	for (int i = 0; i < (int)ARRAY_LENGTH(cases); ++i) {
+		int nrows = cases[i].nrows, ncols = cases[i].ncols;
+		struct Maze *one = Maze_create(nrows, ncols), *many = Maze_create(nrows, ncols);
+		enum MazeAlgorithm algorithm = i % MAZE_ALGORITHM_COUNT;
+
+		TEST( Maze_generate_tiled(one, algorithm, 77, cases[i].tile, 1) );
+		TEST( Maze_generate_tiled(many, algorithm, 77, cases[i].tile, 3) );
+		TEST( maze_is_perfect(one) );
+		TEST( !memcmp(one->bits, many->bits, nrows * one->row_words * sizeof(uint64_t)) );
+
+		Maze_destroy(one);
+		Maze_destroy(many);
+	}
+
+	struct Maze *maze = Maze_create(10, 10);
+	TEST( !Maze_generate_tiled(maze, MAZE_KRUSKAL, 1, 0, 2) );
+	Maze_destroy(maze);
+}
@@ -0,0 +1,150 @@
+#include "krstats.h"
+#include "test.h"
+#include <math.h>
+
+//-----------------------------------------------------------------------------
+// Quantile Sketch
+
+static bool within(double x, double expect, double relative)
+{
+	return fabs(x - expect) <= fabs(expect) * relative;
+}
+
+TEST_CASE(ddsketch_quantiles_within_relative_accuracy)
+{
+	static struct DDSketch s;
+	DDSketch_init(&s, 0.01);
+	TEST( isnan(DDSketch_quantile(&s, 0.5)) );
+
+	for (int i = 1; i <= 10000; ++i)
+		DDSketch_add(&s, i);
+
+	TEST( s.count == 10000 );
+	TEST( within(DDSketch_quantile(&s, 0.50), 5000.0, 0.01) );
+	TEST( within(DDSketch_quantile(&s, 0.99), 9900.0, 0.01) );
+	TEST( DDSketch_quantile(&s, 0.0) == 1.0 );
+	TEST( DDSketch_quantile(&s, 1.0) == 10000.0 );
+	TEST( isnan(DDSketch_quantile(&s, 1.5)) );
+}
+
+TEST_CASE(ddsketch_counts_negatives_and_zero)
+{
+	static struct DDSketch s;
+	DDSketch_init(&s, 0.02);
+	DDSketch_add_span(&s, (nuspan)SPAN_INIT( ((double[]){ -100, -10, 0, 0, 10, 100, NAN, INFINITY }) ));
+
+	TEST( s.count == 6 );
+	TEST( s.zero_count == 2 );
+	TEST( DDSketch_quantile(&s, 0.0) == -100.0 );
+	TEST( within(DDSketch_quantile(&s, 0.2), -10.0, 0.02) );
+	TEST( DDSketch_quantile(&s, 0.5) == 0.0 );
+	TEST( within(DDSketch_quantile(&s, 0.8), 10.0, 0.02) );
+}
+
+TEST_CASE(ddsketch_merge_matches_single_stream)
+{
+	static struct DDSketch whole, a, b;
+	DDSketch_init(&whole, 0.01);
+	DDSketch_init(&a, 0.01);
+	DDSketch_init(&b, 0.01);
+
+	for (int i = 1; i <= 5000; ++i) {
+		double x = i * 0.37;
+		DDSketch_add(&whole, x);
+		DDSketch_add((i % 2) ? &a : &b, x);
+	}
+
+	TEST( DDSketch_merge(&a, &b) );
+	TEST( a.count == whole.count );
+	for (double q = 0.0; q <= 1.0; q += 0.125)
+		TEST( DDSketch_quantile(&a, q) == DDSketch_quantile(&whole, q) );
+}
+
+TEST_CASE(ddsketch_memory_stays_bounded)
+{
+	static struct DDSketch s;
+	DDSketch_init(&s, 0.01);
+
+	// Twelve decades need more buckets than one store holds.
+	for (double x = 1e-6; x < 1e6; x *= 1.001)
+		DDSketch_add(&s, x);
+
+	TEST( s.positive.hi - s.positive.offset < DDSKETCH_BINS );
+	TEST( within(DDSketch_quantile(&s, 0.99), 1e6 * pow(1.001, -0.01 * s.count), 0.01) );
+	TEST( DDSketch_quantile(&s, 1.0) == s.max );
+}
+
+TEST_CASE(ddsketch_encode_round_trip)
+{
+	static struct DDSketch s, t;
+	DDSketch_init(&s, 0.01);
+	for (int i = -500; i <= 2000; ++i)
+		DDSketch_add(&s, i * 1.5);
+
+	int size = DDSketch_encode(&s, NULL, 0);
+	TEST( size > 0 && size < (int)sizeof(s) / 4 );
+
+	byte buf[4096];
+	TEST( DDSketch_encode(&s, buf, sizeof(buf)) == size );
+	TEST( DDSketch_decode(&t, buf, size) );
+	TEST( t.count == s.count );
+	for (double q = 0.0; q <= 1.0; q += 0.1)
+		TEST( DDSketch_quantile(&t, q) == DDSketch_quantile(&s, q) );
+
+	TEST( !DDSketch_decode(&t, buf, size / 2) );
+}
+
+//-----------------------------------------------------------------------------
+// Log-Linear Histogram
+
+TEST_CASE(log_histogram_buckets)
+{
+	struct Interval b = LogHistogram_bucket(-LOGHIST_MIN_EXP * LOGHIST_SUB);
+	TEST( b.left == 1.0 );
+	TEST( b.right == 1.0 + 1.0 / LOGHIST_SUB );
+
+	b = LogHistogram_bucket(LOGHIST_BUCKETS - 1);
+	TEST( b.right == ldexp(1.0, LOGHIST_MAX_EXP) );
+}
+
+TEST_CASE(log_histogram_quantiles)
+{
+	static struct LogHistogram h;
+	LogHistogram_init(&h);
+	for (int i = 1; i <= 10000; ++i)
+		LogHistogram_add(&h, i);
+
+	TEST( h.count == 10000 );
+	TEST( h.sum == 10000.0 * 10001.0 / 2.0 );
+	TEST( within(LogHistogram_quantile(&h, 0.5),  5000.0, 1.0 / LOGHIST_SUB) );
+	TEST( within(LogHistogram_quantile(&h, 0.99), 9900.0, 1.0 / LOGHIST_SUB) );
+	TEST( LogHistogram_quantile(&h, 1.0) <= 10000.0 );
+
+	nuspan odd = $N(0.0, -1.0, 1e300, NAN);
+	LogHistogram_add_span(&h, odd);
+	TEST( h.count == 10003 );
+	TEST( h.underflow == 2 );
+	TEST( h.overflow == 1 );
+	TEST( LogHistogram_quantile(&h, 0.0) == -1.0 );
+	TEST( LogHistogram_quantile(&h, 1.0) == 1e300 );
+}
+
+TEST_CASE(log_histogram_merge_and_encode)
+{
+	static struct LogHistogram a, b, c;
+	LogHistogram_init(&a);
+	LogHistogram_init(&b);
+	for (int i = 0; i < 1000; ++i) {
+		LogHistogram_add(&a, 0.001 * i);
+		LogHistogram_add(&b, 1000.0 + i);
+	}
+	LogHistogram_merge(&a, &b);
+	TEST( a.count == 2000 );
+	TEST( a.max == 1999.0 );
+
+	byte buf[8192];
+	int size = LogHistogram_encode(&a, buf, sizeof(buf));
+	TEST( size < (int)sizeof(a) / 4 );
+	TEST( LogHistogram_decode(&c, buf, size) );
+	TEST( !memcmp(&a, &c, sizeof(a)) );
+}